@@ -37,6 +37,7 @@
 #endif
 
 #include <string.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
@@ -79,6 +80,210 @@ wipememory (void *ptr, size_t len)
 }
 
 
+/* The items and their strings may be allocated from an arena which
+ * is released in one step.  The arena used by a thread is set with
+ * cJSON_SetArena.  Larger strings are always taken from the heap.
+ * Memory of the arena is wiped when it is released.  */
+#define ARENA_CHUNKSIZE (64 * 1024)
+#define ARENA_MAXALLOC  2048
+#define ARENA_MAXPOOL   16   /* Number of unused chunks kept.  */
+
+/* The flags of cJSON.arena.  */
+#define ARENA_ITEM   1
+#define ARENA_VALUE  2   /* The valuestring.  */
+#define ARENA_NAME   4   /* The string.  */
+
+struct arena_chunk_s
+{
+  struct arena_chunk_s *next;
+  size_t used;                  /* Used bytes of DATA.  */
+  union { double d; void *p; long l; } data[1];
+};
+#define ARENA_DATASIZE (ARENA_CHUNKSIZE - offsetof (struct arena_chunk_s, data))
+
+struct cJSON_arena_s
+{
+  struct arena_chunk_s *chunks; /* The current chunk first.  */
+};
+
+/* Unused and wiped chunks.  */
+static struct arena_chunk_s *chunk_pool;
+static int chunk_pool_len;
+GPGRT_LOCK_DEFINE (chunk_pool_lock);
+
+#ifdef HAVE_TLS
+static __thread cjson_arena_t current_arena;
+
+/* Set while cJSON_ParseInPlace runs in this thread.  */
+static __thread int parse_in_place;
+#endif
+
+
+static void *
+arena_alloc (cjson_arena_t arena, size_t n)
+{
+  struct arena_chunk_s *chunk = arena->chunks;
+  void *p;
+
+  n = (n + sizeof chunk->data[0] - 1) & ~(sizeof chunk->data[0] - 1);
+  if (!chunk || chunk->used + n > ARENA_DATASIZE)
+    {
+      gpgrt_lock_lock (&chunk_pool_lock);
+      chunk = chunk_pool;
+      if (chunk)
+        {
+          chunk_pool = chunk->next;
+          chunk_pool_len--;
+        }
+      gpgrt_lock_unlock (&chunk_pool_lock);
+      if (!chunk)
+        chunk = xtrycalloc (1, ARENA_CHUNKSIZE);
+      if (!chunk)
+        return NULL;
+      chunk->next = arena->chunks;
+      arena->chunks = chunk;
+    }
+
+  p = (char *)chunk->data + chunk->used;
+  chunk->used += n;
+  return p;
+}
+
+
+/* Allocate N bytes of cleared memory for an item or its strings.
+ * FLAG is set in *FLAGS if the memory is taken from the arena and
+ * cleared otherwise.  */
+static void *
+item_alloc (size_t n, unsigned int *flags, unsigned int flag)
+{
+#ifdef HAVE_TLS
+  if (current_arena && n <= ARENA_MAXALLOC)
+    {
+      void *p = arena_alloc (current_arena, n);
+      if (p)
+        {
+          *flags |= flag;
+          return p;
+        }
+    }
+#endif
+  *flags &= ~flag;
+  return xtrycalloc (1, n);
+}
+
+
+static char *
+item_strdup (const char *string, unsigned int *flags, unsigned int flag)
+{
+  size_t n = strlen (string) + 1;
+  char *p;
+
+  p = item_alloc (n, flags, flag);
+  if (p)
+    memcpy (p, string, n);
+  return p;
+}
+
+
+/* Release P.  With WIPE the string P is wiped first.  Memory of an
+ * arena, as told by IN_ARENA, is not released and only wiped along
+ * with the arena.  */
+static void
+item_free (void *p, int wipe, int in_arena)
+{
+  if (in_arena)
+    return;
+  if (wipe && p)
+    wipememory (p, strlen (p));
+  xfree (p);
+}
+
+
+/* Make the valuestring of ITEM its name.  */
+static void
+value_to_name (cJSON *item)
+{
+  item->string = item->valuestring;
+  item->valuestring = NULL;
+  if ((item->arena & ARENA_VALUE))
+    item->arena = (item->arena & ~ARENA_VALUE) | ARENA_NAME;
+  else
+    item->arena &= ~ARENA_NAME;
+}
+
+
+/* Create an arena for cJSON_SetArena.  Returns NULL on error.  */
+cjson_arena_t
+cJSON_CreateArena (void)
+{
+  return xtrycalloc (1, sizeof (struct cJSON_arena_s));
+}
+
+
+/* Release ARENA and all items allocated from it.  */
+void
+cJSON_ReleaseArena (cjson_arena_t arena)
+{
+  struct arena_chunk_s *chunk;
+
+  if (!arena)
+    return;
+
+#ifdef HAVE_TLS
+  if (current_arena == arena)
+    current_arena = NULL;
+#endif
+  while ((chunk = arena->chunks))
+    {
+      arena->chunks = chunk->next;
+      wipememory (chunk->data, chunk->used);
+      chunk->used = 0;
+      gpgrt_lock_lock (&chunk_pool_lock);
+      if (chunk_pool_len < ARENA_MAXPOOL)
+        {
+          chunk->next = chunk_pool;
+          chunk_pool = chunk;
+          chunk_pool_len++;
+          chunk = NULL;
+        }
+      gpgrt_lock_unlock (&chunk_pool_lock);
+      xfree (chunk);
+    }
+  xfree (arena);
+}
+
+
+/* Allocate the items created by the calling thread from ARENA or
+ * from the heap if ARENA is NULL.  Items of the arena may be deleted
+ * with any or no arena set but not after the arena has been
+ * released.  Returns the arena set before.  */
+cjson_arena_t
+cJSON_SetArena (cjson_arena_t arena)
+{
+#ifdef HAVE_TLS
+  cjson_arena_t prev = current_arena;
+
+  current_arena = arena;
+  return prev;
+#else
+  (void)arena;
+  return NULL;
+#endif
+}
+
+
+/* Return the arena of the calling thread or NULL.  */
+cjson_arena_t
+cJSON_GetArena (void)
+{
+#ifdef HAVE_TLS
+  return current_arena;
+#else
+  return NULL;
+#endif
+}
+
+
 static int
 cJSON_strcasecmp (const char *s1, const char *s2)
 {
@@ -98,7 +303,13 @@ cJSON_strcasecmp (const char *s1, const char *s2)
 static cJSON *
 cJSON_New_Item (void)
 {
-  return xtrycalloc (1, sizeof (cJSON));
+  unsigned int flags = 0;
+  cJSON *item;
+
+  item = item_alloc (sizeof (cJSON), &flags, ARENA_ITEM);
+  if (item)
+    item->arena = flags;
+  return item;
 }
 
 /* Delete a cJSON structure.  (Does not clobber ERRNO). */
@@ -118,16 +329,10 @@ cJSON_Delete (cJSON * c)
       if (!(c->type & cJSON_IsReference) && c->child)
 	cJSON_Delete (c->child);
       if (!(c->type & cJSON_IsReference) && c->valuestring)
-        {
-          wipememory (c->valuestring, strlen (c->valuestring));
-          xfree (c->valuestring);
-        }
+        item_free (c->valuestring, 1, (c->arena & ARENA_VALUE));
       if (c->string)
-        {
-          wipememory (c->string, strlen (c->string));
-          xfree (c->string);
-        }
-      xfree (c);
+        item_free (c->string, 1, (c->arena & ARENA_NAME));
+      item_free (c, 0, (c->arena & ARENA_ITEM));
       c = next;
     }
   errno = save_errno;
@@ -306,10 +511,9 @@ parse_string (cJSON * item, const char *str, const char **ep)
     if (*ptr++ == '\\' && *ptr)
       ptr++;			/* Skip escaped quotes. */
 
-  out = xtrymalloc (len + 2);	/* This is how long we need for the
-                                 * string, roughly.  We add one extra
-                                 * byte in case the last input
-                                 * character is a backslash.  */
+  /* This is how long we need for the string, roughly.  We add one
+   * extra byte in case the last input character is a backslash.  */
+  out = item_alloc (len + 2, &item->arena, ARENA_VALUE);
   if (!out)
     return 0;
 
@@ -409,6 +613,28 @@ parse_string (cJSON * item, const char *str, const char **ep)
   return ptr;
 }
 
+#ifdef HAVE_TLS
+/* Parse the string value at STR without copying it.  This is only
+ * done for strings without escapes which are too long for the arena.
+ * Returns NULL if the string needs to be copied.  */
+static const char *
+parse_string_in_place (cJSON * item, const char *str)
+{
+  const char *ptr = str + 1;
+
+  while (*ptr != '\"' && *ptr != '\\' && *ptr)
+    ptr++;
+  if (*ptr != '\"' || ptr - (str + 1) <= ARENA_MAXALLOC)
+    return NULL;
+
+  /* The caller of cJSON_ParseInPlace passed a writable buffer.  */
+  *(char *)ptr = 0;
+  item->valuestring = (char *)str + 1;
+  item->type = cJSON_String | cJSON_IsReference;
+  return ptr + 1;
+}
+#endif /*HAVE_TLS*/
+
 /* Render the cstring provided to an escaped version that can be printed. */
 static char *
 print_string_ptr (const char *str)
@@ -559,6 +785,21 @@ cJSON_Parse (const char *value, size_t *r_erroff)
   return cJSON_ParseWithOpts (value, 0, 0, r_erroff);
 }
 
+cJSON *
+cJSON_ParseInPlace (char *value, size_t *r_erroff)
+{
+  cJSON *c;
+
+#ifdef HAVE_TLS
+  parse_in_place = 1;
+#endif
+  c = cJSON_ParseWithOpts (value, 0, 0, r_erroff);
+#ifdef HAVE_TLS
+  parse_in_place = 0;
+#endif
+  return c;
+}
+
 /* Render a cJSON item/entity/structure to text. */
 char *
 cJSON_Print (cJSON * item)
@@ -603,6 +844,12 @@ parse_value (cJSON * item, const char *value, const char **ep,
     }
   if (*value == '\"')
     {
+#ifdef HAVE_TLS
+      const char *end;
+
+      if (parse_in_place && (end = parse_string_in_place (item, value)))
+        return end;
+#endif
       return parse_string (item, value, ep);
     }
   if (*value == '-' || (*value >= '0' && *value <= '9'))
@@ -817,8 +1064,7 @@ parse_object (cJSON * item, const char *value, const char **ep,
   value = skip (parse_string (child, skip (value), ep));
   if (!value)
     return 0;
-  child->string = child->valuestring;
-  child->valuestring = 0;
+  value_to_name (child);
   if (*value != ':')
     {
       *ep = value;
@@ -841,8 +1087,7 @@ parse_object (cJSON * item, const char *value, const char **ep,
       value = skip (parse_string (child, skip (value + 1), ep));
       if (!value)
 	return 0;
-      child->string = child->valuestring;
-      child->valuestring = 0;
+      value_to_name (child);
       if (*value != ':')
 	{
 	  *ep = value;
@@ -1019,11 +1264,15 @@ static cJSON *
 create_reference (cJSON * item)
 {
   cJSON *ref = cJSON_New_Item ();
+  unsigned int flags;
+
   if (!ref)
     return 0;
+  flags = ref->arena;
   memcpy (ref, item, sizeof (cJSON));
   ref->string = 0;
   ref->type |= cJSON_IsReference;
+  ref->arena = flags;
   ref->next = ref->prev = 0;
   return ref;
 }
@@ -1053,16 +1302,18 @@ cJSON *
 cJSON_AddItemToObject (cJSON * object, const char *string, cJSON * item)
 {
   char *tmp;
+  unsigned int flags = 0;
 
   if (!item)
     return 0;
-  tmp = xtrystrdup (string);
+  tmp = item_strdup (string, &flags, ARENA_NAME);
   if (!tmp)
     return NULL;
 
   if (item->string)
-    xfree (item->string);
+    item_free (item->string, 0, (item->arena & ARENA_NAME));
   item->string = tmp;
+  item->arena = (item->arena & ~ARENA_NAME) | flags;
   cJSON_AddItemToArray (object, item);
   return object;
 }
@@ -1239,7 +1490,7 @@ cJSON_ReplaceItemInObject (cJSON * object, const char *string,
     {
       /* FIXME: I guess we should free newitem->string here.  See
        * upstream commit 0d10e279c8b604f71829b5d49d092719f4ae96b6.  */
-      newitem->string = xtrystrdup (string);
+      newitem->string = item_strdup (string, &newitem->arena, ARENA_NAME);
       cJSON_ReplaceItemInArray (object, i, newitem);
     }
 }
@@ -1301,7 +1552,7 @@ cJSON_CreateString (const char *string)
   if (item)
     {
       item->type = cJSON_String;
-      item->valuestring = xtrystrdup (string);
+      item->valuestring = item_strdup (string, &item->arena, ARENA_VALUE);
     }
   return item;
 }
@@ -1422,7 +1673,8 @@ cJSON_Duplicate (cJSON * item, int recurse)
     item->valueint, newitem->valuedouble = item->valuedouble;
   if (item->valuestring)
     {
-      newitem->valuestring = xtrystrdup (item->valuestring);
+      newitem->valuestring = item_strdup (item->valuestring,
+                                          &newitem->arena, ARENA_VALUE);
       if (!newitem->valuestring)
 	{
 	  cJSON_Delete (newitem);
@@ -1431,7 +1683,8 @@ cJSON_Duplicate (cJSON * item, int recurse)
     }
   if (item->string)
     {
-      newitem->string = xtrystrdup (item->string);
+      newitem->string = item_strdup (item->string,
+                                     &newitem->arena, ARENA_NAME);
       if (!newitem->string)
 	{
 	  cJSON_Delete (newitem);
@@ -67,24 +67,44 @@ typedef struct cJSON
   /* The item's name string, if this item is the child of, or is in
      the list of subitems of an object. */
   char *string;
+
+  /* Flags telling which of the item, valuestring and string are
+     allocated from an arena.  */
+  unsigned int arena;
 } cJSON;
 
 typedef struct cJSON *cjson_t;
 
-/* Macros to test the type of an object.  */
-#define cjson_is_boolean(a) (!((a)->type & ~1))
-#define cjson_is_false(a)   ((a)->type == cJSON_False)
-#define cjson_is_true(a)    ((a)->type == cJSON_True)
-#define cjson_is_null(a)    ((a)->type == cJSON_NULL)
-#define cjson_is_number(a)  ((a)->type == cJSON_Number)
-#define cjson_is_string(a)  ((a)->type == cJSON_String)
-#define cjson_is_array(a)   ((a)->type == cJSON_Array)
-#define cjson_is_object(a)  ((a)->type == cJSON_Object)
+/* An arena to allocate items from.  */
+typedef struct cJSON_arena_s *cjson_arena_t;
+
+/* Macros to test the type of an object.  The flags are ignored.  */
+#define cjson_is_boolean(a) (!((a)->type & 254))
+#define cjson_is_false(a)   (((a)->type & 255) == cJSON_False)
+#define cjson_is_true(a)    (((a)->type & 255) == cJSON_True)
+#define cjson_is_null(a)    (((a)->type & 255) == cJSON_NULL)
+#define cjson_is_number(a)  (((a)->type & 255) == cJSON_Number)
+#define cjson_is_string(a)  (((a)->type & 255) == cJSON_String)
+#define cjson_is_array(a)   (((a)->type & 255) == cJSON_Array)
+#define cjson_is_object(a)  (((a)->type & 255) == cJSON_Object)
+
+/* Allocate the items of the calling thread from an arena which is
+   released in one step.  */
+extern cjson_arena_t cJSON_CreateArena(void);
+extern void cJSON_ReleaseArena(cjson_arena_t arena);
+extern cjson_arena_t cJSON_SetArena(cjson_arena_t arena);
+extern cjson_arena_t cJSON_GetArena(void);
 
 /* Supply a block of JSON, and this returns a cJSON object you can
    interrogate. Call cJSON_Delete when finished. */
 extern cJSON *cJSON_Parse(const char *value, size_t *r_erroff);
 
+/* Parse VALUE which is modified and must stay valid as long as the
+   returned object.  Long strings without escapes are not copied but
+   terminated in place and flagged with cJSON_IsReference.  Without
+   thread-local storage this is the same as cJSON_Parse.  */
+extern cJSON *cJSON_ParseInPlace(char *value, size_t *r_erroff);
+
 /* Render a cJSON entity to text for transfer/storage. Free the char*
    when finished. */
 extern char  *cJSON_Print(cJSON *item);
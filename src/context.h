@@ -140,6 +140,10 @@ struct gpgme_context
   /* True if the option --proc-all-sigs shall be passed to gpg.  */
   unsigned int proc_all_sigs : 1;
 
+  /* True if the engine process shall be tracked to collect its exit
+   * status and resource usage.  */
+  unsigned int engine_stats : 1;
+
   /* Pass --expert to gpg edit key. */
   unsigned int extended_edit : 1;
 
@@ -152,6 +156,16 @@ struct gpgme_context
   /* Number of certs to be included.  */
   unsigned int include_certs;
 
+  /* The maximum run time of an operation in milliseconds or 0 for no
+   * limit, and the absolute deadline of the current operation as
+   * returned by _gpgme_monotonic_ms (or 0).  DEADLINE is protected by
+   * LOCK.  */
+  unsigned int deadline_ms;
+  unsigned long long deadline;
+
+  /* The value of DEADLINE_MS as returned by gpgme_get_ctx_flag.  */
+  char deadline_ms_str[12];
+
   /* The actual number of keys in SIGNERS, the allocated size of the
    * array, and the array with the signing keys.  */
   unsigned int signers_len;
@@ -218,6 +232,9 @@ struct gpgme_context
      operation.  */
   struct fd_table fdt;
   struct gpgme_io_cbs io_cbs;
+
+  /* The binding to a reactor or NULL.  See wait-reactor.c.  */
+  struct reactor_ctx_s *reactor;
 };
 
 #endif	/* CONTEXT_H */
@@ -0,0 +1,361 @@
+/* data-base64.c - A data object decoding or encoding Base64.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GPGME.
+ *
+ * GPGME is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GPGME is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <https://gnu.org/licenses/>.
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "data.h"
+
+
+/* Set ERRNO from the error ERR and return -1.  */
+static int
+set_errno (gpg_error_t err)
+{
+  int ec = gpg_err_code_to_errno (gpg_err_code (err));
+
+  gpg_err_set_errno (ec? ec : EINVAL);
+  return -1;
+}
+
+
+
+/* Decoding.  Data read from the object is the decoded content of the
+   inner data object.  The Base64 text is read into the caller's
+   buffer and decoded in place.  */
+
+static gpgme_ssize_t
+b64dec_read (gpgme_data_t dh, void *buffer, size_t size)
+{
+  gpg_error_t err;
+  gpgme_ssize_t amt;
+  size_t nbytes;
+  size_t total = 0;
+
+  /* The decoded data is shorter than the Base64 text; thus we read
+   * until BUFFER is filled so that our callers see full reads.  */
+  while (total < size && dh->data.b64.state)
+    {
+      amt = gpgme_data_read (dh->data.b64.inner, (char *)buffer + total,
+                             size - total);
+      if (amt < 0)
+        return -1;
+      if (!amt)
+        {
+          err = gpgrt_b64dec_finish (dh->data.b64.state);
+          dh->data.b64.state = NULL;  /* EOF.  */
+          if (err)
+            return set_errno (err);
+          break;
+        }
+      err = gpgrt_b64dec_proc (dh->data.b64.state, (char *)buffer + total,
+                               amt, &nbytes);
+      if (err)
+        return set_errno (err);
+      total += nbytes;
+    }
+
+  dh->data.b64.offset += total;
+  return total;
+}
+
+
+/* Restart decoding at the position of the inner data object at the
+   time the object was created.  */
+static int
+b64dec_rewind (gpgme_data_t dh)
+{
+  if (dh->data.b64.start < 0)
+    {
+      gpg_err_set_errno (ESPIPE);
+      return -1;
+    }
+  if (gpgme_data_seek (dh->data.b64.inner, dh->data.b64.start, SEEK_SET)
+      != dh->data.b64.start)
+    return -1;
+  gpgrt_b64dec_finish (dh->data.b64.state);
+  dh->data.b64.state = gpgrt_b64dec_start (dh->data.b64.title);
+  if (!dh->data.b64.state)
+    return -1;
+  dh->data.b64.offset = 0;
+  return 0;
+}
+
+
+/* The decoded data can't be accessed randomly.  Seeking backwards
+   thus restarts decoding and seeking forward skips data.  */
+static gpgme_off_t
+b64dec_seek (gpgme_data_t dh, gpgme_off_t offset, int whence)
+{
+  char buffer[512];
+
+  switch (whence)
+    {
+    case SEEK_SET:
+      break;
+    case SEEK_CUR:
+      offset += dh->data.b64.offset;
+      break;
+    default:
+      gpg_err_set_errno (ESPIPE);
+      return -1;
+    }
+  if (offset < 0)
+    {
+      gpg_err_set_errno (EINVAL);
+      return -1;
+    }
+
+  if (offset < dh->data.b64.offset && b64dec_rewind (dh))
+    return -1;
+  while (dh->data.b64.offset < offset)
+    {
+      gpgme_off_t n = offset - dh->data.b64.offset;
+      gpgme_ssize_t amt;
+
+      amt = b64dec_read (dh, buffer, n < sizeof buffer? n : sizeof buffer);
+      if (amt < 0)
+        return -1;
+      if (!amt)
+        {
+          gpg_err_set_errno (EINVAL);
+          return -1;
+        }
+    }
+  return offset;
+}
+
+
+static gpgme_ssize_t
+b64dec_write (gpgme_data_t dh, const void *buffer, size_t size)
+{
+  (void)dh;
+  (void)buffer;
+  (void)size;
+
+  gpg_err_set_errno (EBADF);
+  return -1;
+}
+
+
+
+/* Encoding.  Data written to the object is encoded and written to
+   the inner data object.  The encoder of libgpg-error writes to a
+   stream which forwards to the inner data object.  */
+
+static gpgrt_ssize_t
+b64enc_cookie_write (void *cookie, const void *buffer, size_t size)
+{
+  gpgme_data_t inner = cookie;
+  const char *p = buffer;
+  size_t left = size;
+
+  if (!buffer && !size)
+    return 0;  /* Flush request.  */
+
+  while (left)
+    {
+      gpgme_ssize_t n = gpgme_data_write (inner, p, left);
+
+      if (n < 0)
+        return -1;
+      if (!n)
+        {
+          gpg_err_set_errno (EIO);
+          return -1;
+        }
+      p += n;
+      left -= n;
+    }
+  return size;
+}
+
+
+static gpgme_ssize_t
+b64enc_read (gpgme_data_t dh, void *buffer, size_t size)
+{
+  (void)dh;
+  (void)buffer;
+  (void)size;
+
+  gpg_err_set_errno (EBADF);
+  return -1;
+}
+
+
+static gpgme_ssize_t
+b64enc_write (gpgme_data_t dh, const void *buffer, size_t size)
+{
+  gpg_error_t err;
+
+  if (!dh->data.b64.state)
+    {
+      gpg_err_set_errno (EBADF);
+      return -1;
+    }
+  err = gpgrt_b64enc_write (dh->data.b64.state, buffer, size);
+  if (err)
+    return set_errno (err);
+  dh->data.b64.offset += size;
+  return size;
+}
+
+
+/* Only the current position, which is the number of bytes written so
+   far, can be sought.  */
+static gpgme_off_t
+b64enc_seek (gpgme_data_t dh, gpgme_off_t offset, int whence)
+{
+  switch (whence)
+    {
+    case SEEK_SET:
+      break;
+    case SEEK_CUR:
+    case SEEK_END:
+      offset += dh->data.b64.offset;
+      break;
+    default:
+      gpg_err_set_errno (EINVAL);
+      return -1;
+    }
+  if (offset != dh->data.b64.offset)
+    {
+      gpg_err_set_errno (ESPIPE);
+      return -1;
+    }
+  return offset;
+}
+
+
+
+static void
+b64_release (gpgme_data_t dh)
+{
+  if ((dh->data.b64.flags & GPGME_DATA_BASE64_ENCODE))
+    {
+      /* Write the pending data and the armor footer.  */
+      gpgrt_b64enc_finish (dh->data.b64.state);
+      gpgrt_fclose (dh->data.b64.stream);
+    }
+  else
+    gpgrt_b64dec_finish (dh->data.b64.state);
+
+  if ((dh->data.b64.flags & GPGME_DATA_BASE64_OWN))
+    gpgme_data_release (dh->data.b64.inner);
+  free (dh->data.b64.title);
+}
+
+
+static struct _gpgme_data_cbs b64dec_cbs =
+  {
+    b64dec_read,
+    b64dec_write,
+    b64dec_seek,
+    b64_release,
+    NULL
+  };
+
+static struct _gpgme_data_cbs b64enc_cbs =
+  {
+    b64enc_read,
+    b64enc_write,
+    b64enc_seek,
+    b64_release,
+    NULL
+  };
+
+
+/* Create a new data object on top of INNER.  Unless FLAGS has
+   GPGME_DATA_BASE64_ENCODE set, reading from it returns the decoded
+   content of INNER; otherwise data written to it is written Base64
+   encoded to INNER.  If TITLE is not NULL PEM or OpenPGP armor with
+   that title is expected or written.  */
+gpgme_error_t
+gpgme_data_new_base64 (gpgme_data_t *r_dh, gpgme_data_t inner,
+                       const char *title, unsigned int flags)
+{
+  gpgme_error_t err;
+  gpgme_data_t dh;
+  int encode = !!(flags & GPGME_DATA_BASE64_ENCODE);
+  static gpgrt_cookie_io_functions_t cookie_functions =
+    {
+      NULL,
+      b64enc_cookie_write,
+      NULL,
+      NULL
+    };
+  TRACE_BEG  (DEBUG_DATA, "gpgme_data_new_base64", r_dh,
+	      "inner=%p, title=%s, flags=0x%x",
+              inner, title? title : "(null)", flags);
+
+  if (!r_dh || !inner)
+    return TRACE_ERR (gpg_error (GPG_ERR_INV_VALUE));
+
+  err = _gpgme_data_new (&dh, encode? &b64enc_cbs : &b64dec_cbs);
+  if (err)
+    return TRACE_ERR (err);
+
+  if (title)
+    {
+      dh->data.b64.title = strdup (title);
+      if (!dh->data.b64.title)
+        goto syserror;
+    }
+
+  if (encode)
+    {
+      dh->data.b64.stream = gpgrt_fopencookie (inner, "w", cookie_functions);
+      if (!dh->data.b64.stream)
+        goto syserror;
+      dh->data.b64.state = gpgrt_b64enc_start (dh->data.b64.stream, title);
+      if (!dh->data.b64.state)
+        {
+          err = gpg_error_from_syserror ();
+          gpgrt_fclose (dh->data.b64.stream);
+          goto leave;
+        }
+    }
+  else
+    {
+      dh->data.b64.state = gpgrt_b64dec_start (title);
+      if (!dh->data.b64.state)
+        goto syserror;
+      dh->data.b64.start = gpgme_data_seek (inner, 0, SEEK_CUR);
+    }
+
+  /* Only now the object owns INNER.  */
+  dh->data.b64.inner = inner;
+  dh->data.b64.flags = flags;
+  *r_dh = dh;
+  TRACE_SUC ("dh=%p", dh);
+  return 0;
+
+ syserror:
+  err = gpg_error_from_syserror ();
+ leave:
+  free (dh->data.b64.title);
+  _gpgme_data_release (dh);
+  return TRACE_ERR (err);
+}
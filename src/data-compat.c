@@ -29,12 +29,223 @@
 #ifdef HAVE_SYS_STAT_H
 # include <sys/stat.h>
 #endif
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "data.h"
 #include "util.h"
 #include "debug.h"
 
+
+/* Parts of files of at least this size are not read into memory by
+   gpgme_data_new_from_filepart.  They are mapped instead or, if that
+   is not possible, read on demand.  */
+#define LARGE_FILE_THRESHOLD (16 * 1024 * 1024)
+
+
+/* Seek to the absolute position OFFSET of STREAM.  */
+static int
+seek_stream (FILE *stream, gpgme_off_t offset)
+{
+#ifdef HAVE_FSEEKO
+  return fseeko (stream, offset, SEEK_SET);
+#else
+  /* FIXME: Check for overflow, or at least bail at compilation.  */
+  return fseek (stream, offset, SEEK_SET);
+#endif
+}
+
+
+/* The data object used for large files which can't be mapped.  */
+
+static gpgme_ssize_t
+file_read (gpgme_data_t dh, void *buffer, size_t size)
+{
+  gpgme_off_t left = dh->data.file.length - dh->data.file.offset;
+  size_t amt;
+
+  if (left <= 0)
+    return 0;
+  if ((uint64_t)left < size)
+    size = left;
+
+  do
+    {
+      clearerr (dh->data.file.stream);
+      amt = fread (buffer, 1, size, dh->data.file.stream);
+    }
+  while (!amt && ferror (dh->data.file.stream) && errno == EINTR);
+  if (!amt && ferror (dh->data.file.stream))
+    return -1;
+
+  dh->data.file.offset += amt;
+  return amt;
+}
+
+
+static gpgme_ssize_t
+file_write (gpgme_data_t dh, const void *buffer, size_t size)
+{
+  (void)dh;
+  (void)buffer;
+  (void)size;
+
+  /* The file is opened only for reading.  */
+  gpg_err_set_errno (EBADF);
+  return -1;
+}
+
+
+static gpgme_off_t
+file_seek (gpgme_data_t dh, gpgme_off_t offset, int whence)
+{
+  switch (whence)
+    {
+    case SEEK_SET:
+      break;
+    case SEEK_CUR:
+      offset += dh->data.file.offset;
+      break;
+    case SEEK_END:
+      offset += dh->data.file.length;
+      break;
+    default:
+      gpg_err_set_errno (EINVAL);
+      return -1;
+    }
+  if (offset < 0 || offset > dh->data.file.length)
+    {
+      gpg_err_set_errno (EINVAL);
+      return -1;
+    }
+
+  if (seek_stream (dh->data.file.stream, dh->data.file.start + offset))
+    return -1;
+  dh->data.file.offset = offset;
+  return offset;
+}
+
+
+static void
+file_release (gpgme_data_t dh)
+{
+  fclose (dh->data.file.stream);
+}
+
+
+static struct _gpgme_data_cbs file_cbs =
+  {
+    file_read,
+    file_write,
+    file_seek,
+    file_release,
+    NULL
+  };
+
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+/* Create a memory data object at R_DH for LENGTH bytes at OFFSET of
+   the file open at FD by mapping it.  The memory data object copies
+   the data only if it is written to.  */
+static gpgme_error_t
+map_filepart (gpgme_data_t *r_dh, int fd, gpgme_off_t offset, size_t length)
+{
+  gpgme_error_t err;
+  long pagesize;
+  gpgme_off_t base;
+  size_t map_length;
+  void *map;
+
+  pagesize = sysconf (_SC_PAGESIZE);
+  if (pagesize <= 0)
+    pagesize = 4096;
+  base = offset - offset % pagesize;
+  if (length > SIZE_MAX - (offset - base))
+    return gpg_error (GPG_ERR_TOO_LARGE);
+  map_length = length + (offset - base);
+
+  map = mmap (NULL, map_length, PROT_READ, MAP_PRIVATE, fd, base);
+  if (map == MAP_FAILED)
+    return gpg_error_from_syserror ();
+#ifdef HAVE_MADVISE
+  madvise (map, map_length, MADV_SEQUENTIAL);
+#endif
+
+  err = gpgme_data_new (r_dh);
+  if (err)
+    {
+      munmap (map, map_length);
+      return err;
+    }
+  (*r_dh)->data.mem.orig_buffer = (char *)map + (offset - base);
+  (*r_dh)->data.mem.size = length;
+  (*r_dh)->data.mem.length = length;
+  (*r_dh)->data.mem.map_base = map;
+  (*r_dh)->data.mem.map_length = map_length;
+  return 0;
+}
+#endif /*HAVE_MMAP*/
+
+
+/* Create a data object at R_DH for LENGTH bytes at OFFSET of STREAM
+   without reading it into memory.  The file is mapped if possible.
+   Otherwise, if OWN_STREAM is set, a data object reading from STREAM
+   on demand is created and takes ownership of STREAM.  Returns
+   GPG_ERR_NOT_SUPPORTED if the file shall be read into memory
+   instead.  */
+static gpgme_error_t
+new_from_large_filepart (gpgme_data_t *r_dh, FILE *stream, int own_stream,
+                         gpgme_off_t offset, size_t length)
+{
+  gpgme_error_t err;
+  struct stat statbuf;
+  int fd;
+
+  fd = fileno (stream);
+  if (fd == -1 || fstat (fd, &statbuf))
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  /* Only regular files with the requested part available are
+   * handled; accessing a mapping beyond the end of the file is
+   * fatal.  */
+  if (!S_ISREG (statbuf.st_mode) || offset < 0
+      || statbuf.st_size < offset
+      || (uint64_t)(statbuf.st_size - offset) < length)
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  err = map_filepart (r_dh, fd, offset, length);
+  if (!err)
+    {
+      if (own_stream)
+        fclose (stream);
+      return 0;
+    }
+  TRACE (DEBUG_DATA, "gpgme:new_from_large_filepart", r_dh,
+         "mapping failed: %s", gpg_strerror (err));
+#endif
+
+  if (!own_stream)
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  if (seek_stream (stream, offset))
+    return gpg_error_from_syserror ();
+  err = _gpgme_data_new (r_dh, &file_cbs);
+  if (err)
+    return err;
+  (*r_dh)->data.file.stream = stream;
+  (*r_dh)->data.file.start = offset;
+  (*r_dh)->data.file.length = length;
+  (*r_dh)->data.file.offset = 0;
+  return 0;
+}
+
 
 /* Create a new data buffer filled with LENGTH bytes starting from
    OFFSET within the file FNAME or stream STREAM (exactly one must be
@@ -59,12 +270,23 @@ gpgme_data_new_from_filepart (gpgme_data_t *r_dh, const char *fname,
   if (!stream)
     return TRACE_ERR (gpg_error_from_syserror ());
 
-#ifdef HAVE_FSEEKO
-  res = fseeko (stream, offset, SEEK_SET);
-#else
-  /* FIXME: Check for overflow, or at least bail at compilation.  */
-  res = fseek (stream, offset, SEEK_SET);
-#endif
+  if (length >= LARGE_FILE_THRESHOLD)
+    {
+      err = new_from_large_filepart (r_dh, stream, !!fname, offset, length);
+      if (!err)
+        {
+          TRACE_SUC ("r_dh=%p", *r_dh);
+          return 0;
+        }
+      if (gpg_err_code (err) != GPG_ERR_NOT_SUPPORTED)
+        {
+          if (fname)
+            fclose (stream);
+          return TRACE_ERR (err);
+        }
+    }
+
+  res = seek_stream (stream, offset);
 
   if (res)
     {
@@ -28,6 +28,7 @@
 #ifdef HAVE_SYS_TYPES_H
 # include <sys/types.h>
 #endif
+#include <sys/stat.h>
 
 #include "debug.h"
 #include "data.h"
@@ -85,3 +86,30 @@ gpgme_data_new_from_fd (gpgme_data_t *r_dh, int fd)
   TRACE_SUC ("dh=%p", *r_dh);
   return 0;
 }
+
+
+/* Return the file descriptor of DH if DH is a file descriptor based
+   data object for a regular file.  An engine may then let its process
+   access the file directly instead of pumping the data through a
+   pipe.  Otherwise return -1.  Note that data objects for stdio or
+   estream streams are not considered because the position of their
+   buffered stream would not follow the file.  */
+int
+_gpgme_data_get_file_fd (gpgme_data_t dh)
+{
+#ifdef HAVE_W32_SYSTEM
+  /* The engine processes can't use a CRT file descriptor.  */
+  (void)dh;
+  return -1;
+#else
+  struct stat st;
+
+  if (!dh || dh->cbs != &fd_cbs)
+    return -1;
+  if (dh->readahead_off < dh->readahead_len)
+    return -1;  /* The data read ahead would be lost.  */
+  if (fstat (dh->data.fd, &st) || !S_ISREG (st.st_mode))
+    return -1;
+  return dh->data.fd;
+#endif
+}
@@ -278,38 +278,62 @@ pgp_binary_detection (const void *image_arg, size_t imagelen)
 
 
 /* This is probably an armored "PGP MESSAGE" which can encode
- * different PGP data types.  STRING is modified after a call to this
- * function. */
+ * different PGP data types.  The DATALEN bytes of DATA are decoded
+ * in a copy.  */
 static gpgme_data_type_t
-inspect_pgp_message (char *string)
+inspect_pgp_message (const char *data, size_t datalen)
 {
+  gpgme_data_type_t result;
   gpgrt_b64state_t state;
+  char *string;
   size_t nbytes;
 
-  if (!(state = gpgrt_b64dec_start ("")))
+  string = malloc (datalen + 1);
+  if (!string)
     return GPGME_DATA_TYPE_INVALID; /* oops */
+  memcpy (string, data, datalen);
 
-  if (gpgrt_b64dec_proc (state, string, strlen (string), &nbytes))
+  if (!(state = gpgrt_b64dec_start ("")))
+    {
+      free (string);
+      return GPGME_DATA_TYPE_INVALID; /* oops */
+    }
+
+  if (gpgrt_b64dec_proc (state, string, datalen, &nbytes))
     {
       gpgrt_b64dec_finish (state);
+      free (string);
       return GPGME_DATA_TYPE_UNKNOWN; /* bad encoding etc. */
     }
   gpgrt_b64dec_finish (state);
   string[nbytes] = 0; /* Better append a Nul. */
 
-  return pgp_binary_detection (string, nbytes);
+  result = pgp_binary_detection (string, nbytes);
+  free (string);
+  return result;
+}
+
+
+/* Return true if the line at S which ends at END starts with the
+ * string PREFIX.  */
+static inline int
+has_prefix (const char *s, const char *end, const char *prefix)
+{
+  size_t n = strlen (prefix);
+
+  return end - s >= n && !memcmp (s, prefix, n);
 }
 
 
-/* Note that DATA may be binary but a final nul is required so that
-   string operations will find a terminator.
+/* Note that DATA may be binary and needs no terminating nul; only
+   the DATALEN bytes at DATA are inspected.
 
    Returns: GPGME_DATA_TYPE_xxxx */
 static gpgme_data_type_t
-basic_detection (char *data, size_t datalen)
+basic_detection (const char *data, size_t datalen)
 {
   tlvinfo_t ti;
-  const char *s;
+  const char *s, *end, *nl;
   size_t n;
   int maybe_p12 = 0;
 
@@ -449,65 +473,84 @@ basic_detection (char *data, size_t datalen)
       return pgp_binary_detection (data, datalen);
     }
 
-  /* Now check whether there are armor lines.  */
-  for (s = data; s && *s; s = (*s=='\n')?(s+1):((s=strchr (s,'\n'))?(s+1):s))
+  /* Now check whether there are armor lines.  As with a string the
+   * text ends at a nul.  The lines are found with memchr which is
+   * much faster than a scan by ourselves.  */
+  if ((nl = memchr (data, 0, datalen)))
+    datalen = nl - data;
+  end = data + datalen;
+  for (s = data; s < end; s = nl? nl + 1 : end)
     {
-      if (!strncmp (s, "-----BEGIN ", 11))
+      nl = memchr (s, '\n', end - s);
+      if (*s != '-' || !has_prefix (s, end, "-----BEGIN "))
+        continue;
+
+      s += 11;
+      if (has_prefix (s, end, "SIGNED "))
+        return GPGME_DATA_TYPE_CMS_SIGNED;
+      if (has_prefix (s, end, "ENCRYPTED "))
+        return GPGME_DATA_TYPE_CMS_ENCRYPTED;
+      if (has_prefix (s, end, "PGP "))
         {
-          if (!strncmp (s+11, "SIGNED ", 7))
-            return GPGME_DATA_TYPE_CMS_SIGNED;
-          if (!strncmp (s+11, "ENCRYPTED ", 10))
-            return GPGME_DATA_TYPE_CMS_ENCRYPTED;
-          if (!strncmp (s+11, "PGP ", 4))
-            {
-              if (!strncmp (s+15, "SIGNATURE", 9))
-                return GPGME_DATA_TYPE_PGP_SIGNATURE;
-              if (!strncmp (s+15, "SIGNED MESSAGE", 14))
-                return GPGME_DATA_TYPE_PGP_SIGNED;
-              if (!strncmp (s+15, "PUBLIC KEY BLOCK", 16))
-                return GPGME_DATA_TYPE_PGP_KEY;
-              if (!strncmp (s+15, "PRIVATE KEY BLOCK", 17))
-                return GPGME_DATA_TYPE_PGP_KEY;
-              if (!strncmp (s+15, "SECRET KEY BLOCK", 16))
-                return GPGME_DATA_TYPE_PGP_KEY;
-              if (!strncmp (s+15, "ARMORED FILE", 12))
-                return GPGME_DATA_TYPE_UNKNOWN;
-
-              return inspect_pgp_message (data);
-            }
-          if (!strncmp (s+11, "CERTIFICATE", 11))
-            return GPGME_DATA_TYPE_X509_CERT;
-          if (!strncmp (s+11, "PKCS12", 6))
-            return GPGME_DATA_TYPE_PKCS12;
-          return GPGME_DATA_TYPE_CMS_OTHER; /* Not PGP, thus we assume CMS.  */
+          s += 4;
+          if (has_prefix (s, end, "SIGNATURE"))
+            return GPGME_DATA_TYPE_PGP_SIGNATURE;
+          if (has_prefix (s, end, "SIGNED MESSAGE"))
+            return GPGME_DATA_TYPE_PGP_SIGNED;
+          if (has_prefix (s, end, "PUBLIC KEY BLOCK"))
+            return GPGME_DATA_TYPE_PGP_KEY;
+          if (has_prefix (s, end, "PRIVATE KEY BLOCK"))
+            return GPGME_DATA_TYPE_PGP_KEY;
+          if (has_prefix (s, end, "SECRET KEY BLOCK"))
+            return GPGME_DATA_TYPE_PGP_KEY;
+          if (has_prefix (s, end, "ARMORED FILE"))
+            return GPGME_DATA_TYPE_UNKNOWN;
+
+          return inspect_pgp_message (data, datalen);
         }
+      if (has_prefix (s, end, "CERTIFICATE"))
+        return GPGME_DATA_TYPE_X509_CERT;
+      if (has_prefix (s, end, "PKCS12"))
+        return GPGME_DATA_TYPE_PKCS12;
+      return GPGME_DATA_TYPE_CMS_OTHER; /* Not PGP, thus we assume CMS.  */
     }
 
   return GPGME_DATA_TYPE_UNKNOWN;
 }
 
 
-/* Try to detect the type of the data.  Note that this function works
-   only on seekable data objects.  The function tries to reset the
-   file pointer but there is no guarantee that it will work.
-
-   FIXME: We may want to add internal buffering so that this function
-   can be implemented for almost all kind of data objects.
- */
+/* Try to detect the type of the data.  The data of memory based
+   objects is inspected in place.  Data objects which can't seek keep
+   the sample in their read-ahead buffer so that it is read again
+   later.  For other objects the function tries to reset the file
+   pointer but there is no guarantee that it will work.  */
 gpgme_data_type_t
 gpgme_data_identify (gpgme_data_t dh, int reserved)
 {
   gpgme_data_type_t result;
+  const char *view;
+  size_t viewlen;
   char *sample;
   int n;
   gpgme_off_t off;
 
   (void)reserved;
 
+  if (!dh)
+    return GPGME_DATA_TYPE_INVALID;
+
+  if (!_gpgme_data_mem_view (dh, &view, &viewlen))
+    return basic_detection (view, (viewlen < SAMPLE_SIZE - 1
+                                   ? viewlen : SAMPLE_SIZE - 1));
+
   /* Check whether we can seek the data object.  */
   off = gpgme_data_seek (dh, 0, SEEK_CUR);
   if (off == (gpgme_off_t)(-1))
-    return GPGME_DATA_TYPE_INVALID;
+    {
+      if (_gpgme_data_peek (dh, SAMPLE_SIZE - 1, &view, &viewlen))
+        return GPGME_DATA_TYPE_INVALID;
+      return basic_detection (view, viewlen);
+    }
 
   /* Allocate a buffer and read the data. */
   sample = malloc (SAMPLE_SIZE);
@@ -519,7 +562,6 @@ gpgme_data_identify (gpgme_data_t dh, int reserved)
       free (sample);
       return GPGME_DATA_TYPE_INVALID; /* Ooops.  */
     }
-  sample[n] = 0;  /* (Required for our string functions.)  */
 
   result = basic_detection (sample, n);
   free (sample);
@@ -527,3 +569,30 @@ gpgme_data_identify (gpgme_data_t dh, int reserved)
 
   return result;
 }
+
+
+/* Detect the types of the COUNT memory buffers BUFFERS with the
+   lengths LENGTHS and store them at R_TYPES.  Only the first bytes
+   of each buffer are inspected, as gpgme_data_identify does.  */
+gpgme_error_t
+gpgme_data_identify_mem (const void * const *buffers, const size_t *lengths,
+                         size_t count, gpgme_data_type_t *r_types)
+{
+  size_t i;
+
+  if (count && (!buffers || !lengths || !r_types))
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  for (i = 0; i < count; i++)
+    {
+      if (!buffers[i])
+        r_types[i] = (lengths[i]? GPGME_DATA_TYPE_INVALID
+                      /**/      : GPGME_DATA_TYPE_UNKNOWN);
+      else
+        r_types[i] = basic_detection (buffers[i],
+                                      (lengths[i] < SAMPLE_SIZE - 1
+                                       ? lengths[i] : SAMPLE_SIZE - 1));
+    }
+
+  return 0;
+}
@@ -29,12 +29,67 @@
 #endif
 #include <assert.h>
 #include <string.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 
 #include "data.h"
 #include "util.h"
 #include "debug.h"
 
 
+/* Release the buffer of DH.  Buffers of sensitive data objects are
+   wiped.  */
+static void
+mem_free (gpgme_data_t dh)
+{
+  if (dh->sensitive || _gpgme_secmem_owns (dh->data.mem.buffer))
+    _gpgme_secmem_free (dh->data.mem.buffer, dh->data.mem.size);
+  else
+    free (dh->data.mem.buffer);
+  dh->data.mem.buffer = NULL;
+}
+
+
+/* Hand over the buffer of DH to the caller, who will release it with
+   gpgme_free.  Memory from the pool for sensitive data is copied for
+   this.  Returns NULL on error.  */
+static char *
+mem_snatch (gpgme_data_t dh)
+{
+  char *str = dh->data.mem.buffer;
+
+  if (_gpgme_secmem_owns (str))
+    {
+      str = malloc (dh->data.mem.length? dh->data.mem.length : 1);
+      if (!str)
+        return NULL;
+      memcpy (str, dh->data.mem.buffer, dh->data.mem.length);
+      mem_free (dh);
+    }
+  dh->data.mem.buffer = NULL;
+  return str;
+}
+
+
+/* Release the file mapping of DH, if any.  */
+static void
+mem_unmap (gpgme_data_t dh)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  if (dh->data.mem.map_base)
+    {
+      munmap (dh->data.mem.map_base, dh->data.mem.map_length);
+      dh->data.mem.map_base = NULL;
+      dh->data.mem.map_length = 0;
+      dh->data.mem.orig_buffer = NULL;
+    }
+#else
+  (void)dh;
+#endif
+}
+
+
 static gpgme_ssize_t
 mem_read (gpgme_data_t dh, void *buffer, size_t size)
 {
@@ -67,13 +122,18 @@ mem_write (gpgme_data_t dh, const void *buffer, size_t size)
       if (new_size < dh->data.mem.offset + size)
 	new_size = dh->data.mem.offset + size;
 
-      new_buffer = malloc (new_size);
+      if (dh->sensitive)
+        new_buffer = _gpgme_secmem_malloc (new_size);
+      else
+        new_buffer = malloc (new_size);
       if (!new_buffer)
 	return -1;
       memcpy (new_buffer, dh->data.mem.orig_buffer, dh->data.mem.length);
 
       dh->data.mem.buffer = new_buffer;
       dh->data.mem.size = new_size;
+      /* The mapped file is not needed anymore.  */
+      mem_unmap (dh);
     }
 
   unused = dh->data.mem.size - dh->data.mem.offset;
@@ -88,12 +148,20 @@ mem_write (gpgme_data_t dh, const void *buffer, size_t size)
       if (new_size < dh->data.mem.offset + size)
 	new_size = dh->data.mem.offset + size;
 
-      new_buffer = realloc (dh->data.mem.buffer, new_size);
+      if (dh->sensitive || _gpgme_secmem_owns (dh->data.mem.buffer))
+        new_buffer = _gpgme_secmem_realloc (dh->data.mem.buffer,
+                                            dh->data.mem.size, new_size);
+      else
+        new_buffer = realloc (dh->data.mem.buffer, new_size);
       if (!new_buffer && new_size > dh->data.mem.offset + size)
 	{
 	  /* Maybe we were too greedy, try again.  */
 	  new_size = dh->data.mem.offset + size;
-	  new_buffer = realloc (dh->data.mem.buffer, new_size);
+          if (dh->sensitive || _gpgme_secmem_owns (dh->data.mem.buffer))
+            new_buffer = _gpgme_secmem_realloc (dh->data.mem.buffer,
+                                                dh->data.mem.size, new_size);
+          else
+            new_buffer = realloc (dh->data.mem.buffer, new_size);
 	}
       if (!new_buffer)
 	return -1;
@@ -150,8 +218,8 @@ mem_seek (gpgme_data_t dh, gpgme_off_t offset, int whence)
 static void
 mem_release (gpgme_data_t dh)
 {
-  if (dh->data.mem.buffer)
-    free (dh->data.mem.buffer);
+  mem_free (dh);
+  mem_unmap (dh);
 }
 
 
@@ -165,6 +233,286 @@ static struct _gpgme_data_cbs mem_cbs =
   };
 
 
+
+/* Chunked memory data objects.  Writing to them never moves data
+   which has already been written; instead new chunks are appended.
+   The size of the chunks grows from CHUNK_MIN_SIZE to CHUNK_MAX_SIZE
+   so that small objects do not waste memory.  */
+#define CHUNK_MIN_SIZE 4096
+#define CHUNK_MAX_SIZE (1024 * 1024)
+
+struct _gpgme_data_chunk_s
+{
+  struct _gpgme_data_chunk_s *next;
+  size_t size;    /* Allocated size of DATA.  */
+  size_t length;  /* Number of used bytes in DATA.  */
+  char data[1];
+};
+typedef struct _gpgme_data_chunk_s *data_chunk_t;
+
+
+/* Return the chunk holding the byte at OFFSET and store the offset of
+   that byte within the chunk at R_OFF.  If OFFSET is the end of the
+   data, the last chunk or NULL is returned.  */
+static data_chunk_t
+chunk_locate (gpgme_data_t dh, size_t offset, size_t *r_off)
+{
+  data_chunk_t chunk = dh->data.chunk.cur;
+  size_t start = dh->data.chunk.cur_start;
+
+  if (!chunk || offset < start)
+    {
+      chunk = dh->data.chunk.head;
+      start = 0;
+    }
+  while (chunk && chunk->next && offset >= start + chunk->length)
+    {
+      start += chunk->length;
+      chunk = chunk->next;
+    }
+
+  dh->data.chunk.cur = chunk;
+  dh->data.chunk.cur_start = start;
+  *r_off = offset - start;
+  return chunk;
+}
+
+
+static gpgme_ssize_t
+chunk_read (gpgme_data_t dh, void *buffer, size_t size)
+{
+  size_t amt = dh->data.chunk.length - dh->data.chunk.offset;
+  size_t done = 0;
+
+  if (size < amt)
+    amt = size;
+
+  while (done < amt)
+    {
+      size_t off, n;
+      data_chunk_t chunk = chunk_locate (dh, dh->data.chunk.offset, &off);
+
+      n = chunk->length - off;
+      if (n > amt - done)
+        n = amt - done;
+      memcpy ((char *)buffer + done, chunk->data + off, n);
+      done += n;
+      dh->data.chunk.offset += n;
+    }
+  return done;
+}
+
+
+/* Release CHUNK of DH.  Chunks of sensitive data objects are wiped.  */
+static void
+chunk_free (gpgme_data_t dh, data_chunk_t chunk)
+{
+  if (dh->sensitive || _gpgme_secmem_owns (chunk))
+    _gpgme_secmem_free (chunk, sizeof *chunk - 1 + chunk->size);
+  else
+    free (chunk);
+}
+
+
+static gpgme_ssize_t
+chunk_write (gpgme_data_t dh, const void *buffer, size_t size)
+{
+  size_t done = 0;
+
+  while (done < size)
+    {
+      size_t off, n;
+      data_chunk_t chunk = chunk_locate (dh, dh->data.chunk.offset, &off);
+
+      if (!chunk || off == chunk->size)
+        {
+          /* Append a new chunk.  */
+          data_chunk_t prev = dh->data.chunk.tail;
+          size_t chunk_size = prev? prev->size * 2 : CHUNK_MIN_SIZE;
+
+          if (chunk_size > CHUNK_MAX_SIZE)
+            chunk_size = CHUNK_MAX_SIZE;
+          if (dh->sensitive)
+            chunk = _gpgme_secmem_malloc (sizeof *chunk - 1 + chunk_size);
+          else
+            chunk = malloc (sizeof *chunk - 1 + chunk_size);
+          if (!chunk)
+            return done? done : -1;
+          chunk->next = NULL;
+          chunk->size = chunk_size;
+          chunk->length = 0;
+          if (prev)
+            {
+              prev->next = chunk;
+              dh->data.chunk.cur_start += prev->length;
+            }
+          else
+            dh->data.chunk.head = chunk;
+          dh->data.chunk.tail = chunk;
+          dh->data.chunk.cur = chunk;
+          off = 0;
+        }
+
+      n = chunk->size - off;
+      if (n > size - done)
+        n = size - done;
+      memcpy (chunk->data + off, (const char *)buffer + done, n);
+      if (chunk->length < off + n)
+        {
+          dh->data.chunk.length += off + n - chunk->length;
+          chunk->length = off + n;
+        }
+      done += n;
+      dh->data.chunk.offset += n;
+    }
+  return done;
+}
+
+
+static gpgme_off_t
+chunk_seek (gpgme_data_t dh, gpgme_off_t offset, int whence)
+{
+  switch (whence)
+    {
+    case SEEK_SET:
+      break;
+    case SEEK_CUR:
+      offset += dh->data.chunk.offset;
+      break;
+    case SEEK_END:
+      offset += dh->data.chunk.length;
+      break;
+    default:
+      gpg_err_set_errno (EINVAL);
+      return -1;
+    }
+  if (offset < 0 || offset > dh->data.chunk.length)
+    {
+      gpg_err_set_errno (EINVAL);
+      return -1;
+    }
+  dh->data.chunk.offset = offset;
+  return offset;
+}
+
+
+static void
+chunk_release (gpgme_data_t dh)
+{
+  data_chunk_t chunk, next;
+
+  for (chunk = dh->data.chunk.head; chunk; chunk = next)
+    {
+      next = chunk->next;
+      chunk_free (dh, chunk);
+    }
+}
+
+
+static struct _gpgme_data_cbs chunk_cbs =
+  {
+    chunk_read,
+    chunk_write,
+    chunk_seek,
+    chunk_release,
+    NULL
+  };
+
+
+/* Switch the empty memory data object DH to chunked mode.  */
+gpgme_error_t
+_gpgme_data_set_chunked (gpgme_data_t dh)
+{
+  if (dh->cbs == &chunk_cbs)
+    return 0;
+  if (dh->cbs != &mem_cbs)
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+  if (dh->data.mem.buffer || dh->data.mem.orig_buffer)
+    return gpg_error (GPG_ERR_CONFLICT);
+
+  dh->cbs = &chunk_cbs;
+  memset (&dh->data.chunk, 0, sizeof dh->data.chunk);
+  return 0;
+}
+
+
+/* Copy the content of the chunked data object DH into a single
+   malloced buffer of length LEN.  If DH consists of only one chunk
+   which is not from the pool for sensitive data, that chunk is reused
+   and removed from DH.  */
+static char *
+chunk_flatten (gpgme_data_t dh, size_t len)
+{
+  data_chunk_t chunk = dh->data.chunk.head;
+  char *str;
+  size_t n;
+
+  if (chunk && !chunk->next && len <= chunk->length
+      && !_gpgme_secmem_owns (chunk))
+    {
+      /* Move the data to the start of the allocation so that the
+       * chunk can be released with gpgme_free.  */
+      memmove (chunk, chunk->data, len);
+      dh->data.chunk.head = dh->data.chunk.tail = NULL;
+      dh->data.chunk.cur = NULL;
+      return (char *)chunk;
+    }
+
+  str = malloc (len);
+  if (!str)
+    return NULL;
+  for (n = 0; chunk && n < len; chunk = chunk->next)
+    {
+      size_t amt = chunk->length < len - n? chunk->length : len - n;
+
+      memcpy (str + n, chunk->data, amt);
+      n += amt;
+    }
+  return str;
+}
+
+
+/* Copy all data of the chunked data object DH to BUFFER.  */
+static void
+chunk_read_all (gpgme_data_t dh, char *buffer)
+{
+  data_chunk_t chunk;
+
+  for (chunk = dh->data.chunk.head; chunk; chunk = chunk->next)
+    {
+      memcpy (buffer, chunk->data, chunk->length);
+      buffer += chunk->length;
+    }
+}
+
+
+/* Join the chunks of the chunked data object DH into one chunk.  */
+static gpg_error_t
+chunk_coalesce (gpgme_data_t dh)
+{
+  data_chunk_t chunk;
+  size_t len = dh->data.chunk.length;
+
+  if (!dh->data.chunk.head || !dh->data.chunk.head->next)
+    return 0;
+
+  if (dh->sensitive)
+    chunk = _gpgme_secmem_malloc (sizeof *chunk - 1 + len);
+  else
+    chunk = malloc (sizeof *chunk - 1 + len);
+  if (!chunk)
+    return gpg_error_from_syserror ();
+  chunk_read_all (dh, chunk->data);
+  chunk_release (dh);
+
+  chunk->next = NULL;
+  chunk->size = chunk->length = len;
+  dh->data.chunk.head = dh->data.chunk.tail = dh->data.chunk.cur = chunk;
+  dh->data.chunk.cur_start = 0;
+  return 0;
+}
+
+
 /* Create a new data buffer and return it in R_DH.  */
 gpgme_error_t
 gpgme_data_new (gpgme_data_t *r_dh)
@@ -234,7 +582,7 @@ gpgme_data_release_and_get_mem (gpgme_data_t dh, size_t *r_len)
   TRACE_BEG  (DEBUG_DATA, "gpgme_data_release_and_get_mem", dh,
 	      "r_len=%p", r_len);
 
-  if (!dh || dh->cbs != &mem_cbs)
+  if (!dh || (dh->cbs != &mem_cbs && dh->cbs != &chunk_cbs))
     {
       gpgme_data_release (dh);
       TRACE_ERR (gpg_error (GPG_ERR_INV_VALUE));
@@ -249,6 +597,25 @@ gpgme_data_release_and_get_mem (gpgme_data_t dh, size_t *r_len)
       return NULL;
     }
 
+  if (dh->cbs == &chunk_cbs)
+    {
+      /* Only now the chunks are joined.  */
+      len = dh->data.chunk.length;
+      if (blankout && len)
+        len = 1;
+      str = len? chunk_flatten (dh, len) : NULL;
+      if (!str && len)
+        {
+          int saved_err = gpg_error_from_syserror ();
+          gpgme_data_release (dh);
+          TRACE_ERR (saved_err);
+          return NULL;
+        }
+      if (blankout && len)
+        *str = 0;
+      goto leave;
+    }
+
   str = dh->data.mem.buffer;
   len = dh->data.mem.length;
   if (blankout && len)
@@ -273,11 +640,19 @@ gpgme_data_release_and_get_mem (gpgme_data_t dh, size_t *r_len)
     {
       if (blankout && len)
         *str = 0;
-      /* Prevent mem_release from releasing the buffer memory.  We
-       * must not fail from this point.  */
-      dh->data.mem.buffer = NULL;
+      /* Take the buffer memory so that mem_release does not release
+       * it.  */
+      str = mem_snatch (dh);
+      if (!str && len)
+	{
+	  int saved_err = gpg_error_from_syserror ();
+	  gpgme_data_release (dh);
+	  TRACE_ERR (saved_err);
+	  return NULL;
+	}
     }
 
+ leave:
   if (r_len)
     *r_len = len;
 
@@ -291,6 +666,210 @@ gpgme_data_release_and_get_mem (gpgme_data_t dh, size_t *r_len)
 }
 
 
+/* Return in R_BUFFER a pointer to the entire content of the memory
+   data object DH and its length in R_LENGTH.  The offset of DH is
+   not changed.  The returned memory is owned by DH and valid only
+   until the next write to or the release of DH.  The chunks of a
+   chunked object are joined for this.  */
+gpgme_error_t
+gpgme_data_peek_mem (gpgme_data_t dh, const void **r_buffer,
+                     size_t *r_length)
+{
+  gpg_error_t err;
+  int blankout;
+  TRACE_BEG  (DEBUG_DATA, "gpgme_data_peek_mem", dh, "");
+
+  if (!dh || !r_buffer || !r_length)
+    return TRACE_ERR (gpg_error (GPG_ERR_INV_VALUE));
+  *r_buffer = NULL;
+  *r_length = 0;
+
+  if (dh->cbs != &mem_cbs && dh->cbs != &chunk_cbs)
+    return TRACE_ERR (gpg_error (GPG_ERR_NOT_SUPPORTED));
+
+  err = _gpgme_data_get_prop (dh, 0, DATA_PROP_BLANKOUT, &blankout);
+  if (err)
+    return TRACE_ERR (err);
+  if (blankout)
+    return TRACE_ERR (gpg_error (GPG_ERR_NO_DATA));
+
+  if (dh->cbs == &chunk_cbs)
+    {
+      err = chunk_coalesce (dh);
+      if (err)
+        return TRACE_ERR (err);
+      if (dh->data.chunk.head)
+        {
+          *r_buffer = dh->data.chunk.head->data;
+          *r_length = dh->data.chunk.length;
+        }
+    }
+  else if (dh->data.mem.length)
+    {
+      *r_buffer = (dh->data.mem.buffer? dh->data.mem.buffer
+                   /**/              : dh->data.mem.orig_buffer);
+      *r_length = dh->data.mem.length;
+    }
+
+  TRACE_SUC ("buffer=%p len=%zu", *r_buffer, *r_length);
+  return 0;
+}
+
+
+/* Store in R_BUFFER a view of the data of the memory data object DH
+   from its current offset on and its length in R_LENGTH.  Returns
+   GPG_ERR_NOT_SUPPORTED for other data objects.  */
+gpgme_error_t
+_gpgme_data_mem_view (gpgme_data_t dh, const char **r_buffer,
+                      size_t *r_length)
+{
+  const char *buffer;
+  int blankout;
+
+  if (dh->cbs != &mem_cbs)
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  *r_buffer = NULL;
+  *r_length = 0;
+  if (_gpgme_data_get_prop (dh, 0, DATA_PROP_BLANKOUT, &blankout)
+      || blankout)
+    return 0;
+
+  buffer = dh->data.mem.buffer? dh->data.mem.buffer : dh->data.mem.orig_buffer;
+  if (buffer && dh->data.mem.offset < dh->data.mem.length)
+    {
+      *r_buffer = buffer + dh->data.mem.offset;
+      *r_length = dh->data.mem.length - dh->data.mem.offset;
+    }
+  return 0;
+}
+
+
+/* Remove the entire content from the memory data object DH and
+   return it in R_BUFFER and its length in R_LENGTH.  The buffer must
+   be released with gpgme_free.  A buffer allocated by gpgme is handed
+   over without a copy.  DH stays valid and is empty afterwards.  */
+gpgme_error_t
+gpgme_data_take_mem (gpgme_data_t dh, void **r_buffer, size_t *r_length)
+{
+  gpg_error_t err;
+  int blankout;
+  char *str = NULL;
+  size_t len;
+  TRACE_BEG  (DEBUG_DATA, "gpgme_data_take_mem", dh, "");
+
+  if (!dh || !r_buffer || !r_length)
+    return TRACE_ERR (gpg_error (GPG_ERR_INV_VALUE));
+  *r_buffer = NULL;
+  *r_length = 0;
+
+  if (dh->cbs != &mem_cbs && dh->cbs != &chunk_cbs)
+    return TRACE_ERR (gpg_error (GPG_ERR_NOT_SUPPORTED));
+
+  err = _gpgme_data_get_prop (dh, 0, DATA_PROP_BLANKOUT, &blankout);
+  if (err)
+    return TRACE_ERR (err);
+  if (blankout)
+    return TRACE_ERR (gpg_error (GPG_ERR_NO_DATA));
+
+  if (dh->cbs == &chunk_cbs)
+    {
+      len = dh->data.chunk.length;
+      if (len)
+        {
+          str = chunk_flatten (dh, len);
+          if (!str)
+            return TRACE_ERR (gpg_error_from_syserror ());
+        }
+      chunk_release (dh);
+      memset (&dh->data.chunk, 0, sizeof dh->data.chunk);
+    }
+  else
+    {
+      len = dh->data.mem.length;
+      if (dh->data.mem.buffer)
+        {
+          str = mem_snatch (dh);
+          if (!str)
+            return TRACE_ERR (gpg_error_from_syserror ());
+        }
+      else if (len)
+        {
+          str = malloc (len);
+          if (!str)
+            return TRACE_ERR (gpg_error_from_syserror ());
+          memcpy (str, dh->data.mem.orig_buffer, len);
+        }
+      mem_unmap (dh);
+      dh->data.mem.orig_buffer = NULL;
+      dh->data.mem.size = 0;
+      dh->data.mem.length = 0;
+      dh->data.mem.offset = 0;
+    }
+
+  *r_buffer = str;
+  *r_length = len;
+  TRACE_SUC ("buffer=%p len=%zu", *r_buffer, *r_length);
+  return 0;
+}
+
+
+/* Return in R_BUFFER a pointer to the data at the current offset of
+   the memory data object DH and its length in R_LENGTH; the offset
+   is advanced by that length.  At the end of the data R_LENGTH is set
+   to 0.  The returned memory is owned by DH and valid only until the
+   next write to or the release of DH.  This allows to iterate over
+   the content of DH without copying it.  */
+gpgme_error_t
+gpgme_data_read_chunk (gpgme_data_t dh, const void **r_buffer,
+                       size_t *r_length)
+{
+  gpg_error_t err;
+  int blankout;
+  TRACE_BEG  (DEBUG_DATA, "gpgme_data_read_chunk", dh, "");
+
+  if (!dh || !r_buffer || !r_length)
+    return TRACE_ERR (gpg_error (GPG_ERR_INV_VALUE));
+  *r_buffer = NULL;
+  *r_length = 0;
+
+  if (dh->cbs != &mem_cbs && dh->cbs != &chunk_cbs)
+    return TRACE_ERR (gpg_error (GPG_ERR_NOT_SUPPORTED));
+
+  err = _gpgme_data_get_prop (dh, 0, DATA_PROP_BLANKOUT, &blankout);
+  if (err)
+    return TRACE_ERR (err);
+  if (blankout)
+    return TRACE_ERR (gpg_error (GPG_ERR_NO_DATA));
+
+  if (dh->cbs == &chunk_cbs)
+    {
+      size_t off;
+      data_chunk_t chunk;
+
+      if (dh->data.chunk.offset < dh->data.chunk.length)
+        {
+          chunk = chunk_locate (dh, dh->data.chunk.offset, &off);
+          *r_buffer = chunk->data + off;
+          *r_length = chunk->length - off;
+          dh->data.chunk.offset += *r_length;
+        }
+    }
+  else if (dh->data.mem.offset < dh->data.mem.length)
+    {
+      const char *src = (dh->data.mem.buffer? dh->data.mem.buffer
+                         /**/              : dh->data.mem.orig_buffer);
+
+      *r_buffer = src + dh->data.mem.offset;
+      *r_length = dh->data.mem.length - dh->data.mem.offset;
+      dh->data.mem.offset = dh->data.mem.length;
+    }
+
+  TRACE_SUC ("buffer=%p len=%zu", *r_buffer, *r_length);
+  return 0;
+}
+
+
 /* Release the memory returned by gpgme_data_release_and_get_mem() and
    some other functions.  */
 void
@@ -0,0 +1,161 @@
+/* data-tee.c - A data object forwarding to other data objects.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GPGME.
+ *
+ * GPGME is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GPGME is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <https://gnu.org/licenses/>.
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "data.h"
+
+
+/* A tee can only be written.  */
+static gpgme_ssize_t
+tee_read (gpgme_data_t dh, void *buffer, size_t size)
+{
+  (void)dh;
+  (void)buffer;
+  (void)size;
+
+  gpg_err_set_errno (EBADF);
+  return -1;
+}
+
+
+static gpgme_ssize_t
+tee_write (gpgme_data_t dh, const void *buffer, size_t size)
+{
+  gpgme_data_t *sink;
+
+  for (sink = dh->data.tee.sinks; *sink; sink++)
+    {
+      const char *p = buffer;
+      size_t left = size;
+
+      while (left)
+        {
+          gpgme_ssize_t n = gpgme_data_write (*sink, p, left);
+
+          if (n < 0)
+            return -1;
+          if (!n)
+            {
+              gpg_err_set_errno (EIO);
+              return -1;
+            }
+          p += n;
+          left -= n;
+        }
+    }
+
+  if (dh->data.tee.digest_cb)
+    dh->data.tee.digest_cb (dh->data.tee.digest_cb_value, buffer, size);
+  dh->data.tee.count += size;
+  return size;
+}
+
+
+/* The only position is the number of bytes written so far.  Thus
+   seeking to the current position returns that count.  */
+static gpgme_off_t
+tee_seek (gpgme_data_t dh, gpgme_off_t offset, int whence)
+{
+  switch (whence)
+    {
+    case SEEK_SET:
+      break;
+    case SEEK_CUR:
+    case SEEK_END:
+      offset += dh->data.tee.count;
+      break;
+    default:
+      gpg_err_set_errno (EINVAL);
+      return -1;
+    }
+  if (offset != dh->data.tee.count)
+    {
+      gpg_err_set_errno (ESPIPE);
+      return -1;
+    }
+  return offset;
+}
+
+
+static void
+tee_release (gpgme_data_t dh)
+{
+  free (dh->data.tee.sinks);
+}
+
+
+static struct _gpgme_data_cbs tee_cbs =
+  {
+    tee_read,
+    tee_write,
+    tee_seek,
+    tee_release,
+    NULL
+  };
+
+
+/* Create a new data object which forwards all data written to it to
+   each data object in the NULL terminated array SINKS and also passes
+   it to DIGEST_CB.  The sinks are not owned by the new object and
+   must not be released before it.  */
+gpgme_error_t
+gpgme_data_new_tee (gpgme_data_t *r_dh, gpgme_data_t *sinks,
+                    gpgme_data_digest_cb_t digest_cb, void *digest_cb_value)
+{
+  gpgme_error_t err;
+  size_t n = 0;
+  TRACE_BEG  (DEBUG_DATA, "gpgme_data_new_tee", r_dh,
+	      "sinks=%p, digest_cb=%p/%p", sinks, digest_cb, digest_cb_value);
+
+  if (!r_dh)
+    return TRACE_ERR (gpg_error (GPG_ERR_INV_VALUE));
+
+  if (sinks)
+    for (; sinks[n]; n++)
+      ;
+
+  err = _gpgme_data_new (r_dh, &tee_cbs);
+  if (err)
+    return TRACE_ERR (err);
+
+  (*r_dh)->data.tee.sinks = calloc (n + 1, sizeof *sinks);
+  if (!(*r_dh)->data.tee.sinks)
+    {
+      int saved_err = gpg_error_from_syserror ();
+      _gpgme_data_release (*r_dh);
+      *r_dh = NULL;
+      return TRACE_ERR (saved_err);
+    }
+  if (n)
+    memcpy ((*r_dh)->data.tee.sinks, sinks, n * sizeof *sinks);
+  (*r_dh)->data.tee.digest_cb = digest_cb;
+  (*r_dh)->data.tee.digest_cb_value = digest_cb_value;
+
+  TRACE_SUC ("dh=%p", *r_dh);
+  return 0;
+}
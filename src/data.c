@@ -49,11 +49,15 @@
  * number which is good enough to create a new data object every
  * nanosecond for more than 500 years.  Thus no wrap around will ever
  * happen.
+ *
+ * The unused slots are linked into a free list so that inserting and
+ * removing a data object does not depend on the size of the table.
  */
 struct property_s
 {
   gpgme_data_t dh;   /* The data object or NULL if the slot is not used.  */
   uint64_t dserial;  /* The serial number of the data object.  */
+  unsigned int next_free;  /* Index of the next unused slot.  */
   struct {
     unsigned int blankout : 1;  /* Void the held data.  */
   } flags;
@@ -62,8 +66,11 @@ typedef struct property_s *property_t;
 
 static property_t property_table;
 static unsigned int property_table_size;
+/* Index of the first unused slot or NO_FREE_SLOT.  */
+static unsigned int property_table_free;
 DEFINE_STATIC_LOCK (property_table_lock);
 #define PROPERTY_TABLE_ALLOCATION_CHUNK 32
+#define NO_FREE_SLOT ((unsigned int)(-1))
 
 
 
@@ -78,30 +85,17 @@ insert_into_property_table (gpgme_data_t dh, unsigned int *r_idx)
   unsigned int idx;
 
   LOCK (property_table_lock);
-  if (!property_table)
-    {
-      property_table_size = PROPERTY_TABLE_ALLOCATION_CHUNK;
-      property_table = calloc (property_table_size, sizeof *property_table);
-      if (!property_table)
-        {
-          err = gpg_error_from_syserror ();
-          goto leave;
-        }
-    }
-
-  /* Find an empty slot.  */
-  for (idx = 0; idx < property_table_size; idx++)
-    if (!property_table[idx].dh)
-      break;
-  if (!(idx < property_table_size))
+  if (!property_table || property_table_free == NO_FREE_SLOT)
     {
-      /* No empty slot found.  Enlarge the table.  */
+      /* No empty slot.  Enlarge the table by doubling its size.  */
       property_t newtbl;
       unsigned int newsize;
 
-      newsize = property_table_size + PROPERTY_TABLE_ALLOCATION_CHUNK;;
-      if ((newsize * sizeof *property_table)
-          < (property_table_size * sizeof *property_table))
+      newsize = (property_table_size? 2 * property_table_size
+                 /**/                : PROPERTY_TABLE_ALLOCATION_CHUNK);
+      if (newsize <= property_table_size || newsize == NO_FREE_SLOT
+          || (newsize * sizeof *property_table) / sizeof *property_table
+          != newsize)
         {
           err = gpg_error (GPG_ERR_ENOMEM);
           goto leave;
@@ -114,11 +108,18 @@ insert_into_property_table (gpgme_data_t dh, unsigned int *r_idx)
         }
       property_table = newtbl;
       for (idx = property_table_size; idx < newsize; idx++)
-        property_table[idx].dh = NULL;
-      idx = property_table_size;
+        {
+          property_table[idx].dh = NULL;
+          property_table[idx].next_free = idx + 1 < newsize? idx + 1
+            /**/                                           : NO_FREE_SLOT;
+        }
+      property_table_free = property_table_size;
       property_table_size = newsize;
     }
 
+  idx = property_table_free;
+  property_table_free = property_table[idx].next_free;
+
   /* Slot found. */
   property_table[idx].dh = dh;
   property_table[idx].dserial = ++last_dserial;
@@ -142,6 +143,8 @@ remove_from_property_table (gpgme_data_t dh, unsigned int propidx)
   assert (propidx < property_table_size);
   assert (property_table[propidx].dh == dh);
   property_table[propidx].dh = NULL;
+  property_table[propidx].next_free = property_table_free;
+  property_table_free = propidx;
   UNLOCK (property_table_lock);
 }
 
@@ -330,6 +333,28 @@ _gpgme_data_new (gpgme_data_t *r_dh, struct _gpgme_data_cbs *cbs)
 }
 
 
+/* Allocate an I/O buffer of SIZE bytes for DH.  Buffers of sensitive
+ * data objects are taken from the locked pool.  */
+static char *
+alloc_io_buffer (gpgme_data_t dh, size_t size)
+{
+  if (dh->sensitive)
+    return _gpgme_secmem_malloc (size);
+  return malloc (size);
+}
+
+
+/* Release the I/O buffer BUFFER of DH with SIZE bytes.  */
+static void
+free_io_buffer (gpgme_data_t dh, char *buffer, size_t size)
+{
+  if (dh->sensitive || _gpgme_secmem_owns (buffer))
+    _gpgme_secmem_free (buffer, size);
+  else
+    free (buffer);
+}
+
+
 void
 _gpgme_data_release (gpgme_data_t dh)
 {
@@ -340,19 +365,13 @@ _gpgme_data_release (gpgme_data_t dh)
   if (dh->file_name)
     free (dh->file_name);
   if (dh->inbound_buffer)
-    {
-      if (dh->sensitive)
-        _gpgme_wipememory (dh->inbound_buffer, dh->io_buffer_size);
-      free (dh->inbound_buffer);
-    }
+    free_io_buffer (dh, dh->inbound_buffer,
+                    dh->io_buffer_size? dh->io_buffer_size : BUFFER_SIZE);
   if (dh->outbound_buffer)
-    {
-      if (dh->sensitive)
-        _gpgme_wipememory (dh->outbound_buffer, dh->io_buffer_size);
-      free (dh->outbound_buffer);
-    }
-  if (dh->sensitive)
-    _gpgme_wipememory (dh->outboundspace, BUFFER_SIZE);
+    free_io_buffer (dh, dh->outbound_buffer,
+                    dh->io_buffer_size? dh->io_buffer_size : BUFFER_SIZE);
+  if (dh->readahead)
+    free_io_buffer (dh, dh->readahead, dh->readahead_size);
 
   free (dh);
 }
@@ -384,6 +403,15 @@ gpgme_data_read (gpgme_data_t dh, void *buffer, size_t size)
   if (_gpgme_data_get_prop (dh, 0, DATA_PROP_BLANKOUT, &blankout)
       || blankout)
     res = 0;
+  else if (dh->readahead_off < dh->readahead_len)
+    {
+      /* Return the data read ahead first.  */
+      res = dh->readahead_len - dh->readahead_off;
+      if (res > size)
+        res = size;
+      memcpy (buffer, dh->readahead + dh->readahead_off, res);
+      dh->readahead_off += res;
+    }
   else
     {
       do
@@ -446,11 +474,17 @@ gpgme_data_seek (gpgme_data_t dh, gpgme_off_t offset, int whence)
   /* For relative movement, we must take into account the actual
      position of the read counter.  */
   if (whence == SEEK_CUR)
-    offset -= dh->outbound_pending;
+    offset -= dh->outbound_pending + (dh->readahead_len - dh->readahead_off);
 
   offset = (*dh->cbs->seek) (dh, offset, whence);
   if (offset >= 0)
-    dh->outbound_pending = 0;
+    {
+      dh->outbound_start = 0;
+      dh->outbound_pending = 0;
+      dh->outbound_eof = 0;
+      dh->readahead_off = 0;
+      dh->readahead_len = 0;
+    }
 
   return TRACE_SYSRES_OFF_T (offset);
 }
@@ -574,8 +608,8 @@ gpgme_data_set_flag (gpgme_data_t dh, const char *name, const char *value)
     {
       uint64_t val;
 
-      /* We may set this only once.  */
-      if (dh->io_buffer_size)
+      /* We may set this only once and not after I/O happened.  */
+      if (dh->io_buffer_size || dh->inbound_buffer || dh->outbound_buffer)
         return gpg_error (GPG_ERR_CONFLICT);
 
       val = value? _gpgme_string_to_off (value) : 0;
@@ -592,6 +626,11 @@ gpgme_data_set_flag (gpgme_data_t dh, const char *name, const char *value)
     {
       dh->sensitive = (value && *value)? !!atoi (value) : 0;
     }
+  else if (!strcmp (name, "chunked"))
+    {
+      if (value && *value && atoi (value))
+        return _gpgme_data_set_chunked (dh);
+    }
   else
     return gpg_error (GPG_ERR_UNKNOWN_NAME);
 
@@ -602,6 +641,9 @@ gpgme_data_set_flag (gpgme_data_t dh, const char *name, const char *value)
 
 /* Functions to support the wait interface.  */
 
+/* The maximum number of buffers the handlers transfer in one call.  */
+#define DATA_PUMP_ROUNDS 16
+
 gpgme_error_t
 _gpgme_data_inbound_handler (void *opaque, int fd)
 {
@@ -613,18 +655,21 @@ _gpgme_data_inbound_handler (void *opaque, int fd)
   size_t buffer_size;
   char *bufp;
   gpgme_ssize_t buflen;
+  int rounds = 0;
   TRACE_BEG  (DEBUG_CTX, "_gpgme_data_inbound_handler", dh,
 	      "fd=%d", fd);
 
-  if (dh->io_buffer_size)
+  if (dh->io_buffer_size || dh->sensitive)
     {
+      /* Sensitive data is not put on the stack but into a buffer
+       * from the locked pool.  */
+      buffer_size = dh->io_buffer_size? dh->io_buffer_size : BUFFER_SIZE;
       if (!dh->inbound_buffer)
         {
-          dh->inbound_buffer = malloc (dh->io_buffer_size);
+          dh->inbound_buffer = alloc_io_buffer (dh, buffer_size);
           if (!dh->inbound_buffer)
             return TRACE_ERR (gpg_error_from_syserror ());
         }
-      buffer_size = dh->io_buffer_size;
       buffer = dh->inbound_buffer;
     }
   else
@@ -632,7 +677,6 @@ _gpgme_data_inbound_handler (void *opaque, int fd)
       buffer_size = BUFFER_SIZE;
       buffer = bufferspace;
     }
-  bufp = buffer;
 
   buflen = _gpgme_io_read (fd, buffer, buffer_size);
   if (buflen < 0)
@@ -643,24 +687,38 @@ _gpgme_data_inbound_handler (void *opaque, int fd)
       return TRACE_ERR (0);
     }
 
-  do
+  for (;;)
     {
-      gpgme_ssize_t amt = gpgme_data_write (dh, bufp, buflen);
-      if (amt == 0 || (amt < 0 && errno != EINTR))
-	{
-          err = gpg_error_from_syserror ();
-          goto leave;
+      bufp = buffer;
+      do
+        {
+          gpgme_ssize_t amt = gpgme_data_write (dh, bufp, buflen);
+          if (amt == 0 || (amt < 0 && errno != EINTR))
+            {
+              err = gpg_error_from_syserror ();
+              goto leave;
+            }
+          bufp += amt;
+          buflen -= amt;
         }
-      bufp += amt;
-      buflen -= amt;
+      while (buflen > 0);
+
+      /* If the buffer was filled, more data may be available.  Read
+       * it now if that is possible without blocking, but give the
+       * other file descriptors a chance after some rounds.  */
+      if (bufp - buffer < buffer_size || ++rounds >= DATA_PUMP_ROUNDS)
+        break;
+      buflen = _gpgme_io_readable (fd);
+      if (buflen <= 0)
+        break;
+      buflen = _gpgme_io_read (fd, buffer,
+                               buflen < buffer_size? buflen : buffer_size);
+      if (buflen <= 0)
+        break;  /* Let the next call handle EOF and errors.  */
     }
-  while (buflen > 0);
   err = 0;
 
  leave:
-  if (dh->sensitive && buffer == bufferspace)
-    _gpgme_wipememory (bufferspace, BUFFER_SIZE);
-
   return TRACE_ERR (err);
 }
 
@@ -672,62 +730,87 @@ _gpgme_data_outbound_handler (void *opaque, int fd)
   gpgme_data_t dh = (gpgme_data_t) data->handler_value;
   char *buffer;
   size_t buffer_size;
+  struct io_iov_s iov[2];
   gpgme_ssize_t nwritten;
+  int rounds;
   TRACE_BEG  (DEBUG_CTX, "_gpgme_data_outbound_handler", dh,
 	      "fd=%d", fd);
 
-  if (dh->io_buffer_size)
+  buffer_size = dh->io_buffer_size? dh->io_buffer_size : BUFFER_SIZE;
+  if (!dh->outbound_buffer)
     {
+      /* Allocated only now because most data objects are never used
+       * for outbound data.  */
+      dh->outbound_buffer = alloc_io_buffer (dh, buffer_size);
       if (!dh->outbound_buffer)
+        return TRACE_ERR (gpg_error_from_syserror ());
+      dh->outbound_start = 0;
+      dh->outbound_pending = 0;
+    }
+  buffer = dh->outbound_buffer;
+
+  /* Keep on reading and writing as long as the pipe takes all data,
+   * but give the other file descriptors a chance after some rounds.  */
+  for (rounds = 0; rounds < DATA_PUMP_ROUNDS; rounds++)
+    {
+      /* Fill the free space of the ring buffer.  */
+      while (!dh->outbound_eof && dh->outbound_pending < buffer_size)
         {
-          dh->outbound_buffer = malloc (dh->io_buffer_size);
-          if (!dh->outbound_buffer)
+          size_t end, space;
+          gpgme_ssize_t amt;
+
+          end = (dh->outbound_start + dh->outbound_pending) % buffer_size;
+          space = ((end < dh->outbound_start? dh->outbound_start : buffer_size)
+                   - end);
+          amt = gpgme_data_read (dh, buffer + end, space);
+          if (amt < 0)
             return TRACE_ERR (gpg_error_from_syserror ());
-          dh->outbound_pending = 0;
+          if (amt == 0)
+            dh->outbound_eof = 1;
+          dh->outbound_pending += amt;
+          if (amt < space)
+            break;
         }
-      buffer_size = dh->io_buffer_size;
-      buffer = dh->outbound_buffer;
-    }
-  else
-    {
-      buffer_size = BUFFER_SIZE;
-      buffer = dh->outboundspace;
-    }
 
+      if (!dh->outbound_pending)
+        {
+          /* All data has been written.  */
+          dh->outbound_eof = 0;
+          _gpgme_io_close (fd);
+          return TRACE_ERR (0);
+        }
 
-  if (!dh->outbound_pending)
-    {
-      gpgme_ssize_t amt = gpgme_data_read (dh, buffer, buffer_size);
-      if (amt < 0)
-	return TRACE_ERR (gpg_error_from_syserror ());
-      if (amt == 0)
-	{
-	  _gpgme_io_close (fd);
-	  return TRACE_ERR (0);
-	}
-      dh->outbound_pending = amt;
-    }
+      /* Write the pending data, which may wrap around.  */
+      iov[0].data = buffer + dh->outbound_start;
+      iov[0].len = buffer_size - dh->outbound_start;
+      if (iov[0].len > dh->outbound_pending)
+        iov[0].len = dh->outbound_pending;
+      iov[1].data = buffer;
+      iov[1].len = dh->outbound_pending - iov[0].len;
+      nwritten = _gpgme_io_writev (fd, iov, iov[1].len? 2 : 1);
+      if (nwritten == -1 && errno == EAGAIN)
+        return TRACE_ERR (0);
+
+      if (nwritten == -1 && errno == EPIPE)
+        {
+          /* Not much we can do.  The other end closed the pipe, but we
+             still have data.  This should only ever happen if the other
+             end is going to tell us what happened on some other channel.
+             Silently close our end.  */
+          _gpgme_io_close (fd);
+          return TRACE_ERR (0);
+        }
 
-  nwritten = _gpgme_io_write (fd, buffer, dh->outbound_pending);
-  if (nwritten == -1 && errno == EAGAIN)
-    return TRACE_ERR (0);
+      if (nwritten <= 0)
+        return TRACE_ERR (gpg_error_from_syserror ());
 
-  if (nwritten == -1 && errno == EPIPE)
-    {
-      /* Not much we can do.  The other end closed the pipe, but we
-	 still have data.  This should only ever happen if the other
-	 end is going to tell us what happened on some other channel.
-	 Silently close our end.  */
-      _gpgme_io_close (fd);
-      return TRACE_ERR (0);
+      dh->outbound_pending -= nwritten;
+      dh->outbound_start = (dh->outbound_pending
+                            ? (dh->outbound_start + nwritten) % buffer_size
+                            : 0);
+      if (dh->outbound_pending)
+        break;  /* The pipe is full.  */
     }
-
-  if (nwritten <= 0)
-    return TRACE_ERR (gpg_error_from_syserror ());
-
-  if (nwritten < dh->outbound_pending)
-    memmove (buffer, buffer + nwritten, dh->outbound_pending - nwritten);
-  dh->outbound_pending -= nwritten;
   return TRACE_ERR (0);
 }
 
@@ -739,10 +822,74 @@ _gpgme_data_get_fd (gpgme_data_t dh)
 {
   if (!dh || !dh->cbs->get_fd)
     return -1;
+  /* The data read ahead would be lost.  */
+  if (dh->readahead_off < dh->readahead_len)
+    return -1;
   return (*dh->cbs->get_fd) (dh);
 }
 
 
+/* Read up to WANT bytes of DH into its read-ahead buffer without
+   consuming them.  Less data is only returned at the end of the data.
+   On success a view of the buffer is stored at R_BUFFER and its
+   length at R_LENGTH; the view is valid until the next read or seek
+   on DH.  */
+gpgme_error_t
+_gpgme_data_peek (gpgme_data_t dh, size_t want,
+                  const char **r_buffer, size_t *r_length)
+{
+  gpgme_ssize_t amt;
+  int blankout;
+
+  if (!dh->cbs->read)
+    return gpg_error (GPG_ERR_NOT_IMPLEMENTED);
+
+  if (dh->readahead_off)
+    {
+      dh->readahead_len -= dh->readahead_off;
+      memmove (dh->readahead, dh->readahead + dh->readahead_off,
+               dh->readahead_len);
+      dh->readahead_off = 0;
+    }
+
+  if (_gpgme_data_get_prop (dh, 0, DATA_PROP_BLANKOUT, &blankout)
+      || blankout)
+    want = 0;
+
+  if (want > dh->readahead_size)
+    {
+      char *buffer = alloc_io_buffer (dh, want);
+
+      if (!buffer)
+        return gpg_error_from_syserror ();
+      if (dh->readahead)
+        {
+          memcpy (buffer, dh->readahead, dh->readahead_len);
+          free_io_buffer (dh, dh->readahead, dh->readahead_size);
+        }
+      dh->readahead = buffer;
+      dh->readahead_size = want;
+    }
+
+  while (dh->readahead_len < want)
+    {
+      amt = (*dh->cbs->read) (dh, dh->readahead + dh->readahead_len,
+                              want - dh->readahead_len);
+      if (amt < 0 && errno == EINTR)
+        continue;
+      if (amt < 0)
+        return gpg_error_from_syserror ();
+      if (!amt)
+        break;
+      dh->readahead_len += amt;
+    }
+
+  *r_buffer = dh->readahead;
+  *r_length = dh->readahead_len;
+  return 0;
+}
+
+
 /* Get the size-hint value for DH or 0 if not available.  */
 uint64_t
 _gpgme_data_get_size_hint (gpgme_data_t dh)
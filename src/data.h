@@ -103,20 +103,33 @@ struct gpgme_data
   unsigned int io_buffer_size;
 
   /* If not NULL a malloced buffer used for inbound data used instead
-   * of the handler's static buffer.  Its size is io_buffer_size.  */
+   * of the handler's static buffer.  Its size is io_buffer_size or
+   * BUFFER_SIZE.  */
   char *inbound_buffer;
 
-  /* A default memory space for the outbound handler and the number of
-   * actual pending bytes.  If outbound_buffer is not NULL, this is a
-   * malloced buffer used instead of the outboundspace.  Its malloced
-   * size is io_buffer_size. */
-  char outboundspace[BUFFER_SIZE];
+  /* The ring buffer of the outbound handler, the offset of the first
+   * pending byte and the number of pending bytes.  The buffer is
+   * malloced on first use; its size is io_buffer_size or BUFFER_SIZE.
+   * OUTBOUND_EOF is set when the end of the data has been read into
+   * the buffer.  */
+  unsigned int outbound_start;
   unsigned int outbound_pending;
   char *outbound_buffer;
-
-  /* If set sensitive data is conveyed via the internal buffer.  This
-   * flags overwrites the memory of the buffers with zero before they
-   * are released. */
+  unsigned int outbound_eof:1;
+
+  /* Data read ahead from a data object which can't seek, for example
+   * by gpgme_data_identify.  It is returned by gpgme_data_read before
+   * any new data.  READAHEAD_OFF is the offset of the first byte not
+   * yet returned, READAHEAD_LEN the end of the data and
+   * READAHEAD_SIZE the allocated size.  */
+  char *readahead;
+  size_t readahead_off;
+  size_t readahead_len;
+  size_t readahead_size;
+
+  /* If set sensitive data is conveyed via the internal buffer.  The
+   * buffers are then taken from the locked pool of secmem.c and are
+   * overwritten with zero before they are released. */
   unsigned int sensitive:1;
 
   union
@@ -146,8 +159,62 @@ struct gpgme_data
       size_t size;
       size_t length;
       gpgme_off_t offset;
+      /* If not NULL ORIG_BUFFER points into this mapping of a file
+       * which has a length of MAP_LENGTH.  */
+      void *map_base;
+      size_t map_length;
     } mem;
 
+    /* For memory data objects with the flag "chunked".  The data is
+     * kept in a list of chunks; all but the last one are full.  CUR
+     * caches the chunk at CUR_START which was used last.  */
+    struct
+    {
+      struct _gpgme_data_chunk_s *head;
+      struct _gpgme_data_chunk_s *tail;
+      struct _gpgme_data_chunk_s *cur;
+      size_t cur_start;
+      size_t length;
+      gpgme_off_t offset;
+    } chunk;
+
+    /* For gpgme_data_new_from_file and gpgme_data_new_from_filepart
+     * if a large file can't be mapped.  The part of LENGTH bytes at
+     * START of the file is read on demand from STREAM.  */
+    struct
+    {
+      FILE *stream;
+      gpgme_off_t start;
+      gpgme_off_t length;
+      gpgme_off_t offset;
+    } file;
+
+    /* For gpgme_data_new_tee.  SINKS is a NULL terminated array and
+     * COUNT the number of bytes written so far.  */
+    struct
+    {
+      gpgme_data_t *sinks;
+      gpgme_data_digest_cb_t digest_cb;
+      void *digest_cb_value;
+      gpgme_off_t count;
+    } tee;
+
+    /* For gpgme_data_new_base64.  STATE is the decoder or encoder
+     * state; it is NULL after the end of the decoded data.  STREAM
+     * is used by the encoder to write to INNER.  OFFSET is the number
+     * of decoded bytes read or of bytes written.  START is the offset
+     * of INNER where decoding started or -1.  */
+    struct
+    {
+      gpgme_data_t inner;
+      gpgrt_b64state_t state;
+      gpgrt_stream_t stream;
+      char *title;
+      unsigned int flags;
+      gpgme_off_t offset;
+      gpgme_off_t start;
+    } b64;
+
     /* For gpgme_data_new_from_read_cb.  */
     struct
     {
@@ -191,5 +258,24 @@ int _gpgme_data_get_fd (gpgme_data_t dh);
 /* Get the size-hint value for DH or 0 if not available.  */
 uint64_t _gpgme_data_get_size_hint (gpgme_data_t dh);
 
+/* Read up to WANT bytes of DH into its read-ahead buffer without
+   consuming them and return a view of that buffer.  */
+gpgme_error_t _gpgme_data_peek (gpgme_data_t dh, size_t want,
+                                const char **r_buffer, size_t *r_length);
+
+/*-- data-fd.c --*/
+/* Get the file descriptor of DH if it is a regular file which can be
+   passed directly to an engine.  Otherwise return -1.  */
+int _gpgme_data_get_file_fd (gpgme_data_t dh);
+
+/*-- data-mem.c --*/
+/* Switch the empty memory data object DH to chunked mode.  */
+gpgme_error_t _gpgme_data_set_chunked (gpgme_data_t dh);
+
+/* Return a view of the data of the memory data object DH from its
+   current offset on.  */
+gpgme_error_t _gpgme_data_mem_view (gpgme_data_t dh, const char **r_buffer,
+                                    size_t *r_length);
+
 
 #endif	/* DATA_H */
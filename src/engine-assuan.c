@@ -855,5 +855,7 @@ struct engine_ops _gpgme_engine_ops_assuan =
     llass_cancel_op,
     NULL,               /* passwd */
     NULL,               /* set_pinentry_mode */
-    NULL                /* opspawn */
+    NULL,               /* opspawn */
+    NULL,               /* get_process_result */
+    NULL                /* kill_process */
   };
@@ -175,6 +175,12 @@ struct engine_ops
                             gpgme_data_t dataout,
                             gpgme_data_t dataerr, unsigned int flags);
 
+  /* Return the statistics of the last engine process or NULL.  */
+  gpgme_process_result_t (*get_process_result) (void *engine);
+
+  /* Terminate the engine process.  This is used before canceling an
+     operation which exceeded its deadline.  */
+  gpgme_error_t (*kill_process) (void *engine);
 };
 
 
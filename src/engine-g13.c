@@ -825,5 +825,7 @@ struct engine_ops _gpgme_engine_ops_g13 =
     g13_cancel_op,
     NULL,               /* passwd */
     NULL,               /* set_pinentry_mode */
-    NULL                /* opspawn */
+    NULL,               /* opspawn */
+    NULL,               /* get_process_result */
+    NULL                /* kill_process */
   };
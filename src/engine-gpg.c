@@ -46,6 +46,7 @@
 #include "mbox-util.h"
 
 #include "engine-backend.h"
+#include "sys-util.h"
 
 
 /* This type is used to build a list of gpg arguments and data
@@ -155,8 +156,22 @@ struct engine_gpg
     unsigned int auto_key_import : 1;
     unsigned int no_auto_check_trustdb : 1;
     unsigned int proc_all_sigs : 1;
+    unsigned int engine_stats : 1;
+    unsigned int deadline : 1;
   } flags;
 
+  /* The engine process if it is tracked (context flags
+   * "engine-stats" or "deadline-ms").  */
+  struct
+  {
+    int pid;                 /* The unreaped process or -1.  */
+    int fd;                  /* The pidfd or -1.  */
+    void *tag;
+    unsigned long long start;  /* Start time in milliseconds.  */
+    int reaped;              /* RESULT is valid.  */
+    struct _gpgme_op_process_result result;
+  } proc;
+
   /* NULL or the data object fed to --override_session_key-fd.  */
   gpgme_data_t override_session_key;
 
@@ -204,6 +219,12 @@ close_notify_handler (int fd, void *opaque)
     gpg->colon.fd[1] = -1;
   else if (gpg->cmd.fd == fd)
     gpg->cmd.fd = -1;
+  else if (gpg->proc.fd == fd)
+    {
+      if (gpg->proc.tag)
+	(*gpg->io_cbs.remove) (gpg->proc.tag);
+      gpg->proc.fd = -1;
+    }
   else if (gpg->fd_data_map)
     {
       int i;
@@ -534,6 +555,61 @@ free_fd_data_map (struct fd_data_map_s *fd_data_map)
 }
 
 
+#ifndef HAVE_W32_SYSTEM
+/* Milliseconds to wait for the engine process to terminate after its
+   pipes have been closed.  */
+#define REAP_TIMEOUT 1000
+
+/* Try to reap the tracked engine process and record its statistics.
+   If TIMEOUT is not 0, wait up to TIMEOUT milliseconds for the
+   process.  If FORCE is set, kill the process if it does not
+   terminate in time.  Returns true if there is no process left to
+   reap.  */
+static int
+reap_engine_process (engine_gpg_t gpg, unsigned int timeout, int force)
+{
+  struct io_child_stats_s stats;
+  int reaped;
+
+  if (gpg->proc.pid == -1)
+    return 1;
+  if (force)
+    reaped = _gpgme_io_reap (gpg->proc.pid, timeout, &stats);
+  else if (timeout)
+    reaped = _gpgme_io_wait4_timeout (gpg->proc.pid, timeout, &stats);
+  else
+    reaped = _gpgme_io_wait4 (gpg->proc.pid, 0, &stats);
+  if (!reaped)
+    return 0;
+
+  gpg->proc.result.pid = gpg->proc.pid;
+  gpg->proc.result.exit_status = stats.status;
+  gpg->proc.result.exit_signal = stats.signo;
+  gpg->proc.result.wall_time = _gpgme_monotonic_ms () - gpg->proc.start;
+  gpg->proc.result.user_time = stats.user_time;
+  gpg->proc.result.sys_time = stats.sys_time;
+  gpg->proc.result.max_rss = stats.max_rss;
+  gpg->proc.reaped = 1;
+  gpg->proc.pid = -1;
+  return 1;
+}
+
+
+/* The I/O handler for the pidfd of the engine process.  */
+static gpgme_error_t
+pidfd_handler (void *opaque, int fd)
+{
+  struct io_cb_data *data = (struct io_cb_data *) opaque;
+  engine_gpg_t gpg = (engine_gpg_t) data->handler_value;
+
+  assert (fd == gpg->proc.fd);
+  if (reap_engine_process (gpg, 0, 0))
+    _gpgme_io_close (fd);
+  return 0;
+}
+#endif /*!HAVE_W32_SYSTEM*/
+
+
 static gpgme_error_t
 gpg_cancel (void *engine)
 {
@@ -566,6 +642,8 @@ gpg_cancel (void *engine)
       free_fd_data_map (gpg->fd_data_map);
       gpg->fd_data_map = NULL;
     }
+  if (gpg->proc.fd != -1)
+    _gpgme_io_close (gpg->proc.fd);
 
   return 0;
 }
@@ -579,6 +657,11 @@ gpg_release (void *engine)
     return;
 
   gpg_cancel (engine);
+#ifndef HAVE_W32_SYSTEM
+  /* All pipes to the process are closed now; thus it will terminate
+     soon.  A stuck process is killed so that we do not block.  */
+  reap_engine_process (gpg, REAP_TIMEOUT, 1);
+#endif
 
   if (gpg->file_name)
     free (gpg->file_name);
@@ -659,6 +742,8 @@ gpg_new (void **engine, const char *file_name, const char *home_dir,
   gpg->colon.fd[1] = -1;
   gpg->cmd.fd = -1;
   gpg->cmd.idx = -1;
+  gpg->proc.pid = -1;
+  gpg->proc.fd = -1;
 
   /* Allocate the read buffer for the status pipe.  */
   gpg->status.bufsize = 1024;
@@ -825,6 +910,10 @@ gpg_set_engine_flags (void *engine, const gpgme_ctx_t ctx)
 
   gpg->flags.no_auto_check_trustdb = !!ctx->no_auto_check_trustdb;
   gpg->flags.proc_all_sigs = !!ctx->proc_all_sigs;
+#ifndef HAVE_W32_SYSTEM
+  gpg->flags.engine_stats = !!ctx->engine_stats;
+  gpg->flags.deadline = !!ctx->deadline_ms;
+#endif
 }
 
 
@@ -1003,6 +1092,7 @@ build_argv (engine_gpg_t gpg, const char *pgmname)
   char **argv = NULL;
   int need_special = 0;
   int use_agent = 0;
+  int file_fd;
   char *p;
 
   if (_gpgme_in_gpg_one_mode ())
@@ -1337,40 +1427,67 @@ build_argv (engine_gpg_t gpg, const char *pgmname)
 	  /* Create a pipe to pass it down to gpg.  */
 	  fd_data_map[datac].inbound = a->inbound;
 
-	  /* Create a pipe.  */
-	  {
-	    int fds[2];
+	  /* Note that the command fd's data is not a real data
+	     object.  */
+	  if (gpg->cmd.used && gpg->cmd.cb_data == a->data)
+	    file_fd = -1;
+	  else
+	    file_fd = _gpgme_data_get_file_fd (a->data);
+	  if (file_fd != -1)
+	    {
+	      /* The data object is a regular file; gpg can read or
+		 write it directly.  We pass a duplicate because the fd
+		 is closed after the spawn.  No handler is needed.  */
+	      fd_data_map[datac].fd = -1;
+	      fd_data_map[datac].peer_fd = _gpgme_io_dup (file_fd);
+	      if (fd_data_map[datac].peer_fd == -1)
+		{
+		  err = gpg_error_from_syserror ();
+		  goto leave;
+		}
+	      if (_gpgme_io_set_close_notify (fd_data_map[datac].peer_fd,
+					      close_notify_handler, gpg))
+		{
+		  _gpgme_io_close (fd_data_map[datac].peer_fd);
+		  fd_data_map[datac].peer_fd = -1;
+		  err = gpg_error (GPG_ERR_GENERAL);
+		  goto leave;
+		}
+	    }
+	  else
+	    {
+	      int fds[2];
 
-	    if (_gpgme_io_pipe (fds, fd_data_map[datac].inbound ? 1 : 0)
-		== -1)
-	      {
-		err = gpg_error_from_syserror ();
-                goto leave;
-	      }
-	    if (_gpgme_io_set_close_notify (fds[0],
-					    close_notify_handler, gpg)
-		|| _gpgme_io_set_close_notify (fds[1],
-					       close_notify_handler,
-					       gpg))
-	      {
-                /* We leak fd_data_map and the fds.  This is not easy
-                   to avoid and given that we reach this here only
-                   after a malloc failure for a small object, it is
-                   probably better not to do anything.  */
-		return gpg_error (GPG_ERR_GENERAL);
-	      }
-	    /* If the data_type is FD, we have to do a dup2 here.  */
-	    if (fd_data_map[datac].inbound)
-	      {
-		fd_data_map[datac].fd       = fds[0];
-		fd_data_map[datac].peer_fd  = fds[1];
-	      }
-	    else
-	      {
-		fd_data_map[datac].fd       = fds[1];
-		fd_data_map[datac].peer_fd  = fds[0];
-	      }
-	  }
+	      if (_gpgme_io_pipe (fds, fd_data_map[datac].inbound ? 1 : 0)
+		  == -1)
+		{
+		  err = gpg_error_from_syserror ();
+		  goto leave;
+		}
+	      if (_gpgme_io_set_close_notify (fds[0],
+					      close_notify_handler, gpg)
+		  || _gpgme_io_set_close_notify (fds[1],
+						 close_notify_handler,
+						 gpg))
+		{
+		  /* We leak fd_data_map and the fds.  This is not easy
+		     to avoid and given that we reach this here only
+		     after a malloc failure for a small object, it is
+		     probably better not to do anything.  */
+		  return gpg_error (GPG_ERR_GENERAL);
+		}
+	      /* If the data_type is FD, we have to do a dup2 here.  */
+	      if (fd_data_map[datac].inbound)
+		{
+		  fd_data_map[datac].fd       = fds[0];
+		  fd_data_map[datac].peer_fd  = fds[1];
+		}
+	      else
+		{
+		  fd_data_map[datac].fd       = fds[1];
+		  fd_data_map[datac].peer_fd  = fds[0];
+		}
+	    }
 
 	  /* Hack to get hands on the fd later.  */
 	  if (gpg->cmd.used)
@@ -1762,6 +1879,9 @@ start (engine_gpg_t gpg)
   int status;
   struct spawn_fd_item_s *fd_list;
   const char *pgmname;
+  unsigned int spflags;
+  int track;
+  assuan_pid_t pid = (assuan_pid_t)(-1);
 
   if (!gpg)
     return gpg_error (GPG_ERR_INV_VALUE);
@@ -1855,9 +1975,14 @@ start (engine_gpg_t gpg)
   fd_list[n].fd = -1;
   fd_list[n].dup_to = -1;
 
-  status = _gpgme_io_spawn (pgmname, gpg->argv,
-                            (IOSPAWN_FLAG_DETACHED |IOSPAWN_FLAG_ALLOW_SET_FG),
-                            fd_list, NULL, NULL, NULL);
+  /* The process is tracked to collect its statistics or to be able
+   * to terminate it when the deadline expires.  */
+  track = (gpg->flags.engine_stats || gpg->flags.deadline);
+  spflags = (IOSPAWN_FLAG_DETACHED | IOSPAWN_FLAG_ALLOW_SET_FG);
+  if (track)
+    spflags |= IOSPAWN_FLAG_NOREAP;
+  status = _gpgme_io_spawn (pgmname, gpg->argv, spflags,
+                            fd_list, NULL, NULL, track? &pid : NULL);
   {
     int saved_err = gpg_error_from_syserror ();
     free (fd_list);
@@ -1873,6 +1998,32 @@ start (engine_gpg_t gpg)
     /* FIXME: kill the child */
     return rc;
 
+#ifndef HAVE_W32_SYSTEM
+  if (track)
+    {
+      /* Track the process with a pidfd so that the operation is only
+       * finished after the process has been reaped.  Without pidfd
+       * support the process is reaped when the engine is
+       * released.  */
+      gpg->proc.pid = pid;
+      gpg->proc.start = _gpgme_monotonic_ms ();
+      gpg->proc.fd = _gpgme_io_pidfd_open (pid);
+      if (gpg->proc.fd != -1)
+        {
+          if (_gpgme_io_set_close_notify (gpg->proc.fd,
+                                          close_notify_handler, gpg))
+            {
+              _gpgme_io_close (gpg->proc.fd);
+              return gpg_error (GPG_ERR_GENERAL);
+            }
+          rc = add_io_cb (gpg, gpg->proc.fd, 1, pidfd_handler, gpg,
+                          &gpg->proc.tag);
+          if (rc)
+            return rc;
+        }
+    }
+#endif
+
   if (gpg->colon.fnc)
     {
       assert (gpg->colon.fd[0] != -1);
@@ -1891,6 +2042,8 @@ start (engine_gpg_t gpg)
 	  gpg->cmd.fd = gpg->fd_data_map[i].fd;
 	  gpg->fd_data_map[i].fd = -1;
 	}
+      else if (gpg->fd_data_map[i].fd == -1)
+	;  /* Passed directly to gpg.  */
       else
 	{
 	  rc = add_io_cb (gpg, gpg->fd_data_map[i].fd,
@@ -4105,6 +4258,45 @@ gpg_set_io_cbs (void *engine, gpgme_io_cbs_t io_cbs)
 }
 
 
+static gpgme_process_result_t
+gpg_get_process_result (void *engine)
+{
+  engine_gpg_t gpg = engine;
+
+#ifndef HAVE_W32_SYSTEM
+  /* Without a pidfd the process has not been reaped by the operation.
+     Once the status pipe is closed it terminates soon, so reap it now
+     to make the statistics available before the release.  */
+  if (gpg->flags.engine_stats && !gpg->proc.reaped
+      && gpg->status.fd[0] == -1)
+    reap_engine_process (gpg, REAP_TIMEOUT, 0);
+#endif
+
+  return (gpg->flags.engine_stats && gpg->proc.reaped)? &gpg->proc.result
+                                                      : NULL;
+}
+
+
+static gpgme_error_t
+gpg_kill_process (void *engine)
+{
+  engine_gpg_t gpg = engine;
+
+  if (!gpg)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+#ifndef HAVE_W32_SYSTEM
+  /* The process has not been reaped, thus its pid can't have been
+   * reused.  */
+  if (gpg->proc.pid != -1 && _gpgme_io_kill (gpg->proc.pid))
+    return gpg_error_from_syserror ();
+  return 0;
+#else
+  return gpg_error (GPG_ERR_NOT_IMPLEMENTED);
+#endif
+}
+
+
 static gpgme_error_t
 gpg_set_pinentry_mode (void *engine, gpgme_pinentry_mode_t mode)
 {
@@ -4321,5 +4513,7 @@ struct engine_ops _gpgme_engine_ops_gpg =
     NULL,		/* cancel_op */
     gpg_passwd,
     gpg_set_pinentry_mode,
-    NULL                /* opspawn */
+    NULL,               /* opspawn */
+    gpg_get_process_result, /* get_process_result */
+    gpg_kill_process    /* kill_process */
   };
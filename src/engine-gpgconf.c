@@ -1326,5 +1326,7 @@ struct engine_ops _gpgme_engine_ops_gpgconf =
     NULL,               /* cancel_op */
     NULL,               /* passwd */
     NULL,               /* set_pinentry_mode */
-    NULL                /* opspawn */
+    NULL,               /* opspawn */
+    NULL,               /* get_process_result */
+    NULL                /* kill_process */
   };
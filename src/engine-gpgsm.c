@@ -256,6 +256,31 @@ gpgsm_cancel (void *engine)
 }
 
 
+static gpgme_error_t
+gpgsm_kill_process (void *engine)
+{
+  engine_gpgsm_t gpgsm = engine;
+
+  if (!gpgsm)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+#ifndef HAVE_W32_SYSTEM
+  /* This needs to be done before gpgsm_cancel because assuan_release
+     waits for the server process.  */
+  if (gpgsm->assuan_ctx)
+    {
+      assuan_pid_t pid = assuan_get_pid (gpgsm->assuan_ctx);
+
+      if (pid != ASSUAN_INVALID_PID && pid > 0 && _gpgme_io_kill (pid))
+        return gpg_error_from_syserror ();
+    }
+  return 0;
+#else
+  return gpg_error (GPG_ERR_NOT_IMPLEMENTED);
+#endif
+}
+
+
 static void
 gpgsm_release (void *engine)
 {
@@ -2636,5 +2661,7 @@ struct engine_ops _gpgme_engine_ops_gpgsm =
     NULL,		/* cancel_op */
     gpgsm_passwd,
     NULL,               /* set_pinentry_mode */
-    NULL                /* opspawn */
+    NULL,               /* opspawn */
+    NULL,               /* get_process_result */
+    gpgsm_kill_process  /* kill_process */
   };
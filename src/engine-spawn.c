@@ -74,6 +74,14 @@ struct engine_spawn
   struct fd_data_map_s *fd_data_map;
 
   struct gpgme_io_cbs io_cbs;
+
+  /* Set if the operation has a deadline (context flag
+     "deadline-ms").  */
+  int deadline;
+
+  /* The spawned process if it is tracked to terminate it when the
+     deadline expires, or -1.  */
+  assuan_pid_t pid;
 };
 typedef struct engine_spawn *engine_spawn_t;
 
@@ -271,8 +279,15 @@ engspawn_start (engine_spawn_t esp, const char *file, const char *argv[],
       save_argv0 = argv[0];
       argv[0] = _gpgme_get_basename (file);
     }
+#ifndef HAVE_W32_SYSTEM
+  /* Keep a non-detached process as our child so that it can be
+     terminated if the deadline expires.  */
+  if (esp->deadline && !(flags & GPGME_SPAWN_DETACHED))
+    spflags |= IOSPAWN_FLAG_NOREAP;
+#endif
   status = _gpgme_io_spawn (file, (char * const *)argv, spflags,
-                            fd_list, NULL, NULL, NULL);
+                            fd_list, NULL, NULL,
+                            (spflags & IOSPAWN_FLAG_NOREAP)? &esp->pid : NULL);
   if (save_argv0)
     argv[0] = save_argv0;
   free (fd_list);
@@ -339,6 +354,7 @@ engspawn_new (void **engine, const char *file_name, const char *home_dir,
     return gpg_error_from_syserror ();
 
   esp->argtail = &esp->arglist;
+  esp->pid = (assuan_pid_t)(-1);
   *engine = esp;
   return 0;
 }
@@ -354,6 +370,18 @@ engspawn_release (void *engine)
 
   engspawn_cancel (engine);
 
+#ifndef HAVE_W32_SYSTEM
+  if (esp->pid != (assuan_pid_t)(-1))
+    {
+      struct io_child_stats_s stats;
+
+      /* Reap the process; with the pipes closed it is expected to
+         terminate.  A stuck process is killed so that we do not
+         block.  */
+      _gpgme_io_reap (esp->pid, 1000, &stats);
+    }
+#endif
+
   while (esp->arglist)
     {
       struct datalist_s *next = esp->arglist->next;
@@ -366,6 +394,33 @@ engspawn_release (void *engine)
 }
 
 
+static void
+engspawn_set_engine_flags (void *engine, const gpgme_ctx_t ctx)
+{
+  engine_spawn_t esp = engine;
+
+  esp->deadline = !!ctx->deadline_ms;
+}
+
+
+static gpgme_error_t
+engspawn_kill_process (void *engine)
+{
+  engine_spawn_t esp = engine;
+
+  if (!esp)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+#ifndef HAVE_W32_SYSTEM
+  if (esp->pid != (assuan_pid_t)(-1) && _gpgme_io_kill (esp->pid))
+    return gpg_error_from_syserror ();
+  return 0;
+#else
+  return gpg_error (GPG_ERR_NOT_IMPLEMENTED);
+#endif
+}
+
+
 static void
 engspawn_set_io_cbs (void *engine, gpgme_io_cbs_t io_cbs)
 {
@@ -449,7 +504,7 @@ struct engine_ops _gpgme_engine_ops_spawn =
     NULL,		/* set_colon_line_handler */
     NULL,		/* set_locale */
     NULL,		/* set_protocol */
-    NULL,               /* set_engine_flags */
+    engspawn_set_engine_flags, /* set_engine_flags */
     NULL,		/* decrypt */
     NULL,		/* delete */
     NULL,		/* edit */
@@ -482,5 +537,7 @@ struct engine_ops _gpgme_engine_ops_spawn =
     NULL,               /* cancel_op */
     NULL,               /* passwd */
     NULL,               /* set_pinentry_mode */
-    engspawn_op_spawn   /* opspawn */
+    engspawn_op_spawn,  /* opspawn */
+    NULL,               /* get_process_result */
+    engspawn_kill_process /* kill_process */
   };
@@ -1468,5 +1468,7 @@ struct engine_ops _gpgme_engine_ops_uiserver =
     NULL,		/* cancel_op */
     NULL,               /* passwd */
     NULL,               /* set_pinentry_mode */
-    NULL                /* opspawn */
+    NULL,               /* opspawn */
+    NULL,               /* get_process_result */
+    NULL                /* kill_process */
   };
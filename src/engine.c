@@ -1182,3 +1182,29 @@ _gpgme_engine_op_setownertrust (engine_t engine, gpgme_key_t key,
 
   return (*engine->ops->setownertrust) (engine->engine, key, value);
 }
+
+
+gpgme_process_result_t
+_gpgme_engine_get_process_result (engine_t engine)
+{
+  if (!engine)
+    return NULL;
+
+  if (!engine->ops->get_process_result)
+    return NULL;
+
+  return (*engine->ops->get_process_result) (engine->engine);
+}
+
+
+gpgme_error_t
+_gpgme_engine_kill_process (engine_t engine)
+{
+  if (!engine)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  if (!engine->ops->kill_process)
+    return gpg_error (GPG_ERR_NOT_IMPLEMENTED);
+
+  return (*engine->ops->kill_process) (engine->engine);
+}
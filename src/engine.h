@@ -236,4 +236,7 @@ gpgme_error_t _gpgme_engine_op_setownertrust (engine_t engine,
                                               gpgme_key_t key,
                                               const char *value);
 
+gpgme_process_result_t _gpgme_engine_get_process_result (engine_t engine);
+gpgme_error_t _gpgme_engine_kill_process (engine_t engine);
+
 #endif /* ENGINE_H */
@@ -32,7 +32,20 @@
 #include <locale.h>
 #endif
 #include <stdint.h>
+#include <errno.h>
 #include <sys/stat.h>
+#ifdef HAVE_SYS_UIO_H
+# include <sys/uio.h>
+#endif
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+# include <sys/mman.h>
+# define USE_SPOOLING 1
+#endif
+#ifdef HAVE_W32_SYSTEM
+# include <windows.h>
+#else
+# include <pthread.h>
+#endif
 
 #include "json-common.h"
 
@@ -40,9 +53,26 @@
 /* We don't allow a request with more than 64 MiB.  */
 #define MAX_REQUEST_SIZE (64 * 1024 * 1024)
 
+/* The buffer for Native Messaging requests is reused for the next
+ * request.  It has at least this size and is released after a
+ * request which needed more than REQUEST_BUFFER_KEEP bytes.  */
+#define REQUEST_BUFFER_MIN  4096
+#define REQUEST_BUFFER_KEEP (1024 * 1024)
+
+/* Spooled requests are copied to their file in blocks of this size.  */
+#define SPOOL_BUFSIZE (64 * 1024)
+
 /* True is debug mode is active.  */
 static int opt_debug;
 
+/* Requests larger than this are spooled to a temporary file; 0 if
+ * spooling is disabled.  */
+static unsigned long opt_spool_threshold;
+
+/* True if the text of listed keys shall be checked; see
+ * json_common_s.  */
+static int opt_check_writer;
+
 
 /*
  *  Driver code
@@ -368,23 +398,582 @@ read_and_process_single_request (ctrl_t ctrl)
 }
 
 
+/* Requests with an id are processed concurrently by up to this many
+ * threads.  */
+#define MAX_JOBS 8
+
+/* While this many requests have data pending for getmore, new
+ * requests with an id are refused.  Pending data is never dropped
+ * because the client has been told to fetch it.  */
+#define MAX_PENDING_JOBS 8
+
+/* A request spooled to a temporary file and mapped into memory.  */
+struct spooled_request_s
+{
+  estream_t fp;               /* The unlinked temporary file.  */
+  char *request;              /* The mapping or NULL.  */
+  size_t length;              /* The length of the mapping.  */
+};
+typedef struct spooled_request_s *spooled_request_t;
+
+/* A request with an id.  */
+struct job_s
+{
+  struct job_s *next;
+  char *id;                   /* The printed id of the request.  */
+  cjson_t json;               /* The request; released by the job.  */
+  spooled_request_t spool;    /* The spooled request JSON has been
+                               * parsed from or NULL.  */
+  struct json_common_s ctrl;  /* The state of this request.  */
+#ifdef HAVE_W32_SYSTEM
+  HANDLE thread;
+#else
+  pthread_t thread;
+#endif
+};
+typedef struct job_s *job_t;
+
+/* The running jobs in the order they were started.  */
+static job_t running_jobs;
+
+/* The finished jobs which have data pending for getmore; the most
+ * recent first.  */
+static job_t pending_jobs;
+
+/* The lock to write a response and the flag telling that writing
+ * failed.  */
+GPGRT_LOCK_DEFINE (write_lock);
+static int write_failed;
+
+
+#ifdef HAVE_SYS_UIO_H
+/* Write the length header NRESPONSE and the RESPONSE itself with one
+ * system call to the file descriptor of es_stdout, which is not used
+ * for anything else in Native Messaging mode.  Partial writes are
+ * continued.  */
+static gpg_error_t
+writev_response (uint32_t nresponse, const char *response)
+{
+  struct iovec iov[2];
+  struct iovec *v = iov;
+  int iovcnt = 2;
+  ssize_t nwritten;
+  int fd;
+
+  fd = es_fileno (es_stdout);
+  if (fd == -1)
+    return gpg_error (GPG_ERR_EBADF);
+
+  iov[0].iov_base = &nresponse;
+  iov[0].iov_len = sizeof nresponse;
+  iov[1].iov_base = (void *)response;
+  iov[1].iov_len = nresponse;
+  while (iovcnt)
+    {
+      nwritten = writev (fd, v, iovcnt);
+      if (nwritten == -1)
+        {
+          if (errno == EINTR)
+            continue;
+          return gpg_error_from_syserror ();
+        }
+      for (; iovcnt && (size_t)nwritten >= v->iov_len; v++, iovcnt--)
+        nwritten -= v->iov_len;
+      if (iovcnt)
+        {
+          v->iov_base = (char *)v->iov_base + nwritten;
+          v->iov_len -= nwritten;
+        }
+    }
+  return 0;
+}
+#endif /*HAVE_SYS_UIO_H*/
+
+
+/* Write RESPONSE using the Native Messaging protocol.  Returns -1 on
+ * error; an error has then already been logged.  */
+static int
+write_response (const char *response)
+{
+  gpg_error_t err;
+  uint32_t nresponse;
+#ifndef HAVE_SYS_UIO_H
+  size_t n;
+#endif
+  int rc = -1;
+
+  gpgrt_lock_lock (&write_lock);
+  if (write_failed)
+    goto leave;
+
+  nresponse = strlen (response);
+#ifdef HAVE_SYS_UIO_H
+  err = writev_response (nresponse, response);
+  if (err)
+    {
+      log_error ("error writing request: %s\n", gpg_strerror (err));
+      goto leave;
+    }
+#else
+  if (es_write (es_stdout, &nresponse, sizeof nresponse, &n))
+    {
+      err = gpg_error_from_syserror ();
+      log_error ("error writing request header: %s\n", gpg_strerror (err));
+      goto leave;
+    }
+  if (n != sizeof nresponse)
+    {
+      log_error ("error writing request header: short write\n");
+      goto leave;
+    }
+  if (es_write (es_stdout, response, nresponse, &n))
+    {
+      err = gpg_error_from_syserror ();
+      log_error ("error writing request: %s\n", gpg_strerror (err));
+      goto leave;
+    }
+  if (n != nresponse)
+    {
+      log_error ("error writing request: short write\n");
+      goto leave;
+    }
+  if (es_fflush (es_stdout) || es_ferror (es_stdout))
+    {
+      err = gpg_error_from_syserror ();
+      log_error ("error writing request: %s\n", gpg_strerror (err));
+      goto leave;
+    }
+#endif
+  rc = 0;
+
+ leave:
+  if (rc)
+    write_failed = 1;
+  gpgrt_lock_unlock (&write_lock);
+  return rc;
+}
+
+
+static void
+release_spooled_request (spooled_request_t spool)
+{
+  if (!spool)
+    return;
+#ifdef USE_SPOOLING
+  if (spool->request)
+    munmap (spool->request, spool->length);
+#endif
+  es_fclose (spool->fp);
+  xfree (spool);
+}
+
+
+static void
+release_job (job_t job)
+{
+  if (!job)
+    return;
+  cJSON_Delete (job->json);
+  release_spooled_request (job->spool);
+  json_core_release_pending (&job->ctrl);
+  xfree (job->id);
+  xfree (job);
+}
+
+
+/* Process the request of JOB and write the response.  */
+static void
+run_job (job_t job)
+{
+  char *response;
+
+  response = json_core_process_json (&job->ctrl, job->json);
+  job->json = NULL;
+  /* The pending data does not reference the request.  */
+  release_spooled_request (job->spool);
+  job->spool = NULL;
+  if (opt_debug)
+    log_debug ("response='%s'\n", response);
+  write_response (response);
+  xfree (response);
+}
+
+
+#ifdef HAVE_W32_SYSTEM
+static DWORD WINAPI
+job_thread (void *arg)
+{
+  run_job (arg);
+  return 0;
+}
+#else
+static void *
+job_thread (void *arg)
+{
+  run_job (arg);
+  return NULL;
+}
+#endif
+
+
+/* Wait for the running JOB to finish.  If data is pending for
+ * getmore the job is kept; otherwise it is released.  */
+static void
+finish_job (job_t job)
+{
+  job_t *jp;
+
+  for (jp = &running_jobs; *jp; jp = &(*jp)->next)
+    if (*jp == job)
+      {
+        *jp = job->next;
+        break;
+      }
+
+#ifdef HAVE_W32_SYSTEM
+  WaitForSingleObject (job->thread, INFINITE);
+  CloseHandle (job->thread);
+#else
+  pthread_join (job->thread, NULL);
+#endif
+
+  if (!job->ctrl.pending_data.buffer)
+    {
+      release_job (job);
+      return;
+    }
+
+  job->next = pending_jobs;
+  pending_jobs = job;
+}
+
+
+/* Wait for all running jobs to finish.  */
+static void
+finish_all_jobs (void)
+{
+  while (running_jobs)
+    finish_job (running_jobs);
+}
+
+
+/* Remove the job for ID from the list of jobs with pending data and
+ * return it.  Returns NULL if there is no such job.  */
+static job_t
+take_pending_job (const char *id)
+{
+  job_t job, *jp;
+
+  for (job = running_jobs; job; job = job->next)
+    if (!strcmp (job->id, id))
+      {
+        /* The client has already seen the response; thus the job
+         * terminates soon.  */
+        finish_job (job);
+        break;
+      }
+
+  for (jp = &pending_jobs; *jp; jp = &(*jp)->next)
+    if (!strcmp ((*jp)->id, id))
+      {
+        job = *jp;
+        *jp = job->next;
+        job->next = NULL;
+        return job;
+      }
+  return NULL;
+}
+
+
+/* Return the number of jobs in the list starting at JOB.  */
+static int
+count_jobs (job_t job)
+{
+  int n;
+
+  for (n = 0; job; job = job->next)
+    n++;
+  return n;
+}
+
+
+/* Write an error response for the request JSON which can't be
+ * processed because too many requests have data pending.  */
+static void
+write_busy_response (cjson_t json)
+{
+  gpg_error_t err = gpg_error (GPG_ERR_EBUSY);
+  cjson_t response, j_tmp;
+  char *text;
+
+  response = gpg_error_object (NULL, err, "Too many requests with"
+                               " pending data; use getmore first: %s",
+                               gpg_strerror (err));
+  j_tmp = cJSON_GetObjectItem (json, "op");
+  if (j_tmp && cjson_is_string (j_tmp))
+    xjson_AddStringToObject (response, "op", j_tmp->valuestring);
+  j_tmp = cJSON_Duplicate (cJSON_GetObjectItem (json, "id"), 1);
+  if (!j_tmp)
+    xoutofcore ("cJSON_Duplicate");
+  xjson_AddItemToObject (response, "id", j_tmp);
+
+  text = cJSON_PrintUnformatted (response);
+  if (!text)
+    xoutofcore ("cJSON_PrintUnformatted");
+  if (opt_debug)
+    log_debug ("response='%s'\n", text);
+  write_response (text);
+  xfree (text);
+  cJSON_Delete (response);
+}
+
+
+/* Start a job to process the request JSON with the id ID.  SPOOL is
+ * the spooled request JSON has been parsed from or NULL.  Ownership of
+ * JSON, ID and SPOOL is transferred to this function.  */
+static void
+start_job (cjson_t json, char *id, spooled_request_t spool)
+{
+  job_t job, *jp;
+
+  /* A new request replaces the pending data of an old request with
+   * the same id.  */
+  release_job (take_pending_job (id));
+
+  /* Each running job may leave pending data.  Only if that may exceed
+   * the limit we wait for them to see whether there is room.  */
+  if (count_jobs (pending_jobs) + count_jobs (running_jobs)
+      >= MAX_PENDING_JOBS)
+    {
+      finish_all_jobs ();
+      if (count_jobs (pending_jobs) >= MAX_PENDING_JOBS)
+        {
+          write_busy_response (json);
+          cJSON_Delete (json);
+          release_spooled_request (spool);
+          xfree (id);
+          return;
+        }
+    }
+
+  if (count_jobs (running_jobs) >= MAX_JOBS)
+    finish_job (running_jobs);
+
+  job = xcalloc (1, sizeof *job);
+  job->id = id;
+  job->json = json;
+  job->spool = spool;
+  job->ctrl.check_writer = opt_check_writer;
+
+#ifdef HAVE_W32_SYSTEM
+  job->thread = CreateThread (NULL, 0, job_thread, job, 0, NULL);
+  if (!job->thread)
+#else
+  if (pthread_create (&job->thread, NULL, job_thread, job))
+#endif
+    {
+      log_error ("error creating thread - processing request directly\n");
+      run_job (job);
+      release_job (job);
+      return;
+    }
+
+  for (jp = &running_jobs; *jp; jp = &(*jp)->next)
+    ;
+  *jp = job;
+}
+
+
+/* Process the REQUEST and write the response.  Requests with an id
+ * are processed by a job and getmore requests with an id are routed
+ * to the job of that id.  All other requests are processed in order
+ * after all jobs have finished.  If SPOOL is not NULL the REQUEST is
+ * its mapping and parsed in place; ownership of SPOOL is transferred
+ * to this function so that it is released as soon as the request has
+ * been processed.  */
+static void
+process_native_request (ctrl_t ctrl, char *request, spooled_request_t spool)
+{
+  cjson_t json, j_id, j_op;
+  char *response;
+  char *id;
+  job_t job;
+  size_t erroff;
+
+  if (spool)
+    json = cJSON_ParseInPlace (request, &erroff);
+  else
+    json = cJSON_Parse (request, NULL);
+  j_id = json? cJSON_GetObjectItem (json, "id") : NULL;
+  if (!j_id || !(cjson_is_string (j_id) || cjson_is_number (j_id))
+      || !(id = cJSON_PrintUnformatted (j_id)))
+    {
+      finish_all_jobs ();
+      if (json)
+        response = json_core_process_json (ctrl, json);
+      else if (spool)  /* The request has already been modified.  */
+        response = error_object_string ("invalid JSON object at offset %zu\n",
+                                        erroff);
+      else
+        response = json_core_process_request (ctrl, request);
+      if (opt_debug)
+        log_debug ("response='%s'\n", response);
+      write_response (response);
+      xfree (response);
+      release_spooled_request (spool);
+      return;
+    }
+
+  j_op = cJSON_GetObjectItem (json, "op");
+  if (!j_op || !cjson_is_string (j_op)
+      || strcmp (j_op->valuestring, "getmore"))
+    {
+      start_job (json, id, spool);
+      return;
+    }
+
+  job = take_pending_job (id);
+  if (job)
+    {
+      response = json_core_process_json (&job->ctrl, json);
+      if (job->ctrl.pending_data.buffer)
+        {
+          job->next = pending_jobs;
+          pending_jobs = job;
+        }
+      else
+        release_job (job);
+    }
+  else
+    {
+      /* Nothing pending for this id; this returns an error.  */
+      struct json_common_s nodata_ctrl = { 0 };
+
+      response = json_core_process_json (&nodata_ctrl, json);
+      json_core_release_pending (&nodata_ctrl);
+    }
+  if (opt_debug)
+    log_debug ("response='%s'\n", response);
+  write_response (response);
+  xfree (response);
+  release_spooled_request (spool);
+  xfree (id);
+}
+
+
+#ifdef USE_SPOOLING
+/* Read the request of NREQUEST bytes into an unlinked temporary file
+ * and process it from a private mapping of that file.  Thus a large
+ * request is not kept in memory.  The mapping is released by the job
+ * processing the request as soon as it has been processed so that
+ * other jobs keep running meanwhile.  Returns -1 on a read error.  */
+static int
+process_spooled_request (ctrl_t ctrl, uint32_t nrequest)
+{
+  gpg_error_t err;
+  spooled_request_t spool;
+  char *buffer = NULL;
+  char *response;
+  size_t total = 0;
+  size_t n;
+  int rc = -1;
+
+  spool = xcalloc (1, sizeof *spool);
+  spool->length = (size_t)nrequest + 1;
+  spool->fp = es_tmpfile ();
+  if (!spool->fp || !(buffer = xtrymalloc (SPOOL_BUFSIZE)))
+    {
+      err = gpg_error_from_syserror ();
+      log_error ("error spooling request: %s\n", gpg_strerror (err));
+      goto leave;
+    }
+
+  while (total < nrequest)
+    {
+      n = nrequest - total;
+      if (n > SPOOL_BUFSIZE)
+        n = SPOOL_BUFSIZE;
+      if (es_read (es_stdin, buffer, n, &n))
+        {
+          err = gpg_error_from_syserror ();
+          log_error ("error reading request: %s\n", gpg_strerror (err));
+          goto leave;
+        }
+      if (!n)
+        break;
+      if (es_write (spool->fp, buffer, n, NULL))
+        {
+          err = gpg_error_from_syserror ();
+          log_error ("error spooling request: %s\n", gpg_strerror (err));
+          goto leave;
+        }
+      total += n;
+    }
+  if (total != nrequest)
+    {
+      /* That is a protocol violation.  */
+      response = error_object_string ("Invalid request:"
+                                      " short read (%zu of %zu bytes)\n",
+                                      total, (size_t)nrequest);
+      finish_all_jobs ();
+      write_response (response);
+      xfree (response);
+      rc = 0;
+      goto leave;
+    }
+
+  /* Append the terminating Nul so that the mapping ends with it.  */
+  if (es_write (spool->fp, "", 1, NULL) || es_fflush (spool->fp))
+    {
+      err = gpg_error_from_syserror ();
+      log_error ("error spooling request: %s\n", gpg_strerror (err));
+      goto leave;
+    }
+  spool->request = mmap (NULL, spool->length, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE, es_fileno (spool->fp), 0);
+  if (spool->request == MAP_FAILED)
+    {
+      spool->request = NULL;
+      err = gpg_error_from_syserror ();
+      log_error ("error mapping request: %s\n", gpg_strerror (err));
+      goto leave;
+    }
+
+  if (opt_debug)
+    log_debug ("request of %zu bytes spooled\n", (size_t)nrequest);
+  process_native_request (ctrl, spool->request, spool);
+  spool = NULL;
+  rc = 0;
+
+ leave:
+  release_spooled_request (spool);
+  xfree (buffer);
+  return rc;
+}
+#endif /*USE_SPOOLING*/
+
+
 /* The Native Messaging processing loop.  */
 static void
 native_messaging_repl (ctrl_t ctrl)
 {
   gpg_error_t err;
-  uint32_t nrequest, nresponse;
+  uint32_t nrequest;
   char *request = NULL;
+  size_t requestsize = 0;
   char *response = NULL;
   size_t n;
+  job_t job;
 
   /* Due to the length octets we need to switch the I/O stream into
    * binary mode.  */
   es_set_binary (es_stdin);
   es_set_binary (es_stdout);
-  es_setbuf (es_stdin, NULL);  /* stdin needs to be unbuffered! */
+  /* stdin needs to be unbuffered!  This also lets es_read read the
+   * request directly into our buffer.  */
+  es_setbuf (es_stdin, NULL);
 
-  for (;;)
+  while (!write_failed)
     {
       /* Read length.  Note that the protocol uses native endianness.
        * Is it allowed to call such a thing a well thought out
@@ -402,6 +991,14 @@ native_messaging_repl (ctrl_t ctrl)
           log_error ("error reading request header: short read\n");
           break;
         }
+#ifdef USE_SPOOLING
+      if (opt_spool_threshold && nrequest > opt_spool_threshold)
+        {
+          if (process_spooled_request (ctrl, nrequest))
+            break;
+          continue;
+        }
+#endif
       if (nrequest > MAX_REQUEST_SIZE)
         {
           log_error ("error reading request: request too long (%zu MiB)\n",
@@ -412,8 +1009,16 @@ native_messaging_repl (ctrl_t ctrl)
           break;
         }
 
-      /* Read request.  */
-      request = xtrymalloc (nrequest + 1);
+      /* Read request into the buffer; it is enlarged if needed.  The
+       * request is parsed from that buffer.  */
+      if (nrequest + 1 > requestsize)
+        {
+          xfree (request);
+          requestsize = nrequest + 1;
+          if (requestsize < REQUEST_BUFFER_MIN)
+            requestsize = REQUEST_BUFFER_MIN;
+          request = xtrymalloc (requestsize);
+        }
       if (!request)
         {
           err = gpg_error_from_syserror ();
@@ -431,59 +1036,35 @@ native_messaging_repl (ctrl_t ctrl)
       if (n != nrequest)
         {
           /* That is a protocol violation.  */
-          xfree (response);
           response = error_object_string ("Invalid request:"
                                           " short read (%zu of %zu bytes)\n",
                                           n, (size_t)nrequest);
+          finish_all_jobs ();
+          write_response (response);
+          xfree (response);
+          response = NULL;
         }
       else /* Process request  */
         {
           request[n] = '\0'; /* Ensure that request has an end */
           if (opt_debug)
             log_debug ("request='%s'\n", request);
-          xfree (response);
-          response = json_core_process_request (ctrl, request);
-          if (opt_debug)
-            log_debug ("response='%s'\n", response);
-        }
-      nresponse = strlen (response);
-
-      /* Write response */
-      if (es_write (es_stdout, &nresponse, sizeof nresponse, &n))
-        {
-          err = gpg_error_from_syserror ();
-          log_error ("error writing request header: %s\n", gpg_strerror (err));
-          break;
-        }
-      if (n != sizeof nresponse)
-        {
-          log_error ("error writing request header: short write\n");
-          break;
-        }
-      if (es_write (es_stdout, response, nresponse, &n))
-        {
-          err = gpg_error_from_syserror ();
-          log_error ("error writing request: %s\n", gpg_strerror (err));
-          break;
+          process_native_request (ctrl, request, NULL);
         }
-      if (n != nresponse)
+      if (requestsize > REQUEST_BUFFER_KEEP)
         {
-          log_error ("error writing request: short write\n");
-          break;
-        }
-      if (es_fflush (es_stdout) || es_ferror (es_stdout))
-        {
-          err = gpg_error_from_syserror ();
-          log_error ("error writing request: %s\n", gpg_strerror (err));
-          break;
+          xfree (request);
+          request = NULL;
+          requestsize = 0;
         }
-      xfree (response);
-      response = NULL;
-      xfree (request);
-      request = NULL;
     }
 
-  xfree (response);
+  finish_all_jobs ();
+  while ((job = pending_jobs))
+    {
+      pending_jobs = job->next;
+      release_job (job);
+    }
   xfree (request);
 }
 
@@ -585,7 +1166,9 @@ main (int argc, char *argv[])
          CMD_IDENTIFY
   } cmd = CMD_DEFAULT;
   enum {
-    OPT_DEBUG = 600
+    OPT_DEBUG = 600,
+    OPT_SPOOL_THRESHOLD,
+    OPT_CHECK_WRITER
   };
 
   static gpgrt_opt_t opts[] = {
@@ -594,6 +1177,9 @@ main (int argc, char *argv[])
     ARGPARSE_c  (CMD_IDENTIFY,    "identify",    "Identify the input"),
     ARGPARSE_c  (CMD_LIBVERSION,  "lib-version", "Show library version"),
     ARGPARSE_s_n(OPT_DEBUG,       "debug",       "Flyswatter"),
+    ARGPARSE_s_u(OPT_SPOOL_THRESHOLD, "spool-threshold",
+                 "|N|spool requests larger than N bytes to temp files"),
+    ARGPARSE_s_n(OPT_CHECK_WRITER, "check-writer", "@"),
 
     ARGPARSE_end()
   };
@@ -631,6 +1217,10 @@ main (int argc, char *argv[])
           break;
 
         case OPT_DEBUG: opt_debug = 1; break;
+        case OPT_SPOOL_THRESHOLD:
+          opt_spool_threshold = pargs.r.ret_ulong;
+          break;
+        case OPT_CHECK_WRITER: opt_check_writer = 1; break;
 
         default:
           pargs.err = ARGPARSE_PRINT_WARNING;
@@ -638,6 +1228,7 @@ main (int argc, char *argv[])
         }
     }
   gpgrt_argparse (NULL, &pargs, NULL);
+  ctrl->check_writer = opt_check_writer;
 
   if (!opt_debug)
     {
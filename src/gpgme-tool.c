@@ -33,6 +33,17 @@
 #ifdef HAVE_LOCALE_H
 #include <locale.h>
 #endif
+#ifndef HAVE_W32_SYSTEM
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
 
 #include <assuan.h>
 
@@ -101,7 +112,6 @@ init_membuf (membuf_t *mb, int initiallen)
    operation will then behave as if AMOUNT bytes had not been put into
    the buffer.  If AMOUNT is greater than the actual accumulated
    bytes, the membuf is basically reset to its initial state.  */
-#if 0 /* Not yet used.  */
 static void
 clear_membuf (membuf_t *mb, size_t amount)
 {
@@ -116,7 +126,7 @@ clear_membuf (membuf_t *mb, size_t amount)
       memmove (mb->buf, mb->buf+amount, mb->len);
     }
 }
-#endif /* unused */
+
 
 static void
 put_membuf (membuf_t *mb, const void *buf, size_t len)
@@ -180,7 +190,6 @@ get_membuf (membuf_t *mb, size_t *len)
    returned which is valid until the next operation on MB.  If LEN is
    not NULL the current LEN of the buffer is stored there.  On error
    NULL is returned and ERRNO is set.  */
-#if 0 /* Not yet used.  */
 static const void *
 peek_membuf (membuf_t *mb, size_t *len)
 {
@@ -197,7 +206,6 @@ peek_membuf (membuf_t *mb, size_t *len)
     *len = mb->len;
   return p;
 }
-#endif /* unused */
 
 
 
@@ -301,11 +309,16 @@ static const char xml_preamble2[] = "<gpgme>\n";
 static const char xml_end[] = "</gpgme>\n";
 
 
+/* The output is collected in a buffer and passed to the callback in
+ * blocks of this size.  */
+#define RESULT_XML_BLOCKSIZE 8192
+
 struct result_xml_state
 {
   int indent;
   result_xml_write_cb_t cb;
   void *hook;
+  membuf_t out;      /* The output not yet passed to CB.  */
 
 #define MAX_TAGS 20
   int next_tag;
@@ -322,46 +335,100 @@ result_init (struct result_xml_state *state, int indent,
   state->indent = indent;
   state->cb = cb;
   state->hook = hook;
+  init_membuf (&state->out, RESULT_XML_BLOCKSIZE + 1024);
 }
 
 
+/* Pass the buffered output of STATE to the callback.  With FINAL
+ * also flush the callback.  */
+static gpg_error_t
+result_xml_flush_1 (struct result_xml_state *state, int final)
+{
+  gpg_error_t err = 0;
+  const void *buf;
+  size_t len;
+
+  buf = peek_membuf (&state->out, &len);
+  if (!buf)
+    return gpg_error_from_syserror ();
+  if (len)
+    {
+      err = (*state->cb) (state->hook, buf, len);
+      clear_membuf (&state->out, len);
+    }
+  if (!err && final)
+    err = (*state->cb) (state->hook, NULL, 0);
+  return err;
+}
+
+
+/* Pass all output written so far to the callback.  */
 gpg_error_t
+result_xml_flush (struct result_xml_state *state)
+{
+  return result_xml_flush_1 (state, 1);
+}
+
+
+/* Flush the output and release STATE.  */
+gpg_error_t
+result_finish (struct result_xml_state *state)
+{
+  gpg_error_t err;
+
+  err = result_xml_flush_1 (state, 1);
+  free (get_membuf (&state->out, NULL));
+  return err;
+}
+
+
+static void
+result_xml_put (struct result_xml_state *state, const char *buf, size_t len)
+{
+  put_membuf (&state->out, buf, len);
+  if (get_membuf_len (&state->out) >= RESULT_XML_BLOCKSIZE)
+    result_xml_flush_1 (state, 0);
+}
+
+
+static void
+result_xml_put_str (struct result_xml_state *state, const char *string)
+{
+  result_xml_put (state, string, strlen (string));
+}
+
+
+void
 result_xml_indent (struct result_xml_state *state)
 {
-  char spaces[state->indent + 1];
-  int i;
-  for (i = 0; i < state->indent; i++)
-    spaces[i] = ' ';
-  spaces[i] = '\0';
-  return (*state->cb) (state->hook, spaces, i);
+  static const char spaces[] = "                                ";
+  int n;
+
+  for (n = state->indent; n > 0; n -= sizeof spaces - 1)
+    result_xml_put (state, spaces,
+                    n < sizeof spaces - 1? n : sizeof spaces - 1);
 }
 
 
 gpg_error_t
 result_xml_tag_start (struct result_xml_state *state, const char *name, ...)
 {
-  result_xml_write_cb_t cb = state->cb;
-  void *hook = state->hook;
   va_list ap;
   char *attr;
   char *attr_val;
-  char string_null[] = "(null)";
 
   va_start (ap, name);
 
   if (state->next_tag > 0)
     {
       if (! state->had_data[state->next_tag - 1])
-	{
-	  (*cb) (hook, ">\n", 2);
-	  (*cb) (hook, NULL, 0);
-	}
+	result_xml_put (state, ">\n", 2);
       state->had_data[state->next_tag - 1] = 1;
     }
 
   result_xml_indent (state);
-  (*cb) (hook, "<", 1);
-  (*cb) (hook, name, strlen (name));
+  result_xml_put (state, "<", 1);
+  result_xml_put_str (state, name);
 
   state->tag[state->next_tag] = name;
   state->had_data[state->next_tag] = 0;
@@ -376,13 +443,13 @@ result_xml_tag_start (struct result_xml_state *state, const char *name, ...)
 
       attr_val = va_arg (ap, char *);
       if (attr_val == NULL)
-	attr_val = string_null;
+	attr_val = "(null)";
 
-      (*cb) (hook, " ", 1);
-      (*cb) (hook, attr, strlen (attr));
-      (*cb) (hook, "=\"", 2);
-      (*cb) (hook, attr_val, strlen (attr_val));
-      (*cb) (hook, "\"", 1);
+      result_xml_put (state, " ", 1);
+      result_xml_put_str (state, attr);
+      result_xml_put (state, "=\"", 2);
+      result_xml_put_str (state, attr_val);
+      result_xml_put (state, "\"", 1);
     }
   va_end (ap);
   return 0;
@@ -405,60 +472,42 @@ result_xml_escape_replacement(char c)
     }
 }
 
-/* Escape DATA by replacing certain characters with their XML
-   entities.  The result is stored in a newly allocated buffer which
-   address will be stored at BUF.   Returns 0 on success. */
-static gpg_error_t
-result_xml_escape (const char *data, char **buf)
+/* Write DATA to the output of STATE with certain characters replaced
+   by their XML entities.  */
+static void
+result_xml_put_escaped (struct result_xml_state *state, const char *data)
 {
-  int data_len, i;
-  const char *r;
-  membuf_t mb;
+  const char *s, *r;
 
-  init_membuf (&mb, 128);
-  if (data)
+  if (!data)
+    return;
+  for (s = data; *s; s++)
     {
-      data_len = strlen (data);
-      for (i = 0; i < data_len; i++)
+      r = result_xml_escape_replacement (*s);
+      if (r)
         {
-          r = result_xml_escape_replacement (data[i]);
-          if (r)
-            put_membuf (&mb, r, strlen (r));
-          else
-            put_membuf (&mb, data+i, 1);
+          result_xml_put (state, data, s - data);
+          result_xml_put_str (state, r);
+          data = s + 1;
         }
     }
-  put_membuf (&mb, "", 1);
-  *buf = get_membuf (&mb, NULL);
-  return *buf? 0 : gpg_error_from_syserror ();
+  result_xml_put (state, data, s - data);
 }
 
 
 gpg_error_t
 result_xml_tag_data (struct result_xml_state *state, const char *data)
 {
-  gpg_error_t err;
-  result_xml_write_cb_t cb = state->cb;
-  void *hook = state->hook;
-  char *buf = NULL;
-
   if (state->had_data[state->next_tag - 1])
     {
-      (*cb) (hook, "\n", 2);
-      (*cb) (hook, NULL, 0);
+      result_xml_put (state, "\n", 2);
       result_xml_indent (state);
     }
   else
-    (*cb) (hook, ">", 1);
+    result_xml_put (state, ">", 1);
   state->had_data[state->next_tag - 1] = 2;
 
-  err = result_xml_escape (data, &buf);
-  if (err)
-    return err;
-
-  (*cb) (hook, buf, strlen (buf));
-
-  free (buf);
+  result_xml_put_escaped (state, data);
 
   return 0;
 }
@@ -467,9 +516,6 @@ result_xml_tag_data (struct result_xml_state *state, const char *data)
 gpg_error_t
 result_xml_tag_end (struct result_xml_state *state)
 {
-  result_xml_write_cb_t cb = state->cb;
-  void *hook = state->hook;
-
   state->next_tag--;
   state->indent -= 2;
 
@@ -477,17 +523,12 @@ result_xml_tag_end (struct result_xml_state *state)
     {
       if (state->had_data[state->next_tag] == 1)
 	result_xml_indent (state);
-      (*cb) (hook, "</", 2);
-      (*cb) (hook, state->tag[state->next_tag],
-	     strlen (state->tag[state->next_tag]));
-      (*cb) (hook, ">\n", 2);
-      (*cb) (hook, NULL, 0);
+      result_xml_put (state, "</", 2);
+      result_xml_put_str (state, state->tag[state->next_tag]);
+      result_xml_put (state, ">\n", 2);
     }
   else
-    {
-      (*cb) (hook, " />\n", 4);
-      (*cb) (hook, NULL, 0);
-    }
+    result_xml_put (state, " />\n", 4);
   return 0;
 }
 
@@ -718,7 +759,7 @@ result_encrypt_to_xml (gpgme_ctx_t ctx, int indent,
     }
   result_xml_tag_end (&state);
 
-  return 0;
+  return result_finish (&state);
 }
 
 
@@ -771,7 +812,7 @@ result_decrypt_to_xml (gpgme_ctx_t ctx, int indent,
     }
   result_xml_tag_end (&state);
 
-  return 0;
+  return result_finish (&state);
 }
 
 
@@ -831,7 +872,7 @@ result_sign_to_xml (gpgme_ctx_t ctx, int indent,
 
   result_xml_tag_end (&state);
 
-  return 0;
+  return result_finish (&state);
 }
 
 
@@ -891,7 +932,7 @@ result_verify_to_xml (gpgme_ctx_t ctx, int indent,
 
   result_xml_tag_end (&state);
 
-  return 0;
+  return result_finish (&state);
 }
 
 
@@ -947,7 +988,7 @@ result_import_to_xml (gpgme_ctx_t ctx, int indent,
 
   result_xml_tag_end (&state);
 
-  return 0;
+  return result_finish (&state);
 }
 
 
@@ -971,7 +1012,7 @@ result_genkey_to_xml (gpgme_ctx_t ctx, int indent,
 
   result_xml_tag_end (&state);
 
-  return 0;
+  return result_finish (&state);
 }
 
 
@@ -992,7 +1033,7 @@ result_keylist_to_xml (gpgme_ctx_t ctx, int indent,
 
   result_xml_tag_end (&state);
 
-  return 0;
+  return result_finish (&state);
 }
 
 
@@ -1013,7 +1054,7 @@ result_vfs_mount_to_xml (gpgme_ctx_t ctx, int indent,
 
   result_xml_tag_end (&state);
 
-  return 0;
+  return result_finish (&state);
 }
 
 
@@ -1056,6 +1097,10 @@ struct gpgme_tool
   void *write_status_hook;
   gpg_error_t (*write_data) (void *hook, const void *buf, size_t len);
   void *write_data_hook;
+
+  /* Set if this is one of many clients of a socket server.  Errors
+   * of the connection are then not fatal.  */
+  int shared;
 };
 typedef struct gpgme_tool *gpgme_tool_t;
 
@@ -1290,7 +1335,7 @@ gt_write_status (gpgme_tool_t gt, status_t status, ...)
 
   err = gt->write_status (gt->write_status_hook, status_string[status], buf);
   if (err)
-    log_error (1, err, "can't write status line");
+    log_error (gt->shared? 0 : 1, err, "can't write status line");
 }
 
 
@@ -1795,6 +1840,9 @@ struct server
   char *message_filename;
   FILE *message_stream;
   gpgme_data_encoding_t message_enc;
+
+  /* Reading a command line shall not wait for more input.  */
+  int nonblock;
 };
 
 
@@ -2905,11 +2953,9 @@ cmd_keylist (assuan_context_t ctx, char *line)
     }
   pattern[idx] = NULL;
 
-  gt_write_data (gt, xml_preamble1, strlen (xml_preamble1));
-  gt_write_data (gt, NULL, 0);
-  gt_write_data (gt, xml_preamble2, strlen (xml_preamble2));
-  gt_write_data (gt, NULL, 0);
   result_init (&state, indent, (result_xml_write_cb_t) gt_write_data, gt);
+  result_xml_put_str (&state, xml_preamble1);
+  result_xml_put_str (&state, xml_preamble2);
   result_xml_tag_start (&state, "keylist", NULL);
 
   err = gt_keylist_start (server->gt, pattern, secret_only);
@@ -2978,11 +3024,14 @@ cmd_keylist (assuan_context_t ctx, char *line)
 	  result_xml_tag_end (&state);  /* uids */
 	  result_xml_tag_end (&state);  /* key */
 	  gpgme_key_unref (key);
+	  /* Send each key as soon as it is listed.  */
+	  result_xml_flush (&state);
 	}
     }
 
   result_xml_tag_end (&state);  /* keylist */
-  gt_write_data (gt, xml_end, strlen (xml_end));
+  result_xml_put_str (&state, xml_end);
+  result_finish (&state);
 
   server_reset_fds (server);
 
@@ -3218,16 +3267,14 @@ cmd_spawn (assuan_context_t ctx, char *line)
 }
 
 
-/* Tell the assuan library about our commands.  */
-static gpg_error_t
-register_commands (assuan_context_t ctx)
+/* The commands of the server.  */
+static struct
 {
-  gpg_error_t err;
-  static struct {
-    const char *name;
-    assuan_handler_t handler;
-    const char * const help;
-  } table[] = {
+  const char *name;
+  assuan_handler_t handler;
+  const char * const help;
+} command_table[] =
+  {
     /* RESET, BYE are implicit.  */
     { "VERSION", cmd_version, hlp_version },
     /* TODO: Set engine info.  */
@@ -3280,12 +3327,41 @@ register_commands (assuan_context_t ctx)
     { "SPAWN", cmd_spawn, hlp_spawn },
     { NULL }
   };
+
+
+/* The handler for all commands if they are processed with
+ * assuan_process_next.  The command needs then to be finished with
+ * assuan_process_done.  */
+static gpg_error_t
+cmd_async (assuan_context_t ctx, char *line)
+{
+  struct server *server = assuan_get_pointer (ctx);
+  const char *name = assuan_get_command_name (ctx);
+  int idx;
+
+  /* A command may inquire more data from the client.  */
+  server->nonblock = 0;
+  for (idx = 0; command_table[idx].name; idx++)
+    if (!strcmp (command_table[idx].name, name))
+      return assuan_process_done (ctx,
+                                  command_table[idx].handler (ctx, line));
+  return assuan_process_done (ctx, gpg_error (GPG_ERR_ASS_UNKNOWN_CMD));
+}
+
+
+/* Tell the assuan library about our commands.  */
+static gpg_error_t
+register_commands (assuan_context_t ctx, int async)
+{
+  gpg_error_t err;
   int idx;
 
-  for (idx = 0; table[idx].name; idx++)
+  for (idx = 0; command_table[idx].name; idx++)
     {
-      err = assuan_register_command (ctx, table[idx].name, table[idx].handler,
-                                     table[idx].help);
+      err = assuan_register_command (ctx, command_table[idx].name,
+                                     (async? cmd_async
+                                      /**/ : command_table[idx].handler),
+                                     command_table[idx].help);
       if (err)
         return err;
     }
@@ -3293,27 +3369,53 @@ register_commands (assuan_context_t ctx)
 }
 
 
+/* Initialize SERVER for the state GT.  */
+static void
+server_init (struct server *server, gpgme_tool_t gt)
+{
+  memset (server, 0, sizeof (*server));
+  server->input_fd = ASSUAN_INVALID_FD;
+  server->output_fd = ASSUAN_INVALID_FD;
+  server->message_fd = ASSUAN_INVALID_FD;
+  server->input_enc = GPGME_DATA_ENCODING_NONE;
+  server->output_enc = GPGME_DATA_ENCODING_NONE;
+  server->message_enc = GPGME_DATA_ENCODING_NONE;
+
+  server->gt = gt;
+  gt->write_status = server_write_status;
+  gt->write_status_hook = server;
+  gt->write_data = server_write_data;
+  gt->write_data_hook = server;
+}
+
+
+/* Register the commands with the initialized assuan context of
+ * SERVER.  ASYNC is set if the commands are processed with
+ * assuan_process_next.  */
+static gpg_error_t
+server_register (struct server *server, int async)
+{
+  gpg_error_t err;
+  static const char hello[] = ("GPGME-Tool " VERSION " ready");
+
+  err = register_commands (server->assuan_ctx, async);
+  if (err)
+    return err;
+  assuan_set_hello_line (server->assuan_ctx, hello);
+
+  assuan_register_reset_notify (server->assuan_ctx, reset_notify);
+  return 0;
+}
+
+
 void
 gpgme_server (gpgme_tool_t gt)
 {
   gpg_error_t err;
   assuan_fd_t filedes[2];
   struct server server;
-  static const char hello[] = ("GPGME-Tool " VERSION " ready");
-
-  memset (&server, 0, sizeof (server));
-  server.input_fd = ASSUAN_INVALID_FD;
-  server.output_fd = ASSUAN_INVALID_FD;
-  server.message_fd = ASSUAN_INVALID_FD;
-  server.input_enc = GPGME_DATA_ENCODING_NONE;
-  server.output_enc = GPGME_DATA_ENCODING_NONE;
-  server.message_enc = GPGME_DATA_ENCODING_NONE;
 
-  server.gt = gt;
-  gt->write_status = server_write_status;
-  gt->write_status_hook = &server;
-  gt->write_data = server_write_data;
-  gt->write_data_hook = &server;
+  server_init (&server, gt);
 
   /* We use a pipe based server so that we can work from scripts.
    * assuan_init_pipe_server will automagically detect when we are
@@ -3330,12 +3432,9 @@ gpgme_server (gpgme_tool_t gt)
   err = assuan_init_pipe_server (server.assuan_ctx, filedes);
   if (err)
     log_error (1, err, "can't initialize assuan server");
-  err = register_commands (server.assuan_ctx);
+  err = server_register (&server, 0);
   if (err)
     log_error (1, err, "can't register assuan commands");
-  assuan_set_hello_line (server.assuan_ctx, hello);
-
-  assuan_register_reset_notify (server.assuan_ctx, reset_notify);
 
 #define DBG_ASSUAN 0
   if (DBG_ASSUAN)
@@ -3361,6 +3460,422 @@ gpgme_server (gpgme_tool_t gt)
 }
 
 
+#ifndef HAVE_W32_SYSTEM
+/* MULTI-CLIENT SERVER.  */
+
+/* With --socket the server listens on a socket and serves many
+ * clients at once.  Each connection has its own gpgme_tool state and
+ * context.  The main thread polls the idle connections and hands a
+ * connection with pending input to a pool of worker threads, which
+ * process its commands and give it back.  Thus an idle connection
+ * does not occupy a worker.  */
+
+struct connection
+{
+  struct connection *next;
+  struct server server;
+  struct gpgme_tool gt;
+  int fd;              /* The socket of the client.  */
+  int accepted;        /* The hello line has been sent.  */
+  int closed;          /* The connection is to be released.  */
+  time_t last_active;
+};
+typedef struct connection *connection_t;
+
+static struct
+{
+  int workers;
+  int max_clients;
+  int idle_timeout;    /* In seconds; 0 for none.  */
+} socket_opt = { 4, 64, 300 };
+
+/* Connections waiting for a worker and connections given back by the
+ * workers.  Both are protected by CONN_LOCK.  */
+static pthread_mutex_t conn_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t conn_cond = PTHREAD_COND_INITIALIZER;
+static connection_t ready_conns;
+static connection_t *ready_tail = &ready_conns;
+static connection_t done_conns;
+
+/* A pipe to wake up the main thread if a connection is given back.  */
+static int wakeup_fd[2];
+
+
+static void
+connection_release (connection_t conn)
+{
+  if (!conn)
+    return;
+  server_reset_fds (&conn->server);
+  /* This also closes the socket.  */
+  assuan_release (conn->server.assuan_ctx);
+  gt_recipients_clear (&conn->gt);
+  gpgme_release (conn->gt.ctx);
+  free (conn);
+}
+
+
+/* The read hooks of the connections.  While a worker reads the next
+ * command line they do not wait for more input; libassuan then keeps
+ * a partial line until the rest arrives.  */
+static ssize_t
+connection_read (assuan_context_t ctx, assuan_fd_t fd,
+                 void *buffer, size_t size)
+{
+  struct server *server = assuan_get_pointer (ctx);
+
+  if (server && server->nonblock)
+    return recv (fd, buffer, size, MSG_DONTWAIT);
+  return __assuan_read (ctx, fd, buffer, size);
+}
+
+
+static int
+connection_recvmsg (assuan_context_t ctx, assuan_fd_t fd,
+                    assuan_msghdr_t msg, int flags)
+{
+  struct server *server = assuan_get_pointer (ctx);
+
+  if (server && server->nonblock)
+    flags |= MSG_DONTWAIT;
+  return __assuan_recvmsg (ctx, fd, msg, flags);
+}
+
+
+static struct assuan_system_hooks connection_system_hooks =
+  {
+    ASSUAN_SYSTEM_HOOKS_VERSION,
+    __assuan_usleep,
+    __assuan_pipe,
+    __assuan_close,
+    connection_read,
+    __assuan_write,
+    connection_recvmsg,
+    __assuan_sendmsg,
+    __assuan_spawn,
+    __assuan_waitpid,
+    __assuan_socketpair,
+    __assuan_socket,
+    __assuan_connect
+  };
+
+
+/* Create a connection for the accepted socket FD.  Returns NULL on
+ * error; FD is then closed.  */
+static connection_t
+connection_new (int fd)
+{
+  gpg_error_t err;
+  connection_t conn;
+
+  conn = calloc (1, sizeof *conn);
+  if (!conn)
+    {
+      log_error (0, gpg_error_from_syserror (), "can't allocate connection");
+      close (fd);
+      return NULL;
+    }
+  conn->gt.shared = 1;
+  server_init (&conn->server, &conn->gt);
+
+  err = _gt_gpgme_new (&conn->gt, &conn->gt.ctx);
+  if (!err)
+    err = assuan_new (&conn->server.assuan_ctx);
+  if (err)
+    {
+      log_error (0, err, "can't create context for connection");
+      gpgme_release (conn->gt.ctx);
+      free (conn);
+      close (fd);
+      return NULL;
+    }
+  assuan_set_pointer (conn->server.assuan_ctx, &conn->server);
+  assuan_ctx_set_system_hooks (conn->server.assuan_ctx,
+                               &connection_system_hooks);
+
+  err = assuan_init_socket_server (conn->server.assuan_ctx, fd,
+                                   (ASSUAN_SOCKET_SERVER_ACCEPTED
+                                    | ASSUAN_SOCKET_SERVER_FDPASSING));
+  if (err)
+    close (fd);
+  else
+    {
+      conn->fd = fd;
+      err = server_register (&conn->server, 1);
+    }
+  if (err)
+    {
+      log_error (0, err, "can't initialize assuan server");
+      connection_release (conn);
+      return NULL;
+    }
+  return conn;
+}
+
+
+/* Append CONN to the connections waiting for a worker.  */
+static void
+connection_schedule (connection_t conn)
+{
+  conn->next = NULL;
+  pthread_mutex_lock (&conn_lock);
+  *ready_tail = conn;
+  ready_tail = &conn->next;
+  pthread_cond_signal (&conn_cond);
+  pthread_mutex_unlock (&conn_lock);
+}
+
+
+/* Process the commands of the connections waiting for a worker.  */
+static void *
+worker_thread (void *arg)
+{
+  connection_t conn;
+  gpg_error_t err;
+  int done;
+
+  (void)arg;
+
+  for (;;)
+    {
+      pthread_mutex_lock (&conn_lock);
+      while (!ready_conns)
+        pthread_cond_wait (&conn_cond, &conn_lock);
+      conn = ready_conns;
+      ready_conns = conn->next;
+      if (!ready_conns)
+        ready_tail = &ready_conns;
+      pthread_mutex_unlock (&conn_lock);
+
+      done = 0;
+      if (!conn->accepted)
+        {
+          conn->accepted = 1;
+          err = assuan_accept (conn->server.assuan_ctx);
+          if (err)
+            {
+              log_error (0, err, "assuan accept problem");
+              done = 1;
+            }
+        }
+      else
+        {
+          /* This processes only the command lines already received
+           * so that the worker does not wait for an idle client or
+           * for the rest of a partial line.  Lines which libassuan
+           * has buffered are not seen by poll and are processed
+           * here too.  A partial line is kept by libassuan; the
+           * connection is then subject to the idle timeout.  */
+          do
+            {
+              conn->server.nonblock = 1;
+              err = assuan_process_next (conn->server.assuan_ctx, &done);
+            }
+          while (!err && !done
+                 && assuan_pending_line (conn->server.assuan_ctx));
+          conn->server.nonblock = 0;
+          if (gpg_err_code (err) == GPG_ERR_EAGAIN)
+            err = 0;
+          if (err)
+            {
+              log_error (0, err, "assuan processing failed");
+              done = 1;
+            }
+        }
+      conn->closed = done;
+
+      /* Give the connection back to the main thread.  */
+      pthread_mutex_lock (&conn_lock);
+      conn->next = done_conns;
+      done_conns = conn;
+      pthread_mutex_unlock (&conn_lock);
+      if (write (wakeup_fd[1], "", 1) < 0 && errno != EAGAIN)
+        log_error (0, gpg_error_from_syserror (), "can't wake up server");
+    }
+
+  return NULL;
+}
+
+
+/* Create the listening socket NAME.  */
+static int
+socket_listen (const char *name)
+{
+  struct sockaddr_un addr;
+  struct stat st;
+  mode_t oldmask;
+  int fd, rc;
+
+  memset (&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+  if (strlen (name) >= sizeof addr.sun_path)
+    log_error (1, gpg_error (GPG_ERR_ENAMETOOLONG),
+               "can't use socket '%s'", name);
+  strcpy (addr.sun_path, name);
+
+  fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1)
+    log_error (1, gpg_error_from_syserror (), "can't create socket");
+
+  /* Remove a stale socket but do not take over one which is in use.  */
+  if (!lstat (name, &st) && S_ISSOCK (st.st_mode))
+    {
+      if (!connect (fd, (struct sockaddr *)&addr, sizeof addr))
+        log_error (1, gpg_error (GPG_ERR_EADDRINUSE),
+                   "socket '%s' is in use", name);
+      unlink (name);
+    }
+
+  /* Only the owner may connect to the socket.  */
+  oldmask = umask (0077);
+  rc = bind (fd, (struct sockaddr *)&addr, sizeof addr);
+  umask (oldmask);
+  if (rc || listen (fd, SOMAXCONN))
+    log_error (1, gpg_error_from_syserror (),
+               "can't listen on socket '%s'", name);
+  return fd;
+}
+
+
+/* Serve the clients connecting to the socket NAME.  */
+static void
+socket_server (const char *name)
+{
+  int listen_fd, fd;
+  struct pollfd *pfds;
+  connection_t *pconns;
+  connection_t idle = NULL;
+  connection_t conn, next, list;
+  int nconns = 0;
+  int npfds, timeout, i;
+  time_t now;
+  char buffer[64];
+  pthread_t thread;
+
+  /* A client closing its connection early shall not terminate us.  */
+  signal (SIGPIPE, SIG_IGN);
+
+  listen_fd = socket_listen (name);
+  if (pipe (wakeup_fd))
+    log_error (1, gpg_error_from_syserror (), "can't create pipe");
+  fcntl (wakeup_fd[0], F_SETFL, O_NONBLOCK);
+  fcntl (wakeup_fd[1], F_SETFL, O_NONBLOCK);
+
+  pfds = calloc (socket_opt.max_clients + 2, sizeof *pfds);
+  pconns = calloc (socket_opt.max_clients + 2, sizeof *pconns);
+  if (!pfds || !pconns)
+    log_error (1, gpg_error_from_syserror (), "can't allocate poll array");
+
+  for (i = 0; i < socket_opt.workers; i++)
+    {
+      if (pthread_create (&thread, NULL, worker_thread, NULL))
+        log_error (1, gpg_error_from_syserror (), "can't create worker");
+      pthread_detach (thread);
+    }
+
+  for (;;)
+    {
+      now = time (NULL);
+
+      /* Take back the connections from the workers.  */
+      pthread_mutex_lock (&conn_lock);
+      list = done_conns;
+      done_conns = NULL;
+      pthread_mutex_unlock (&conn_lock);
+      for (conn = list; conn; conn = next)
+        {
+          next = conn->next;
+          if (conn->closed)
+            {
+              connection_release (conn);
+              nconns--;
+            }
+          else
+            {
+              conn->last_active = now;
+              conn->next = idle;
+              idle = conn;
+            }
+        }
+
+      /* Wait for new connections only below the limit.  */
+      npfds = 0;
+      pfds[npfds].fd = wakeup_fd[0];
+      pfds[npfds].events = POLLIN;
+      pconns[npfds++] = NULL;
+      if (nconns < socket_opt.max_clients)
+        {
+          pfds[npfds].fd = listen_fd;
+          pfds[npfds].events = POLLIN;
+          pconns[npfds++] = NULL;
+        }
+      timeout = -1;
+      for (conn = idle; conn; conn = conn->next)
+        {
+          pfds[npfds].fd = conn->fd;
+          pfds[npfds].events = POLLIN;
+          pconns[npfds++] = conn;
+          if (socket_opt.idle_timeout)
+            {
+              i = conn->last_active + socket_opt.idle_timeout - now;
+              if (i < 0)
+                i = 0;
+              if (timeout == -1 || i * 1000 < timeout)
+                timeout = i * 1000;
+            }
+        }
+
+      if (poll (pfds, npfds, timeout) == -1)
+        {
+          if (errno == EINTR)
+            continue;
+          log_error (1, gpg_error_from_syserror (), "poll failed");
+        }
+      now = time (NULL);
+
+      if (pfds[0].revents)
+        while (read (wakeup_fd[0], buffer, sizeof buffer) > 0)
+          ;
+
+      if (nconns < socket_opt.max_clients && pfds[1].revents)
+        {
+          fd = accept (listen_fd, NULL, NULL);
+          if (fd == -1)
+            log_error (0, gpg_error_from_syserror (), "accept failed");
+          else if ((conn = connection_new (fd)))
+            {
+              nconns++;
+              connection_schedule (conn);
+            }
+        }
+
+      /* Hand the connections with input to the workers and close
+       * those which have been idle for too long.  */
+      idle = NULL;
+      for (i = 0; i < npfds; i++)
+        {
+          conn = pconns[i];
+          if (!conn)
+            continue;
+          if (pfds[i].revents)
+            connection_schedule (conn);
+          else if (socket_opt.idle_timeout
+                   && now - conn->last_active >= socket_opt.idle_timeout)
+            {
+              connection_release (conn);
+              nconns--;
+            }
+          else
+            {
+              conn->next = idle;
+              idle = conn;
+            }
+        }
+    }
+}
+#endif /*!HAVE_W32_SYSTEM*/
+
+
 
 static const char *
 my_strusage( int level )
@@ -3396,11 +3911,21 @@ main (int argc, char *argv[])
     ARGPARSE_c  ('s', "server",      "Server mode"),
     ARGPARSE_s_s(501, "gpg-binary",  "|FILE|Use FILE for the GPG backend"),
     ARGPARSE_c  (502, "lib-version", "Show library version"),
+    ARGPARSE_s_s(503, "socket",
+                 "|FILE|Serve many clients on the socket FILE"),
+    ARGPARSE_s_i(504, "workers",
+                 "|N|Use N threads to serve the clients (default 4)"),
+    ARGPARSE_s_i(505, "max-clients",
+                 "|N|Serve at most N clients at once (default 64)"),
+    ARGPARSE_s_i(506, "idle-timeout",
+                 "|N|Close connections idle for N seconds (default 300)"),
     ARGPARSE_end()
   };
   ARGPARSE_ARGS pargs = { &argc, &argv, 0 };
-  enum { CMD_DEFAULT, CMD_SERVER, CMD_LIBVERSION } cmd = CMD_DEFAULT;
+  enum { CMD_DEFAULT, CMD_SERVER, CMD_SOCKET, CMD_LIBVERSION } cmd
+    = CMD_DEFAULT;
   const char *gpg_binary = NULL;
+  const char *socket_name = NULL;
   struct gpgme_tool gt;
   gpg_error_t err;
   int needgt = 1;
@@ -3427,16 +3952,32 @@ main (int argc, char *argv[])
         case 's': cmd = CMD_SERVER; break;
         case 501: gpg_binary = pargs.r.ret_str; break;
         case 502: cmd = CMD_LIBVERSION; break;
+#ifndef HAVE_W32_SYSTEM
+        case 503: cmd = CMD_SOCKET; socket_name = pargs.r.ret_str; break;
+        case 504: socket_opt.workers = pargs.r.ret_int; break;
+        case 505: socket_opt.max_clients = pargs.r.ret_int; break;
+        case 506: socket_opt.idle_timeout = pargs.r.ret_int; break;
+#else
+        case 503: case 504: case 505: case 506:
+          log_error (1, gpg_error (GPG_ERR_NOT_SUPPORTED),
+                     "socket server mode");
+          break;
+#endif
         default:
           pargs.err = ARGPARSE_PRINT_WARNING;
 	  break;
         }
     }
 
-  if (cmd == CMD_LIBVERSION)
+  if (cmd == CMD_LIBVERSION || cmd == CMD_SOCKET)
     needgt = 0;
+#ifndef HAVE_W32_SYSTEM
+  if (socket_opt.workers < 1 || socket_opt.max_clients < 1
+      || socket_opt.idle_timeout < 0)
+    log_error (1, gpg_error (GPG_ERR_INV_VALUE), "invalid socket option");
+#endif
 
-  if (needgt && gpg_binary)
+  if ((needgt || cmd == CMD_SOCKET) && gpg_binary)
     {
       if (access (gpg_binary, X_OK))
         err = gpg_error_from_syserror ();
@@ -3458,6 +3999,12 @@ main (int argc, char *argv[])
       gpgme_server (&gt);
       break;
 
+#ifndef HAVE_W32_SYSTEM
+    case CMD_SOCKET:
+      socket_server (socket_name);
+      break;
+#endif
+
     case CMD_LIBVERSION:
       printf ("Version from header: %s (0x%06x)\n",
               GPGME_VERSION, GPGME_VERSION_NUMBER);
@@ -28,6 +28,7 @@
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #ifdef HAVE_LOCALE_H
 #include <locale.h>
 #endif
@@ -179,6 +180,11 @@ _gpgme_cancel_with_err (gpgme_ctx_t ctx, gpg_error_t ctx_err,
   TRACE_BEG  (DEBUG_CTX, "_gpgme_cancel_with_err", ctx, "ctx_err=%i, op_err=%i",
 	      ctx_err, op_err);
 
+  /* An engine which exceeded the deadline may be stuck; make sure it
+     terminates.  */
+  if (gpg_err_code (ctx_err) == GPG_ERR_TIMEOUT)
+    _gpgme_engine_kill_process (ctx->engine);
+
   if (ctx_err)
     {
       err = _gpgme_engine_cancel (ctx->engine);
@@ -231,6 +237,9 @@ gpgme_cancel_async (gpgme_ctx_t ctx)
   ctx->canceled = 1;
   UNLOCK (ctx->lock);
 
+  /* Let a thread waiting in gpgme_wait notice this.  */
+  _gpgme_wait_global_wakeup ();
+
   return TRACE_ERR (0);
 }
 
@@ -246,6 +255,7 @@ gpgme_release (gpgme_ctx_t ctx)
 
   _gpgme_engine_release (ctx->engine);
   ctx->engine = NULL;
+  _gpgme_reactor_release_ctx (ctx);
   _gpgme_fd_table_deinit (&ctx->fdt);
   _gpgme_release_result (ctx);
   _gpgme_signers_clear (ctx);
@@ -625,6 +635,34 @@ gpgme_set_ctx_flag (gpgme_ctx_t ctx, const char *name, const char *value)
     {
       ctx->proc_all_sigs = abool;
     }
+  else if (!strcmp (name, "engine-stats"))
+    {
+      ctx->engine_stats = abool;
+    }
+  else if (!strcmp (name, "deadline-ms"))
+    {
+      char *endp;
+      unsigned long ms;
+
+      if (!value || !*value)
+        ms = 0;
+      else
+        {
+          gpg_err_set_errno (0);
+          ms = strtoul (value, &endp, 10);
+          if (errno || *endp || ms > UINT_MAX)
+            err = gpg_error (GPG_ERR_INV_VALUE);
+        }
+      /* We do not control the timeouts of a user event loop.  */
+      if (!err && ms && ctx->io_cbs.add)
+        err = gpg_error (GPG_ERR_NOT_SUPPORTED);
+      if (!err)
+        {
+          ctx->deadline_ms = ms;
+          snprintf (ctx->deadline_ms_str, sizeof ctx->deadline_ms_str,
+                    "%u", ctx->deadline_ms);
+        }
+    }
   else if (!strcmp (name, "known-notations"))
     {
       free (ctx->known_notations);
@@ -732,6 +770,14 @@ gpgme_get_ctx_flag (gpgme_ctx_t ctx, const char *name)
     {
       return ctx->proc_all_sigs? "1":"";
     }
+  else if (!strcmp (name, "engine-stats"))
+    {
+      return ctx->engine_stats? "1":"";
+    }
+  else if (!strcmp (name, "deadline-ms"))
+    {
+      return ctx->deadline_ms? ctx->deadline_ms_str : "";
+    }
   else if (!strcmp (name, "known-notations"))
     {
       return ctx->known_notations? ctx->known_notations: "";
@@ -745,6 +791,41 @@ gpgme_get_ctx_flag (gpgme_ctx_t ctx, const char *name)
 }
 
 
+/* Return the exit status and resource usage of the engine process
+   used by the last operation on CTX.  Returns NULL if the context
+   flag "engine-stats" was not set, the engine does not support this,
+   or the process has not yet been reaped.  The result is valid until
+   the next operation is started on CTX.  */
+gpgme_process_result_t
+gpgme_op_process_result (gpgme_ctx_t ctx)
+{
+  gpgme_process_result_t result;
+
+  TRACE_BEG (DEBUG_CTX, "gpgme_op_process_result", ctx, "");
+
+  if (!ctx)
+    {
+      TRACE_SUC ("result=(null)");
+      return NULL;
+    }
+
+  result = _gpgme_engine_get_process_result (ctx->engine);
+  if (!result)
+    {
+      TRACE_SUC ("result=(null)");
+      return NULL;
+    }
+
+  TRACE_LOG  ("pid=%d exit_status=%d exit_signal=%d",
+              result->pid, result->exit_status, result->exit_signal);
+  TRACE_LOG  ("wall=%lums user=%lums sys=%lums max_rss=%lukB",
+              result->wall_time, result->user_time, result->sys_time,
+              result->max_rss);
+  TRACE_SUC ("result=%p", result);
+  return result;
+}
+
+
 /* Enable or disable the use of the special textmode.  Textmode is for
   example used for the RFC2015 signatures; note that the updated RFC
   3156 mandates that the MUA does some preparations so that textmode
@@ -1007,6 +1088,8 @@ gpgme_set_io_cbs (gpgme_ctx_t ctx, gpgme_io_cbs_t io_cbs)
   if (!ctx)
     return;
 
+  _gpgme_reactor_release_ctx (ctx);
+
   if (io_cbs)
     {
       TRACE (DEBUG_CTX, "gpgme_set_io_cbs", ctx,
@@ -0,0 +1,184 @@
+/* json-b64.c - Base64 codec for gpgme-json.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GPGME.
+ *
+ * GPGME is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GPGME is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <https://gnu.org/licenses/>.
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* All data passed between gpgme-json and its client is Base64
+ * encoded.  The codec of libgpg-error works on a stream and handles
+ * one character at a time; the functions here work on complete
+ * buffers and handle a group of four characters at once.  They do not
+ * depend on anything else so that they can also be used by test
+ * programs.  */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "json-common.h"
+
+
+/* The characters used for Base64.  */
+static const char bintoasc[64] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* The values of the characters; whitespace is marked by 0xfe, the pad
+ * character by 0xfd, and all invalid characters by 0xff.  */
+#define B64_SPACE 0xfe
+#define B64_PAD   0xfd
+static const unsigned char asctobin[256] =
+  {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xfe, 0xfe, 0xff, 0xff, 0xfe, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xfe, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b,
+    0x3c, 0x3d, 0xff, 0xff, 0xff, 0xfd, 0xff, 0xff,
+    0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+    0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+    0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16,
+    0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20,
+    0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30,
+    0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+  };
+
+
+/* Store the Base64 encoding of the LENGTH bytes at BUFFER at OUT and
+ * return the number of characters stored.  OUT must have room for
+ * json_b64_encoded_len (LENGTH) characters; no Nul is appended.  */
+size_t
+json_b64_encode (char *out, const void *buffer, size_t length)
+{
+  const unsigned char *s = buffer;
+  char *d = out;
+  unsigned int v;
+
+  for (; length >= 3; length -= 3, s += 3, d += 4)
+    {
+      v = (s[0] << 16) | (s[1] << 8) | s[2];
+      d[0] = bintoasc[v >> 18];
+      d[1] = bintoasc[(v >> 12) & 0x3f];
+      d[2] = bintoasc[(v >> 6) & 0x3f];
+      d[3] = bintoasc[v & 0x3f];
+    }
+  if (length)
+    {
+      v = (s[0] << 16) | (length > 1? (s[1] << 8) : 0);
+      d[0] = bintoasc[v >> 18];
+      d[1] = bintoasc[(v >> 12) & 0x3f];
+      d[2] = length > 1? bintoasc[(v >> 6) & 0x3f] : '=';
+      d[3] = '=';
+      d += 4;
+    }
+
+  return d - out;
+}
+
+
+/* Decode the LENGTH characters of Base64 at STRING and store the
+ * result at OUT; OUT may be the same as STRING.  The length of the
+ * result is stored at R_NBYTES.  Whitespace is ignored and decoding
+ * stops at the first pad character.  Returns GPG_ERR_BAD_DATA for
+ * invalid characters or an incomplete group.  */
+gpg_error_t
+json_b64_decode (void *out, const char *string, size_t length,
+                 size_t *r_nbytes)
+{
+  const unsigned char *s = (const unsigned char *)string;
+  const unsigned char *end = s + length;
+  unsigned char *d = out;
+  unsigned int a, b, c, e;
+  unsigned int v = 0;
+  int idx = 0;
+
+  *r_nbytes = 0;
+  while (s < end)
+    {
+      /* The fast path for a complete group.  Only characters of the
+       * Base64 alphabet have values below 0x80.  */
+      if (!idx && end - s >= 4)
+        {
+          a = asctobin[s[0]];
+          b = asctobin[s[1]];
+          c = asctobin[s[2]];
+          e = asctobin[s[3]];
+          if (!((a | b | c | e) & 0x80))
+            {
+              v = (a << 18) | (b << 12) | (c << 6) | e;
+              d[0] = v >> 16;
+              d[1] = v >> 8;
+              d[2] = v;
+              d += 3;
+              s += 4;
+              continue;
+            }
+        }
+
+      a = asctobin[*s++];
+      if (a == B64_SPACE)
+        continue;
+      if (a == B64_PAD)
+        break;
+      if (a == 0xff)
+        return gpg_error (GPG_ERR_BAD_DATA);
+      v = (v << 6) | a;
+      if (++idx == 4)
+        {
+          d[0] = v >> 16;
+          d[1] = v >> 8;
+          d[2] = v;
+          d += 3;
+          idx = 0;
+          v = 0;
+        }
+    }
+
+  /* Flush a partial group.  */
+  if (idx == 1)
+    return gpg_error (GPG_ERR_BAD_DATA);
+  else if (idx == 2)
+    *d++ = v >> 4;
+  else if (idx == 3)
+    {
+      *d++ = v >> 10;
+      *d++ = v >> 2;
+    }
+
+  *r_nbytes = d - (unsigned char *)out;
+  return 0;
+}
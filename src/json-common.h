@@ -40,6 +40,21 @@
 #define CALLOC_ONLY 1
 
 
+/* A writer for JSON text; see json-util.c.  */
+struct json_writer_s
+{
+  char *buffer;    /* The text; Nul terminated.  */
+  size_t length;   /* The length of the text.  */
+  size_t size;     /* The allocated size of BUFFER.  */
+  int need_comma;  /* The next value needs a separator.  */
+};
+typedef struct json_writer_s *json_writer_t;
+
+
+/* The state of a streamed key listing; see json-core.c.  */
+struct keylist_stream_s;
+
+
 /* An object to keep state for the gpgme-json tools.  For the classic
  * gpgme-json tool tehre is just one instance of it but for a server
  * there will be one per connection.  */
@@ -50,12 +65,42 @@ struct json_common_s
   int interactive;
 
 
-  /* Pending data to be returned by a getmore command.  */
+  /* If set large items of a response may be kept to be encoded only
+   * while the response is written.  */
+  int stream_data;
+
+  /* If set the text written for each listed key is compared with the
+   * output of the cJSON functions; used by the tests.  */
+  int check_writer;
+
+  /* Pending data to be returned by a getmore command.  If NAME is set
+   * the response is streamed: The item NAME with the encoded content
+   * of DATA or the JSON text written for KEYLIST is inserted at offset
+   * SPLIT of BUFFER.  If SPOOLBUF is set DATA is a temporary file
+   * which is read block by block into SPOOLBUF; VIEW is then the
+   * current block.  With KEYLIST the keys are retrieved only while the
+   * response is written and VIEW is the text of the current key.  */
   struct
   {
     char  *buffer;   /* Malloced data or NULL if not used.  */
-    size_t length;   /* Length of that data.  */
-    size_t written;  /* # of already written bytes from BUFFER.  */
+    size_t buflen;   /* Length of BUFFER.  */
+    size_t length;   /* Total length of the response or 0 if unknown.  */
+    size_t written;  /* # of already written bytes of the response.  */
+    size_t bufpos;   /* # of already written bytes from BUFFER.  */
+    size_t split;    /* Offset in BUFFER where the item is inserted.  */
+    const char *name;    /* The name of the item or NULL.  */
+    gpgme_data_t data;   /* The data object or NULL.  */
+    struct keylist_stream_s *keylist;  /* The key listing or NULL.  */
+    const char *view;    /* The content of DATA or the key text.  */
+    size_t viewlen;      /* Length of that content.  */
+    size_t viewpos;      /* # of already encoded bytes from VIEW.  */
+    int base64;          /* Encode VIEW with Base64 instead of escaping.  */
+    char encbuf[8];      /* Encoded bytes not yet written.  */
+    size_t encpos;       /* # of already written bytes from ENCBUF.  */
+    size_t enclen;       /* Length of the data in ENCBUF.  */
+    char *spoolbuf;      /* Malloced block buffer or NULL.  */
+    size_t spoolleft;    /* # of bytes not yet read from DATA.  */
+    size_t spoolenclen;  /* Length of the encoded content of DATA.  */
   } pending_data;
 
 };
@@ -133,11 +178,37 @@ cjson_t gpg_error_object (cjson_t json, gpg_error_t err,
                           const char *message, ...);
 char *error_object_string (const char *message, ...);
 
+size_t json_escape_len (unsigned char c);
+size_t json_escape (unsigned char c, char *buffer);
+
+void json_writer_release (json_writer_t w);
+void json_writer_clear (json_writer_t w);
+void json_writer_begin_object (json_writer_t w, const char *name);
+void json_writer_end_object (json_writer_t w);
+void json_writer_begin_array (json_writer_t w, const char *name);
+void json_writer_end_array (json_writer_t w);
+void json_writer_bool (json_writer_t w, const char *name, int abool);
+void json_writer_string0 (json_writer_t w, const char *name,
+                          const char *string);
+void json_writer_number (json_writer_t w, const char *name, double dbl);
+
+
+/*-- json-b64.c --*/
+
+/* The length of the Base64 encoding of N bytes.  */
+#define json_b64_encoded_len(n) (((n) + 2) / 3 * 4)
+
+size_t json_b64_encode (char *out, const void *buffer, size_t length);
+gpg_error_t json_b64_decode (void *out, const char *string, size_t length,
+                             size_t *r_nbytes);
+
 
 /*-- json-core.c --*/
 
 
 char *json_core_process_request (ctrl_t ctrl, const char *request);
+char *json_core_process_json (ctrl_t ctrl, cjson_t json);
+void json_core_release_pending (ctrl_t ctrl);
 
 
 
@@ -19,6 +19,9 @@
  */
 
 #include <config.h>
+#ifdef HAVE_W32_SYSTEM
+# define _CRT_RAND_S  /* For rand_s.  */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -40,6 +43,10 @@
 #define DEF_REPLY_CHUNK_SIZE  0
 #define MAX_REPLY_CHUNK_SIZE (10 * 1024 * 1024)
 
+/* Spooled data is read in blocks of this size.  It is a multiple of
+ * 3 so that only the last block needs Base64 padding.  */
+#define SPOOL_BLOCKSIZE (3 * 16384)
+
 
 
 /*
@@ -54,66 +61,31 @@ static gpg_error_t
 add_base64_to_object (cjson_t object, const char *name,
                       const void *data, size_t datalen)
 {
-  gpg_err_code_t err;
-  estream_t fp = NULL;
-  gpgrt_b64state_t state = NULL;
-  cjson_t j_str = NULL;
-  void *buffer = NULL;
-
-  fp = es_fopenmem (0, "rwb");
-  if (!fp)
-    {
-      err = gpg_err_code_from_syserror ();
-      goto leave;
-    }
-  state = gpgrt_b64enc_start (fp, "");
-  if (!state)
-    {
-      err = gpg_err_code_from_syserror ();
-      goto leave;
-    }
-
-  err = gpgrt_b64enc_write (state, data, datalen);
-  if (err)
-    goto leave;
-
-  err = gpgrt_b64enc_finish (state);
-  state = NULL;
-  if (err)
-    return err;
+  gpg_error_t err;
+  cjson_t j_str;
+  char *buffer;
 
-  es_fputc (0, fp);
-  if (es_fclose_snatch (fp, &buffer, NULL))
-    {
-      fp = NULL;
-      err = gpg_error_from_syserror ();
-      goto leave;
-    }
-  fp = NULL;
+  buffer = xtrymalloc (json_b64_encoded_len (datalen) + 1);
+  if (!buffer)
+    return gpg_error_from_syserror ();
+  buffer[json_b64_encode (buffer, data, datalen)] = 0;
 
   j_str = cJSON_CreateStringConvey (buffer);
   if (!j_str)
     {
       err = gpg_error_from_syserror ();
-      goto leave;
+      xfree (buffer);
+      return err;
     }
-  buffer = NULL;
 
   if (!cJSON_AddItemToObject (object, name, j_str))
     {
       err = gpg_error_from_syserror ();
       cJSON_Delete (j_str);
-      j_str = NULL;
-      goto leave;
+      return err;
     }
-  j_str = NULL;
 
- leave:
-  xfree (buffer);
-  cJSON_Delete (j_str);
-  gpgrt_b64enc_finish (state);
-  es_fclose (fp);
-  return err;
+  return 0;
 }
 
 
@@ -283,43 +255,73 @@ _create_new_context (gpgme_protocol_t proto)
 }
 
 
-/* Return a context object for protocol PROTO.  This is currently a
- * statically allocated context initialized for PROTO.  Terminates
- * process on failure.  */
-static gpgme_ctx_t
-get_context (gpgme_protocol_t proto)
+/* The contexts not in use for each protocol.  Requests may be
+ * processed concurrently; thus each request takes its own contexts
+ * from the pool.  */
+#define CTX_POOL_SIZE 8
+static struct
 {
-  static gpgme_ctx_t ctx_openpgp, ctx_cms, ctx_conf;
+  gpgme_ctx_t ctx[CTX_POOL_SIZE];
+  int count;
+} ctx_pool[3];
+GPGRT_LOCK_DEFINE (ctx_pool_lock);
+
 
+/* Return the index into CTX_POOL for PROTO.  */
+static int
+ctx_pool_index (gpgme_protocol_t proto)
+{
   if (proto == GPGME_PROTOCOL_OpenPGP)
-    {
-      if (!ctx_openpgp)
-        ctx_openpgp = _create_new_context (proto);
-      return ctx_openpgp;
-    }
+    return 0;
   else if (proto == GPGME_PROTOCOL_CMS)
-    {
-      if (!ctx_cms)
-        ctx_cms = _create_new_context (proto);
-      return ctx_cms;
-    }
+    return 1;
   else if (proto == GPGME_PROTOCOL_GPGCONF)
-    {
-      if (!ctx_conf)
-        ctx_conf = _create_new_context (proto);
-      return ctx_conf;
-    }
+    return 2;
   else
     log_bug ("invalid protocol %d requested\n", proto);
 }
 
 
-/* Free context object retrieved by get_context.  */
+/* Return a context object for protocol PROTO.  The context is taken
+ * from the pool or created and initialized for PROTO.  Terminates
+ * process on failure.  */
+static gpgme_ctx_t
+get_context (gpgme_protocol_t proto)
+{
+  int idx = ctx_pool_index (proto);
+  gpgme_ctx_t ctx = NULL;
+
+  gpgrt_lock_lock (&ctx_pool_lock);
+  if (ctx_pool[idx].count)
+    ctx = ctx_pool[idx].ctx[--ctx_pool[idx].count];
+  gpgrt_lock_unlock (&ctx_pool_lock);
+
+  if (!ctx)
+    ctx = _create_new_context (proto);
+  return ctx;
+}
+
+
+/* Free context object retrieved by get_context.  It is put back
+ * into the pool.  */
 static void
 release_context (gpgme_ctx_t ctx)
 {
-  /* Nothing to do right now.  */
-  (void)ctx;
+  int idx;
+
+  if (!ctx)
+    return;
+
+  idx = ctx_pool_index (gpgme_get_protocol (ctx));
+  gpgrt_lock_lock (&ctx_pool_lock);
+  if (ctx_pool[idx].count < CTX_POOL_SIZE)
+    {
+      ctx_pool[idx].ctx[ctx_pool[idx].count++] = ctx;
+      ctx = NULL;
+    }
+  gpgrt_lock_unlock (&ctx_pool_lock);
+
+  gpgme_release (ctx);
 }
 
 
@@ -342,15 +344,14 @@ release_onetime_context (gpgme_ctx_t ctx)
 
 
 /* Given a Base-64 encoded string object in JSON return a gpgme data
- * object at R_DATA.  */
+ * object at R_DATA.  The data is decoded while it is read and the
+ * storage is held in JSON.  */
 static gpg_error_t
 data_from_base64_string (gpgme_data_t *r_data, cjson_t json)
 {
   gpg_error_t err;
-  size_t len;
-  char *buf = NULL;
-  gpgrt_b64state_t state = NULL;
   gpgme_data_t data = NULL;
+  size_t length;
 
   *r_data = NULL;
 
@@ -361,42 +362,42 @@ data_from_base64_string (gpgme_data_t *r_data, cjson_t json)
       goto leave;
     }
 
-  state = gpgrt_b64dec_start (NULL);
-  if (!state)
+  if ((json->type & cJSON_IsReference))
     {
-      err = gpg_err_code_from_syserror ();
-      goto leave;
-    }
+      /* The string is part of a spooled request and decoded only
+       * while it is read; see cJSON_ParseInPlace.  */
+      gpgme_data_t inner;
 
-  /* Fixme: Data duplication - we should see how to snatch the memory
-   * from the json object.  */
-  len = strlen (json->valuestring);
-  buf = xtrystrdup (json->valuestring);
-  if (!buf)
-    {
-      err = gpg_error_from_syserror ();
-      goto leave;
+      err = gpgme_data_new_from_mem (&inner, json->valuestring,
+                                     strlen (json->valuestring), 0);
+      if (err)
+        goto leave;
+      err = gpgme_data_new_base64 (&data, inner, NULL,
+                                   GPGME_DATA_BASE64_OWN);
+      if (err)
+        {
+          gpgme_data_release (inner);
+          goto leave;
+        }
+      *r_data = data;
+      return 0;
     }
 
-  err = gpgrt_b64dec_proc (state, buf, len, &len);
-  if (err)
-    goto leave;
-
-  err = gpgrt_b64dec_finish (state);
-  state = NULL;
+  /* The string is decoded in place; it is not used again and lives
+   * as long as the request.  */
+  err = json_b64_decode (json->valuestring, json->valuestring,
+                         strlen (json->valuestring), &length);
   if (err)
     goto leave;
 
-  err = gpgme_data_new_from_mem (&data, buf, len, 1);
+  err = gpgme_data_new_from_mem (&data, json->valuestring, length, 0);
   if (err)
     goto leave;
   *r_data = data;
   data = NULL;
 
  leave:
-  xfree (data);
-  xfree (buf);
-  gpgrt_b64dec_finish (state);
+  gpgme_data_release (data);
   return err;
 }
 
@@ -832,6 +833,230 @@ key_to_json (gpgme_key_t key)
 }
 
 
+/* The functions below write the same objects as the functions
+ * above directly as JSON text.  They are used to list many keys
+ * without building a cJSON tree; the cJSON versions are the
+ * reference for the tests.  */
+
+static void
+sig_notation_to_writer (json_writer_t w, gpgme_sig_notation_t not)
+{
+  json_writer_begin_object (w, NULL);
+  json_writer_bool (w, "human_readable", not->human_readable);
+  json_writer_bool (w, "critical", not->critical);
+
+  json_writer_string0 (w, "name", not->name);
+  json_writer_string0 (w, "value", not->value);
+
+  json_writer_number (w, "flags", not->flags);
+  json_writer_end_object (w);
+}
+
+
+static void
+key_sig_to_writer (json_writer_t w, gpgme_key_sig_t sig)
+{
+  gpgme_sig_notation_t not;
+
+  json_writer_begin_object (w, NULL);
+  json_writer_bool (w, "revoked", sig->revoked);
+  json_writer_bool (w, "expired", sig->expired);
+  json_writer_bool (w, "invalid", sig->invalid);
+  json_writer_bool (w, "exportable", sig->exportable);
+
+  json_writer_string0 (w, "pubkey_algo_name",
+                       gpgme_pubkey_algo_name (sig->pubkey_algo));
+  json_writer_string0 (w, "keyid", sig->keyid);
+  json_writer_string0 (w, "status", gpgme_strerror (sig->status));
+  json_writer_string0 (w, "name", sig->name);
+  json_writer_string0 (w, "email", sig->email);
+  json_writer_string0 (w, "comment", sig->comment);
+
+  json_writer_number (w, "pubkey_algo", sig->pubkey_algo);
+  json_writer_number (w, "timestamp", sig->timestamp);
+  json_writer_number (w, "expires", sig->expires);
+  json_writer_number (w, "status_code", sig->status);
+  json_writer_number (w, "sig_class", sig->sig_class);
+
+  if (sig->notations)
+    {
+      json_writer_begin_array (w, "notations");
+      for (not = sig->notations; not; not = not->next)
+        sig_notation_to_writer (w, not);
+      json_writer_end_array (w);
+    }
+  json_writer_end_object (w);
+}
+
+
+static void
+tofu_to_writer (json_writer_t w, gpgme_tofu_info_t tofu)
+{
+  json_writer_begin_object (w, NULL);
+  json_writer_string0 (w, "description", tofu->description);
+
+  json_writer_number (w, "validity", tofu->validity);
+  json_writer_number (w, "policy", tofu->policy);
+  json_writer_number (w, "signcount", tofu->signcount);
+  json_writer_number (w, "encrcount", tofu->encrcount);
+  json_writer_number (w, "signfirst", tofu->signfirst);
+  json_writer_number (w, "signlast", tofu->signlast);
+  json_writer_number (w, "encrfirst", tofu->encrfirst);
+  json_writer_number (w, "encrlast", tofu->encrlast);
+  json_writer_end_object (w);
+}
+
+
+static void
+uid_to_writer (json_writer_t w, gpgme_user_id_t uid)
+{
+  gpgme_key_sig_t sig;
+  gpgme_tofu_info_t tofu;
+
+  json_writer_begin_object (w, NULL);
+  json_writer_bool (w, "revoked", uid->revoked);
+  json_writer_bool (w, "invalid", uid->invalid);
+
+  json_writer_string0 (w, "validity", validity_to_string (uid->validity));
+  json_writer_string0 (w, "uid", uid->uid);
+  json_writer_string0 (w, "name", uid->name);
+  json_writer_string0 (w, "email", uid->email);
+  json_writer_string0 (w, "comment", uid->comment);
+  json_writer_string0 (w, "address", uid->address);
+
+  json_writer_number (w, "origin", uid->origin);
+  json_writer_number (w, "last_update", uid->last_update);
+
+  if (uid->signatures)
+    {
+      json_writer_begin_array (w, "signatures");
+      for (sig = uid->signatures; sig; sig = sig->next)
+        key_sig_to_writer (w, sig);
+      json_writer_end_array (w);
+    }
+
+  if (uid->tofu)
+    {
+      json_writer_begin_array (w, "tofu");
+      for (tofu = uid->tofu; tofu; tofu = tofu->next)
+        tofu_to_writer (w, tofu);
+      json_writer_end_array (w);
+    }
+  json_writer_end_object (w);
+}
+
+
+static void
+subkey_to_writer (json_writer_t w, gpgme_subkey_t sub)
+{
+  char *tmp;
+
+  json_writer_begin_object (w, NULL);
+  json_writer_bool (w, "revoked", sub->revoked);
+  json_writer_bool (w, "expired", sub->expired);
+  json_writer_bool (w, "disabled", sub->disabled);
+  json_writer_bool (w, "invalid", sub->invalid);
+  json_writer_bool (w, "can_encrypt", sub->can_encrypt);
+  json_writer_bool (w, "can_sign", sub->can_sign);
+  json_writer_bool (w, "can_certify", sub->can_certify);
+  json_writer_bool (w, "can_authenticate", sub->can_authenticate);
+  json_writer_bool (w, "secret", sub->secret);
+  json_writer_bool (w, "is_qualified", sub->is_qualified);
+  json_writer_bool (w, "is_cardkey", sub->is_cardkey);
+  json_writer_bool (w, "is_de_vs", sub->is_de_vs);
+  json_writer_string0 (w, "pubkey_algo_name",
+                       gpgme_pubkey_algo_name (sub->pubkey_algo));
+
+  tmp = gpgme_pubkey_algo_string (sub);
+  json_writer_string0 (w, "pubkey_algo_string", tmp);
+  gpgme_free (tmp);
+
+  json_writer_string0 (w, "keyid", sub->keyid);
+  json_writer_string0 (w, "card_number", sub->card_number);
+  json_writer_string0 (w, "curve", sub->curve);
+  json_writer_string0 (w, "keygrip", sub->keygrip);
+
+  json_writer_number (w, "pubkey_algo", sub->pubkey_algo);
+  json_writer_number (w, "length", sub->length);
+  json_writer_number (w, "timestamp", sub->timestamp);
+  json_writer_number (w, "expires", sub->expires);
+  json_writer_end_object (w);
+}
+
+
+static void
+revocation_key_to_writer (json_writer_t w, gpgme_revocation_key_t revkey)
+{
+  json_writer_begin_object (w, NULL);
+  json_writer_bool (w, "sensitive", revkey->sensitive);
+
+  json_writer_string0 (w, "fingerprint", revkey->fpr);
+  json_writer_string0 (w, "pubkey_algo_name",
+                       gpgme_pubkey_algo_name (revkey->pubkey_algo));
+
+  json_writer_number (w, "pubkey_algo", revkey->pubkey_algo);
+  json_writer_number (w, "key_class", revkey->key_class);
+  json_writer_end_object (w);
+}
+
+
+static void
+key_to_writer (json_writer_t w, gpgme_key_t key)
+{
+  gpgme_subkey_t sub;
+  gpgme_user_id_t uid;
+  gpgme_revocation_key_t revkey;
+
+  json_writer_begin_object (w, NULL);
+  json_writer_bool (w, "revoked", key->revoked);
+  json_writer_bool (w, "expired", key->expired);
+  json_writer_bool (w, "disabled", key->disabled);
+  json_writer_bool (w, "invalid", key->invalid);
+  json_writer_bool (w, "can_encrypt", key->can_encrypt);
+  json_writer_bool (w, "can_sign", key->can_sign);
+  json_writer_bool (w, "can_certify", key->can_certify);
+  json_writer_bool (w, "can_authenticate", key->can_authenticate);
+  json_writer_bool (w, "secret", key->secret);
+  json_writer_bool (w, "is_qualified", key->is_qualified);
+
+  json_writer_string0 (w, "protocol", protocol_to_string (key->protocol));
+  json_writer_string0 (w, "issuer_serial", key->issuer_serial);
+  json_writer_string0 (w, "issuer_name", key->issuer_name);
+  json_writer_string0 (w, "fingerprint", key->fpr);
+  json_writer_string0 (w, "chain_id", key->chain_id);
+  json_writer_string0 (w, "owner_trust",
+                       validity_to_string (key->owner_trust));
+
+  json_writer_number (w, "origin", key->origin);
+  json_writer_number (w, "last_update", key->last_update);
+
+  if (key->subkeys)
+    {
+      json_writer_begin_array (w, "subkeys");
+      for (sub = key->subkeys; sub; sub = sub->next)
+        subkey_to_writer (w, sub);
+      json_writer_end_array (w);
+    }
+
+  if (key->uids)
+    {
+      json_writer_begin_array (w, "userids");
+      for (uid = key->uids; uid; uid = uid->next)
+        uid_to_writer (w, uid);
+      json_writer_end_array (w);
+    }
+
+  if (key->revocation_keys)
+    {
+      json_writer_begin_array (w, "revocation_keys");
+      for (revkey = key->revocation_keys; revkey; revkey = revkey->next)
+        revocation_key_to_writer (w, revkey);
+      json_writer_end_array (w);
+    }
+  json_writer_end_object (w);
+}
+
+
 /* Create a signature json object */
 static cjson_t
 signature_to_json (gpgme_signature_t sig)
@@ -1181,49 +1406,412 @@ get_string_data (cjson_t request, cjson_t result, const char *name,
 }
 
 
+/* The callbacks of data objects backed by an unlinked temporary
+ * file.  */
+static gpgme_ssize_t
+spool_read (void *handle, void *buffer, size_t size)
+{
+  size_t n;
+
+  if (es_read (handle, buffer, size, &n))
+    return -1;
+  return n;
+}
+
+static gpgme_ssize_t
+spool_write (void *handle, const void *buffer, size_t size)
+{
+  size_t n;
+
+  if (es_write (handle, buffer, size, &n))
+    return -1;
+  return n;
+}
+
+static gpgme_off_t
+spool_seek (void *handle, gpgme_off_t offset, int whence)
+{
+  if (es_fseeko (handle, offset, whence))
+    return -1;
+  return es_ftello (handle);
+}
+
+static void
+spool_release (void *handle)
+{
+  es_fclose (handle);
+}
+
+
+/* Create a data object at R_DATA which keeps its content in a
+ * temporary file.  */
+static gpg_error_t
+spool_data_new (gpgme_data_t *r_data)
+{
+  static struct gpgme_data_cbs spool_cbs =
+    {
+      spool_read,
+      spool_write,
+      spool_seek,
+      spool_release
+    };
+  gpg_error_t err;
+  estream_t fp;
+
+  *r_data = NULL;
+  fp = es_tmpfile ();
+  if (!fp)
+    return gpg_error_from_syserror ();
+  err = gpgme_data_new_from_cbs (r_data, &spool_cbs, fp);
+  if (err)
+    es_fclose (fp);
+  return err;
+}
+
+
+/* Create the output data object for an operation on the "data" of
+ * REQUEST.  The output of a spooled request is spooled as well.  */
+static gpg_error_t
+new_output_data (cjson_t request, gpgme_data_t *r_output)
+{
+  cjson_t j_data;
+
+  j_data = cJSON_GetObjectItem (request, "data");
+  if (j_data && (j_data->type & cJSON_IsReference))
+    return spool_data_new (r_output);
+  return gpgme_data_new (r_output);
+}
+
+
+static void release_keylist_stream (struct keylist_stream_s *ks);
+static gpg_error_t read_keylist_text (ctrl_t ctrl, size_t *r_len);
+
+/* Release the data pending for getmore.  */
+static void
+release_pending_data (ctrl_t ctrl)
+{
+  xfree (ctrl->pending_data.buffer);
+  gpgme_data_release (ctrl->pending_data.data);
+  release_keylist_stream (ctrl->pending_data.keylist);
+  xfree (ctrl->pending_data.spoolbuf);
+  memset (&ctrl->pending_data, 0, sizeof ctrl->pending_data);
+}
+
+
+/* Read the next block of the spooled pending data into the view and
+ * store its length at R_LEN.  */
+static gpg_error_t
+read_spooled_block (ctrl_t ctrl, size_t *r_len)
+{
+  gpg_error_t err;
+  size_t n = 0;
+  size_t want = ctrl->pending_data.spoolleft;
+  gpgme_ssize_t amt;
+
+  if (want > SPOOL_BLOCKSIZE)
+    want = SPOOL_BLOCKSIZE;
+  while (n < want)
+    {
+      amt = gpgme_data_read (ctrl->pending_data.data,
+                             ctrl->pending_data.spoolbuf + n, want - n);
+      if (amt <= 0)
+        {
+          /* The file is shorter than when its length was taken.  */
+          err = (amt? gpg_error_from_syserror ()
+                 /**/ : gpg_error (GPG_ERR_TRUNCATED));
+          log_error ("error reading spooled data: %s\n", gpg_strerror (err));
+          return err;
+        }
+      n += amt;
+    }
+
+  ctrl->pending_data.spoolleft -= n;
+  ctrl->pending_data.view = ctrl->pending_data.spoolbuf;
+  ctrl->pending_data.viewlen = n;
+  ctrl->pending_data.viewpos = 0;
+  *r_len = n;
+  return 0;
+}
+
+
+/* Encode the pending item into at most SIZE bytes at BUFFER and store
+ * the number of bytes stored at R_N; that is 0 at the end of the
+ * data.  */
+static gpg_error_t
+encode_pending_data (ctrl_t ctrl, char *buffer, size_t size, size_t *r_n)
+{
+  gpg_error_t err;
+  const unsigned char *s = (const unsigned char *)ctrl->pending_data.view;
+  size_t pos = ctrl->pending_data.viewpos;
+  size_t len = ctrl->pending_data.viewlen;
+  size_t n = 0;
+  size_t esclen;
+
+  while (n < size)
+    {
+      if (ctrl->pending_data.encpos < ctrl->pending_data.enclen)
+        {
+          buffer[n++] = (ctrl->pending_data.encbuf
+                         [ctrl->pending_data.encpos++]);
+          continue;
+        }
+      if (pos >= len)
+        {
+          if (ctrl->pending_data.keylist)
+            err = read_keylist_text (ctrl, &len);
+          else if (ctrl->pending_data.spoolleft)
+            err = read_spooled_block (ctrl, &len);
+          else
+            break;
+          if (err)
+            return err;
+          if (!len)
+            break;
+          s = (const unsigned char *)ctrl->pending_data.view;
+          pos = 0;
+        }
+
+      if (ctrl->pending_data.keylist)
+        {
+          esclen = len - pos < size - n? len - pos : size - n;
+          memcpy (buffer + n, s + pos, esclen);
+          pos += esclen;
+          n += esclen;
+        }
+      else if (ctrl->pending_data.base64)
+        {
+          /* Encode full groups directly.  */
+          esclen = (size - n) / 4 * 3;
+          if (esclen > (len - pos) / 3 * 3)
+            esclen = (len - pos) / 3 * 3;
+          n += json_b64_encode (buffer + n, s + pos, esclen);
+          pos += esclen;
+          if (n < size && pos < len)
+            {
+              esclen = len - pos < 3? len - pos : 3;
+              json_b64_encode (ctrl->pending_data.encbuf, s + pos, esclen);
+              pos += esclen;
+              ctrl->pending_data.encpos = 0;
+              ctrl->pending_data.enclen = 4;
+            }
+        }
+      else
+        {
+          for (; n < size && pos < len; pos++)
+            {
+              esclen = json_escape_len (s[pos]);
+              if (!esclen)
+                buffer[n++] = s[pos];
+              else if (size - n >= esclen)
+                n += json_escape (s[pos], buffer + n);
+              else
+                {
+                  json_escape (s[pos++], ctrl->pending_data.encbuf);
+                  ctrl->pending_data.encpos = 0;
+                  ctrl->pending_data.enclen = esclen;
+                  break;
+                }
+            }
+        }
+    }
+
+  ctrl->pending_data.viewpos = pos;
+  *r_n = n;
+  return 0;
+}
+
+
+/* Read at most SIZE bytes of the pending response into BUFFER and
+ * store the number of bytes read at R_N.  */
+static gpg_error_t
+read_pending_data (ctrl_t ctrl, char *buffer, size_t size, size_t *r_n)
+{
+  gpg_error_t err;
+  size_t n = 0;
+  size_t amt, end;
+
+  while (n < size && ctrl->pending_data.bufpos < ctrl->pending_data.buflen)
+    {
+      amt = 0;
+      if (ctrl->pending_data.name
+          && ctrl->pending_data.bufpos == ctrl->pending_data.split)
+        {
+          err = encode_pending_data (ctrl, buffer + n, size - n, &amt);
+          if (err)
+            return err;
+        }
+      if (!amt)
+        {
+          /* Copy from the buffer up to the insertion point or the
+           * end.  */
+          end = (ctrl->pending_data.name
+                 && ctrl->pending_data.bufpos < ctrl->pending_data.split
+                 ? ctrl->pending_data.split
+                 : ctrl->pending_data.buflen);
+          amt = end - ctrl->pending_data.bufpos;
+          if (amt > size - n)
+            amt = size - n;
+          memcpy (buffer + n,
+                  ctrl->pending_data.buffer + ctrl->pending_data.bufpos, amt);
+          ctrl->pending_data.bufpos += amt;
+        }
+      n += amt;
+      ctrl->pending_data.written += amt;
+    }
+
+  *r_n = n;
+  return 0;
+}
+
+
+static gpg_error_t make_data_object (ctrl_t ctrl, cjson_t result,
+                                     gpgme_data_t data, const char *type,
+                                     int base64);
+
+/* Helper for make_data_object to handle DATA which is not memory
+ * based.  If the data is streamed it is read from DATA only while the
+ * response is written; otherwise it is first copied to memory.  */
+static gpg_error_t
+make_spooled_data_object (ctrl_t ctrl, cjson_t result, gpgme_data_t data,
+                          const char *type, int base64)
+{
+  gpg_error_t err;
+  gpgme_data_t mem = NULL;
+  char *buffer;
+  const unsigned char *s;
+  gpgme_ssize_t amt;
+  size_t length = 0;
+  size_t strlength = 0;
+  size_t esclen = 0;
+  int binary = 0;
+  int nul_seen = 0;
+  size_t n;
+
+  buffer = xtrymalloc (SPOOL_BLOCKSIZE);
+  if (!buffer)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+  if (gpgme_data_seek (data, 0, SEEK_SET))
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+
+#ifdef HAVE_W32_SYSTEM
+  if (!ctrl->stream_data || !base64)
+#else
+  if (!ctrl->stream_data)
+#endif
+    {
+      err = gpgme_data_new (&mem);
+      if (err)
+        goto leave;
+      while ((amt = gpgme_data_read (data, buffer, SPOOL_BLOCKSIZE)) > 0)
+        if (gpgme_data_write (mem, buffer, amt) != amt)
+          break;
+      if (amt)
+        {
+          err = gpg_error_from_syserror ();
+          goto leave;
+        }
+      xfree (buffer);
+      gpgme_data_release (data);
+      return make_data_object (ctrl, result, mem, type, base64);
+    }
+
+  /* Get the lengths and check whether Base64 is needed; see
+   * make_data_object.  */
+  while ((amt = gpgme_data_read (data, buffer, SPOOL_BLOCKSIZE)) > 0)
+    {
+      for (s = (const unsigned char *)buffer, n = 0; n < (size_t)amt; s++, n++)
+        {
+          if (!*s || (*s & 0x80))
+            binary = 1;
+          if (!*s)
+            nul_seen = 1;
+          if (!nul_seen)
+            {
+              strlength++;
+              esclen += json_escape_len (*s)? json_escape_len (*s) : 1;
+            }
+        }
+      length += amt;
+    }
+  if (amt || gpgme_data_seek (data, 0, SEEK_SET))
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+  if (base64 == -1)
+    base64 = binary;
+
+  xjson_AddStringToObject (result, "type", type);
+  xjson_AddBoolToObject (result, "base64", base64);
+
+  release_pending_data (ctrl);
+  ctrl->pending_data.name = "data";
+  ctrl->pending_data.data = data;
+  ctrl->pending_data.spoolbuf = buffer;
+  ctrl->pending_data.view = buffer;
+  /* Like cJSON a string ends at the first Nul.  */
+  ctrl->pending_data.spoolleft = base64? length : strlength;
+  ctrl->pending_data.spoolenclen = (base64? json_b64_encoded_len (length)
+                                    /* */ : esclen);
+  ctrl->pending_data.base64 = base64;
+  return 0;
+
+ leave:
+  xfree (buffer);
+  gpgme_data_release (mem);
+  gpgme_data_release (data);
+  return err;
+}
+
+
 /* Create a "data" object and the "type" and "base64" flags
  * from DATA and append them to RESULT.  Ownership of DATA is
  * transferred to this function.  TYPE must be a fixed string.
  * If BASE64 is -1 the need for base64 encoding is determined
  * by the content of DATA, all other values are taken as true
- * or false. */
+ * or false.  If CTRL->STREAM_DATA is set the "data" object is not
+ * created but DATA is kept for encode_and_chunk.  */
 static gpg_error_t
-make_data_object (cjson_t result, gpgme_data_t data,
+make_data_object (ctrl_t ctrl, cjson_t result, gpgme_data_t data,
                   const char *type, int base64)
 {
   gpg_error_t err;
-  char *buffer;
-  const char *s;
+  const void *view;
+  const char *buffer, *s;
+  char *string = NULL;
+  cjson_t j_str;
   size_t buflen, n;
 #ifdef HAVE_W32_SYSTEM
   int armor_enabled = 0;
+  char *p;
 #endif
 
-  if (!base64 || base64 == -1) /* Make sure that we really have a string.  */
-    gpgme_data_write (data, "", 1);
-
-  buffer = gpgme_data_release_and_get_mem (data, &buflen);
-  data = NULL;
-  if (!buffer)
-    {
-      err = gpg_error_from_syserror ();
-      goto leave;
-    }
+  /* Look at the data in place; it is copied only once into the JSON
+   * object.  */
+  err = gpgme_data_peek_mem (data, &view, &buflen);
+  if (gpg_err_code (err) == GPG_ERR_NOT_SUPPORTED)
+    return make_spooled_data_object (ctrl, result, data, type, base64);
+  if (err)
+    goto leave;
+  buffer = view? view : "";
 
   if (base64 == -1)
     {
       base64 = 0;
-      if (!buflen)
-        log_fatal ("Appended Nul byte got lost\n");
       /* Figure out if there is any Nul octet in the buffer.  In that
        * case we need to Base-64 the buffer.  Due to problems with the
        * browser's Javascript we use Base-64 also in case an UTF-8
        * character is in the buffer.  This is because the chunking may
        * split an UTF-8 characters and JS can't handle this.  */
-      for (s=buffer, n=0; n < buflen -1; s++, n++)
+      for (s=buffer, n=0; n < buflen; s++, n++)
         if (!*s || (*s & 0x80))
           {
-            buflen--; /* Adjust for the extra nul byte.  */
             base64 = 1;
             break;
           }
@@ -1236,59 +1824,132 @@ make_data_object (cjson_t result, gpgme_data_t data,
   xjson_AddStringToObject (result, "type", type);
   xjson_AddBoolToObject (result, "base64", base64);
 
+#ifdef HAVE_W32_SYSTEM
+  if (ctrl->stream_data && !armor_enabled)
+#else
+  if (ctrl->stream_data)
+#endif
+    {
+      /* The data is encoded only while the response is written;
+       * see encode_and_chunk.  */
+      release_pending_data (ctrl);
+      ctrl->pending_data.name = "data";
+      ctrl->pending_data.data = data;
+      ctrl->pending_data.view = buffer;
+      /* Like cJSON a string ends at the first Nul.  */
+      s = base64? NULL : memchr (buffer, 0, buflen);
+      ctrl->pending_data.viewlen = s? (size_t)(s - buffer) : buflen;
+      ctrl->pending_data.base64 = base64;
+      return 0;
+    }
+
   if (base64)
-    err = add_base64_to_object (result, "data", buffer, buflen);
-  else
     {
+      err = add_base64_to_object (result, "data", buffer, buflen);
+      goto leave;
+    }
+
+  string = xtrymalloc (buflen + 1);
+  if (!string)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
 #ifdef HAVE_W32_SYSTEM
-      /*
-       * In armored output on Windows, newline is CRLF.  We need to
-       * convert CRLF into LF so that the JSON representation is
-       * always same.
-       */
-      if (armor_enabled)
-        {
-          char *p, *p_write;
-          const char *p_end = buffer + buflen;
+  /*
+   * In armored output on Windows, newline is CRLF.  We need to
+   * convert CRLF into LF so that the JSON representation is
+   * always same.
+   */
+  if (armor_enabled)
+    {
+      for (s = buffer, p = string, n = 0; n < buflen; s++, n++)
+        if (!(*s == '\r' && n + 1 < buflen && s[1] == '\n'))
+          *p++ = *s;
+      *p = 0;
+    }
+  else
+#endif
+    {
+      memcpy (string, buffer, buflen);
+      string[buflen] = 0;
+    }
 
-          p = p_write = buffer;
+  j_str = cJSON_CreateStringConvey (string);
+  if (!j_str)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+  string = NULL;
+  if (!cJSON_AddItemToObject (result, "data", j_str))
+    {
+      err = gpg_error_from_syserror ();
+      cJSON_Delete (j_str);
+    }
 
-          while (1)
-            {
-              char c0, c1;
+ leave:
+  xfree (string);
+  gpgme_data_release (data);
+  return err;
+}
 
-              c0 = *p++;
-              if (p >= p_end)
-                {
-                  *p_write++ = c0;
-                  break;
-                }
 
-              if (c0 != '\r')
-                {
-                  *p_write++ = c0;
-                  continue;
-                }
+/* Prepare the streamed response from the printed response at
+ * R_DATA and the pending item.  On success ownership of R_DATA is
+ * transferred to CTRL and NULL is stored at R_DATA.  */
+static gpg_error_t
+insert_pending_data (ctrl_t ctrl, char **r_data)
+{
+  const unsigned char *s = (const unsigned char *)ctrl->pending_data.view;
+  const char *name = ctrl->pending_data.name;
+  const char *quote = ctrl->pending_data.keylist? "" : "\"";
+  size_t viewlen = ctrl->pending_data.viewlen;
+  size_t len, enclen, n;
+  char *buffer, *p;
+
+  len = strlen (*r_data);
+  if (!len || (*r_data)[len-1] != '}')
+    return gpg_error (GPG_ERR_INTERNAL);
+  len--;
+  /* Skip the whitespace of a formatted response.  */
+  while (len && strchr (" \t\n", (*r_data)[len-1]))
+    len--;
+
+  if (ctrl->pending_data.spoolbuf)
+    enclen = ctrl->pending_data.spoolenclen;
+  else if (ctrl->pending_data.keylist)
+    enclen = 0;  /* Not known before all keys have been listed.  */
+  else if (ctrl->pending_data.base64)
+    enclen = json_b64_encoded_len (viewlen);
+  else
+    for (enclen = viewlen, n = 0; n < viewlen; n++)
+      if (json_escape_len (s[n]))
+        enclen += json_escape_len (s[n]) - 1;
 
-              c1 = *p++;
-              if (c1 == '\n')
-                *p_write++ = c1;
-              else
-                {
-                  *p_write++ = c0;
-                  *p_write++ = c1;
-                }
-              if (p >= p_end)
-                break;
-            }
-        }
-#endif
-      err = cjson_AddStringToObject (result, "data", buffer);
-    }
+  /* The name needs no escaping.  */
+  buffer = xtrymalloc (len + strlen (name) + 8);
+  if (!buffer)
+    return gpg_error_from_syserror ();
+  memcpy (buffer, *r_data, len);
+  p = stpcpy (buffer + len, (len && buffer[len-1] == '{')? "\"" : ",\"");
+  p = stpcpy (stpcpy (stpcpy (p, name), "\":"), quote);
+  ctrl->pending_data.split = p - buffer;
+  strcpy (stpcpy (p, quote), "}");
 
- leave:
-  gpgme_free (buffer);
-  return err;
+  xfree (*r_data);
+  *r_data = NULL;
+  xfree (ctrl->pending_data.buffer);
+  ctrl->pending_data.buffer = buffer;
+  ctrl->pending_data.buflen = ctrl->pending_data.split + strlen (quote) + 1;
+  ctrl->pending_data.length = (ctrl->pending_data.keylist? 0
+                               /* */ : ctrl->pending_data.buflen + enclen);
+  ctrl->pending_data.written = 0;
+  ctrl->pending_data.bufpos = 0;
+  ctrl->pending_data.viewpos = 0;
+  ctrl->pending_data.encpos = 0;
+  ctrl->pending_data.enclen = 0;
+  return 0;
 }
 
 
@@ -1317,7 +1978,9 @@ encode_and_chunk (ctrl_t ctrl, cjson_t request, cjson_t response)
   char *data;
   gpg_error_t err = 0;
   size_t chunksize = 0;
-  char *getmore_request = NULL;
+  size_t n, amt, size;
+  char *p;
+  cjson_t getmore_request, j_id;
 
   if (ctrl->interactive)
     data = cJSON_Print (response);
@@ -1341,27 +2004,67 @@ encode_and_chunk (ctrl_t ctrl, cjson_t request, cjson_t response)
       goto leave;
     }
 
-  if (!chunksize)
+  if (ctrl->pending_data.name)
+    {
+      /* Append the pending item to the printed response but encode
+       * its value only while the response is written.  */
+      err = insert_pending_data (ctrl, &data);
+      if (err)
+        goto leave;
+      if (!chunksize)
+        {
+          /* The length of a key listing is not known in advance.  */
+          size = (ctrl->pending_data.length? ctrl->pending_data.length + 1
+                  /**/ : ctrl->pending_data.buflen + 4096);
+          for (n = 0; ; size *= 2)
+            {
+              p = gpgrt_realloc (data, size);
+              if (!p)
+                {
+                  err = gpg_error_from_syserror ();
+                  goto leave;
+                }
+              data = p;
+              err = read_pending_data (ctrl, data + n, size - n - 1, &amt);
+              if (err)
+                goto leave;
+              n += amt;
+              if (ctrl->pending_data.bufpos >= ctrl->pending_data.buflen)
+                break;
+            }
+          data[n] = 0;
+          release_pending_data (ctrl);
+          goto leave;
+        }
+    }
+  else if (!chunksize)
     goto leave;
+  else
+    {
+      ctrl->pending_data.buffer = data;
+      /* Data should already be encoded so that it does not
+         contain 0.*/
+      ctrl->pending_data.buflen = strlen (data);
+      ctrl->pending_data.length = ctrl->pending_data.buflen;
+      ctrl->pending_data.written = 0;
+      ctrl->pending_data.bufpos = 0;
+    }
 
-  ctrl->pending_data.buffer = data;
-  /* Data should already be encoded so that it does not
-     contain 0.*/
-  ctrl->pending_data.length = strlen (data);
-  ctrl->pending_data.written = 0;
-
-  if (gpgrt_asprintf (&getmore_request,
-                  "{ \"op\":\"getmore\", \"chunksize\": %i }",
-                  (int) chunksize) == -1)
+  /* The first chunk is returned right away.  */
+  getmore_request = xjson_CreateObject ();
+  xjson_AddStringToObject (getmore_request, "op", "getmore");
+  xjson_AddNumberToObject (getmore_request, "chunksize", chunksize);
+  if ((j_id = cJSON_GetObjectItem (request, "id")))
     {
-      err = gpg_error_from_syserror ();
-      goto leave;
+      j_id = cJSON_Duplicate (j_id, 1);
+      if (!j_id)
+        xoutofcore ("cJSON_Duplicate");
+      xjson_AddItemToObject (getmore_request, "id", j_id);
     }
 
-  data = json_core_process_request (ctrl, getmore_request);
+  data = json_core_process_json (ctrl, getmore_request);
 
 leave:
-  xfree (getmore_request);
 
   if (!err && !data)
     {
@@ -1374,6 +2077,7 @@ leave:
                                           "Encode and chunk failed: %s",
                                           gpgme_strerror (err));
       xfree (data);
+      release_pending_data (ctrl);
       if (ctrl->interactive)
         data = cJSON_Print (err_obj);
       else
@@ -1541,7 +2245,7 @@ op_encrypt (ctrl_t ctrl, cjson_t request, cjson_t result)
     }
 
   /* Create an output data object.  */
-  err = gpgme_data_new (&output);
+  err = new_output_data (request, &output);
   if (err)
     {
       gpg_error_object (result, err, "Error creating output data object: %s",
@@ -1572,7 +2276,7 @@ op_encrypt (ctrl_t ctrl, cjson_t request, cjson_t result)
   input = NULL;
 
   /* We need to base64 if armoring has not been requested.  */
-  err = make_data_object (result, output,
+  err = make_data_object (ctrl, result, output,
                           "ciphertext", !gpgme_get_armor (ctx));
   output = NULL;
 
@@ -1695,7 +2399,7 @@ op_decrypt (ctrl_t ctrl, cjson_t request, cjson_t result)
       goto leave;
 
   /* Create an output data object.  */
-  err = gpgme_data_new (&output);
+  err = new_output_data (request, &output);
   if (err)
     {
       gpg_error_object (result, err,
@@ -1730,7 +2434,7 @@ op_decrypt (ctrl_t ctrl, cjson_t request, cjson_t result)
                              verify_result_to_json (verify_result));
     }
 
-  err = make_data_object (result, output, "plaintext", -1);
+  err = make_data_object (ctrl, result, output, "plaintext", -1);
   output = NULL;
 
   if (err)
@@ -1853,7 +2557,7 @@ op_sign (ctrl_t ctrl, cjson_t request, cjson_t result)
     goto leave;
 
   /* Create an output data object.  */
-  err = gpgme_data_new (&output);
+  err = new_output_data (request, &output);
   if (err)
     {
       gpg_error_object (result, err, "Error creating output data object: %s",
@@ -1874,7 +2578,7 @@ op_sign (ctrl_t ctrl, cjson_t request, cjson_t result)
   input = NULL;
 
   /* We need to base64 if armoring has not been requested.  */
-  err = make_data_object (result, output,
+  err = make_data_object (ctrl, result, output,
                           "signature", !gpgme_get_armor (ctx));
   output = NULL;
 
@@ -1980,7 +2684,7 @@ op_verify (ctrl_t ctrl, cjson_t request, cjson_t result)
   if (!signature)
     {
       /* Verify opaque or clearsigned we need an output data object.  */
-      err = gpgme_data_new (&output);
+      err = new_output_data (request, &output);
       if (err)
         {
           gpg_error_object (result, err,
@@ -2014,7 +2718,7 @@ op_verify (ctrl_t ctrl, cjson_t request, cjson_t result)
 
   if (output)
     {
-      err = make_data_object (result, output, "plaintext", -1);
+      err = make_data_object (ctrl, result, output, "plaintext", -1);
       output = NULL;
 
       if (err)
@@ -2083,6 +2787,256 @@ op_version (ctrl_t ctrl, cjson_t request, cjson_t result)
 
 
 
+/* Keylist operations which are continued by a later request.  */
+#define MAX_KEYLIST_CURSORS 8
+struct keylist_cursor_s
+{
+  struct keylist_cursor_s *next;
+  char token[31];    /* The random token identifying the cursor.  */
+  gpgme_ctx_t ctx;   /* The context with the keylist operation.  */
+  gpgme_key_t key;   /* The next key.  */
+};
+typedef struct keylist_cursor_s *keylist_cursor_t;
+
+/* The cursors; the most recently used first.  */
+static keylist_cursor_t keylist_cursors;
+GPGRT_LOCK_DEFINE (keylist_cursors_lock);
+
+
+static void
+release_keylist_cursor (keylist_cursor_t cursor)
+{
+  if (!cursor)
+    return;
+  gpgme_key_unref (cursor->key);
+  /* This also terminates the keylist operation.  */
+  gpgme_release (cursor->ctx);
+  xfree (cursor);
+}
+
+
+/* Remove the cursor TOKEN from the list and return it.  Returns NULL
+ * if there is no such cursor.  */
+static keylist_cursor_t
+take_keylist_cursor (const char *token)
+{
+  keylist_cursor_t cursor, *cp;
+
+  gpgrt_lock_lock (&keylist_cursors_lock);
+  for (cp = &keylist_cursors; (cursor = *cp); cp = &cursor->next)
+    if (!strcmp (cursor->token, token))
+      {
+        *cp = cursor->next;
+        break;
+      }
+  gpgrt_lock_unlock (&keylist_cursors_lock);
+  return cursor;
+}
+
+
+/* Fill BUFFER with LENGTH random bytes taken directly from the
+ * system so that no engine is needed.  */
+static gpg_error_t
+get_random_bytes (unsigned char *buffer, size_t length)
+{
+#ifdef HAVE_W32_SYSTEM
+  unsigned int r;
+  size_t n;
+
+  for (n = 0; n < length; n++)
+    {
+      if (rand_s (&r))
+        return gpg_error (GPG_ERR_GENERAL);
+      buffer[n] = r;
+    }
+  return 0;
+#else
+  gpg_error_t err = 0;
+  estream_t fp;
+  size_t n;
+
+  fp = es_fopen ("/dev/urandom", "rb");
+  if (!fp)
+    return gpg_error_from_syserror ();
+  if (es_read (fp, buffer, length, &n))
+    err = gpg_error_from_syserror ();
+  else if (n != length)
+    err = gpg_error (GPG_ERR_EOF);
+  es_fclose (fp);
+  return err;
+#endif
+}
+
+
+/* Keep the keylist operation of CTX with the already retrieved KEY
+ * for a later request and store the token for it at R_TOKEN, which
+ * must have room for 31 bytes.  CURSOR is the cursor used so far or
+ * NULL.  Ownership of all arguments is transferred to this
+ * function.  */
+static gpg_error_t
+store_keylist_cursor (keylist_cursor_t cursor, gpgme_ctx_t ctx,
+                      gpgme_key_t key, char *r_token)
+{
+  gpg_error_t err;
+  keylist_cursor_t old = NULL;
+  keylist_cursor_t *cp;
+  unsigned char rnd[15];
+  int n;
+
+  if (!cursor)
+    cursor = xcalloc (1, sizeof *cursor);
+  cursor->ctx = ctx;
+  cursor->key = key;
+  if (!*cursor->token)
+    {
+      /* The token is random so that a client can't guess the tokens
+       * of other clients.  */
+      err = get_random_bytes (rnd, sizeof rnd);
+      if (err)
+        {
+          release_keylist_cursor (cursor);
+          return err;
+        }
+      for (n = 0; n < sizeof rnd; n++)
+        snprintf (cursor->token + 2 * n, 3, "%02x", rnd[n]);
+    }
+  strcpy (r_token, cursor->token);
+
+  gpgrt_lock_lock (&keylist_cursors_lock);
+  cursor->next = keylist_cursors;
+  keylist_cursors = cursor;
+  /* Drop the least recently used cursor if there are too many.  */
+  for (n = 0, cp = &keylist_cursors; *cp; cp = &(*cp)->next)
+    if (++n > MAX_KEYLIST_CURSORS)
+      {
+        old = *cp;
+        *cp = NULL;
+        break;
+      }
+  gpgrt_lock_unlock (&keylist_cursors_lock);
+
+  release_keylist_cursor (old);
+  return 0;
+}
+
+
+/* The state of a key listing which is written only while the
+ * response is written; see read_keylist_text.  */
+struct keylist_stream_s
+{
+  gpgme_ctx_t ctx;   /* The context with the keylist operation.  */
+  gpgme_key_t key;   /* The next key or NULL.  */
+  keylist_cursor_t cursor;  /* The cursor used so far or NULL.  */
+  size_t limit;      /* The maximum number of keys or 0.  */
+  size_t count;      /* The number of keys written.  */
+  int done;          /* The end of the array has been written.  */
+  struct json_writer_s writer;  /* The text of the current key.  */
+};
+
+
+static void
+release_keylist_stream (struct keylist_stream_s *ks)
+{
+  if (!ks)
+    return;
+  gpgme_key_unref (ks->key);
+  /* An unfinished keylist operation is terminated by releasing the
+   * context.  */
+  if (ks->done)
+    release_context (ks->ctx);
+  else
+    gpgme_release (ks->ctx);
+  xfree (ks->cursor);
+  json_writer_release (&ks->writer);
+  xfree (ks);
+}
+
+
+/* Check that the text written for KEY at TEXT is the same as the
+ * text printed for the object from key_to_json.  */
+static gpg_error_t
+check_key_text (gpgme_key_t key, const char *text)
+{
+  gpg_error_t err = 0;
+  cjson_t json;
+  char *string;
+
+  json = key_to_json (key);
+  string = cJSON_PrintUnformatted (json);
+  cJSON_Delete (json);
+  if (!string)
+    return gpg_error_from_syserror ();
+  if (strcmp (text, string))
+    {
+      log_error ("text written for key %s differs from cJSON\n",
+                 key->fpr? key->fpr : "?");
+      err = gpg_error (GPG_ERR_BUG);
+    }
+  xfree (string);
+  return err;
+}
+
+
+/* Write the text of the next key of the pending key listing into the
+ * view and store its length at R_LEN.  After the last key the end of
+ * the array and the cursor, if any, are written; after that 0 is
+ * stored at R_LEN.  */
+static gpg_error_t
+read_keylist_text (ctrl_t ctrl, size_t *r_len)
+{
+  gpg_error_t err;
+  struct keylist_stream_s *ks = ctrl->pending_data.keylist;
+  json_writer_t w = &ks->writer;
+  char token[31];
+  size_t start;
+
+  json_writer_clear (w);
+  if (ks->done)
+    ;
+  else if ((!ks->limit || ks->count < ks->limit)
+           && (ks->key || !gpgme_op_keylist_next (ks->ctx, &ks->key)))
+    {
+      start = w->length + !!w->need_comma;
+      key_to_writer (w, ks->key);
+      if (ctrl->check_writer)
+        {
+          err = check_key_text (ks->key, w->buffer + start);
+          if (err)
+            return err;
+        }
+      gpgme_key_unref (ks->key);
+      ks->key = NULL;
+      ks->count++;
+    }
+  else
+    {
+      json_writer_end_array (w);
+      ks->done = 1;
+      /* If the limit has been reached and there are more keys, the
+       * listing is kept open for another request.  */
+      if (ks->limit && ks->count == ks->limit
+          && !gpgme_op_keylist_next (ks->ctx, &ks->key))
+        {
+          err = store_keylist_cursor (ks->cursor, ks->ctx, ks->key, token);
+          ks->cursor = NULL;
+          ks->ctx = NULL;
+          ks->key = NULL;
+          if (err)
+            log_error ("error creating keylist cursor: %s\n",
+                       gpg_strerror (err));
+          else
+            json_writer_string0 (w, "cursor", token);
+        }
+    }
+
+  ctrl->pending_data.view = w->buffer;
+  ctrl->pending_data.viewlen = w->length;
+  ctrl->pending_data.viewpos = 0;
+  *r_len = w->length;
+  return 0;
+}
+
+
 static const char hlp_keylist[] =
   "op:     \"keylist\"\n"
   "\n"
@@ -2105,7 +3059,15 @@ static const char hlp_keylist[] =
   "validate:      Add KEYLIST_MODE_VALIDATE.\n"
   "locate:        Add KEYLIST_MODE_LOCATE.\n"
   "\n"
+  "Optional parameters for paging:\n"
+  "limit:         Return at most this many keys.\n"
+  "cursor:        Continue the listing of an earlier response.  All\n"
+  "               other parameters except limit are ignored.\n"
+  "\n"
   "Response on success:\n"
+  "cursor: Only set if more keys are available.  The string to be\n"
+  "        used as \"cursor\" to get them.  The listing is kept open\n"
+  "        only for the 8 most recently used cursors.\n"
   "keys:   Array of keys.\n"
   "  Boolean values:\n"
   "   revoked\n"
@@ -2223,9 +3185,47 @@ op_keylist (ctrl_t ctrl, cjson_t request, cjson_t result)
   int secret_only = 0;
   gpgme_keylist_mode_t mode = 0;
   gpgme_key_t key = NULL;
-  cjson_t keyarray = xjson_CreateArray ();
+  cjson_t keyarray;
+  struct keylist_stream_s *ks;
+  keylist_cursor_t cursor = NULL;
+  char token[31];
+  cjson_t j_item;
+  size_t limit = 0;
+  size_t count;
 
-  (void)ctrl;
+  j_item = cJSON_GetObjectItem (request, "limit");
+  if (j_item)
+    {
+      if (!cjson_is_number (j_item) || j_item->valueint < 0)
+        {
+          err = gpg_error (GPG_ERR_INV_VALUE);
+          goto leave;
+        }
+      limit = j_item->valueint;
+    }
+
+  j_item = cJSON_GetObjectItem (request, "cursor");
+  if (j_item)
+    {
+      if (!cjson_is_string (j_item))
+        {
+          err = gpg_error (GPG_ERR_INV_VALUE);
+          goto leave;
+        }
+      cursor = take_keylist_cursor (j_item->valuestring);
+      if (!cursor)
+        {
+          err = gpg_error (GPG_ERR_NOT_FOUND);
+          gpg_error_object (result, err, "Unknown keylist cursor '%s'",
+                            j_item->valuestring);
+          goto leave;
+        }
+      ctx = cursor->ctx;
+      key = cursor->key;
+      cursor->ctx = NULL;
+      cursor->key = NULL;
+      goto list_keys;
+    }
 
   if ((err = get_protocol (request, &protocol)))
     goto leave;
@@ -2314,25 +3314,65 @@ op_keylist (ctrl_t ctrl, cjson_t request, cjson_t result)
       goto leave;
     }
 
-  while (!(err = gpgme_op_keylist_next (ctx, &key)))
+ list_keys:
+  /* With stream_data the keys are retrieved and written as text only
+   * while the response is written; see read_keylist_text.  */
+  if (ctrl->stream_data)
+    {
+      ks = xcalloc (1, sizeof *ks);
+      ks->ctx = ctx;
+      ks->key = key;
+      ks->cursor = cursor;
+      ks->limit = limit;
+      ctx = NULL;
+      key = NULL;
+      cursor = NULL;
+      json_writer_begin_array (&ks->writer, NULL);
+
+      release_pending_data (ctrl);
+      ctrl->pending_data.name = "keys";
+      ctrl->pending_data.keylist = ks;
+      ctrl->pending_data.view = ks->writer.buffer;
+      ctrl->pending_data.viewlen = ks->writer.length;
+      goto leave;
+    }
+
+  keyarray = xjson_CreateArray ();
+  for (count = 0; !limit || count < limit; count++)
     {
+      if (!key && gpgme_op_keylist_next (ctx, &key))
+        break;
       cJSON_AddItemToArray (keyarray, key_to_json (key));
       gpgme_key_unref (key);
+      key = NULL;
     }
-  err = 0;
+  xjson_AddItemToObject (result, "keys", keyarray);
 
-  if (!cJSON_AddItemToObject (result, "keys", keyarray))
+  /* If the limit has been reached and there are more keys, the
+   * listing is kept open for another request.  */
+  if (limit && count == limit && !gpgme_op_keylist_next (ctx, &key))
     {
-      err = gpg_error_from_syserror ();
-      goto leave;
+      /* If that fails the keys are still returned, only without a
+       * cursor.  */
+      err = store_keylist_cursor (cursor, ctx, key, token);
+      cursor = NULL;
+      ctx = NULL;
+      key = NULL;
+      if (err)
+        {
+          log_error ("error creating keylist cursor: %s\n",
+                     gpg_strerror (err));
+          err = 0;
+        }
+      else
+        xjson_AddStringToObject (result, "cursor", token);
     }
 
  leave:
   xfree_array (patterns);
-  if (err)
-    {
-      cJSON_Delete (keyarray);
-    }
+  gpgme_key_unref (key);
+  release_context (ctx);
+  xfree (cursor);
   return err;
 }
 
@@ -2500,7 +3540,7 @@ op_export (ctrl_t ctrl, cjson_t request, cjson_t result)
   patterns = create_keylist_patterns (request, "keys");
 
   /* Create an output data object.  */
-  err = gpgme_data_new (&output);
+  err = new_output_data (request, &output);
   if (err)
     {
       gpg_error_object (result, err, "Error creating output data object: %s",
@@ -2518,7 +3558,7 @@ op_export (ctrl_t ctrl, cjson_t request, cjson_t result)
     }
 
   /* We need to base64 if armoring has not been requested.  */
-  err = make_data_object (result, output,
+  err = make_data_object (ctrl, result, output,
                           "keys", !gpgme_get_armor (ctx));
   output = NULL;
 
@@ -2934,16 +3974,33 @@ static gpg_error_t
 op_getmore (ctrl_t ctrl, cjson_t request, cjson_t result)
 {
   gpg_error_t err;
-  int c;
+  cjson_t j_id;
+  char *chunk;
   size_t n;
   size_t chunksize;
+  int more;
 
   if ((err = get_chunksize (request, &chunksize)))
     goto leave;
 
   /* For the meta data we need 41 bytes:
-     {"more":true,"base64":true,"response":""} */
-  chunksize -= 41;
+     {"more":true,"base64":true,"response":""}
+     Note that the chunk is never empty.  */
+  chunksize = chunksize > 41 + 4? chunksize - 41 : 4;
+
+  /* And for the id of the request:  ,"id":ID  */
+  if ((j_id = cJSON_GetObjectItem (request, "id")))
+    {
+      chunk = cJSON_PrintUnformatted (j_id);
+      if (!chunk)
+        {
+          err = gpg_error_from_syserror ();
+          goto leave;
+        }
+      n = strlen (chunk) + 6;
+      xfree (chunk);
+      chunksize = chunksize > n + 4? chunksize - n : 4;
+    }
 
   /* Adjust the chunksize for the base64 conversion.  */
   chunksize = (chunksize / 4) * 3;
@@ -2957,44 +4014,50 @@ op_getmore (ctrl_t ctrl, cjson_t request, cjson_t result)
       goto leave;
     }
 
-  /* We currently always use base64 encoding for simplicity. */
-  xjson_AddBoolToObject (result, "base64", 1);
-
-  if (ctrl->pending_data.written >= ctrl->pending_data.length)
+  if (ctrl->pending_data.bufpos >= ctrl->pending_data.buflen)
     {
       /* EOF reached.  This should not happen but we return an empty
        * string once in case of client errors.  */
-      gpgme_free (ctrl->pending_data.buffer);
-      ctrl->pending_data.buffer = NULL;
+      release_pending_data (ctrl);
+      /* We currently always use base64 encoding for simplicity. */
+      xjson_AddBoolToObject (result, "base64", 1);
       xjson_AddBoolToObject (result, "more", 0);
       err = cjson_AddStringToObject (result, "response", "");
     }
   else
     {
-      n = ctrl->pending_data.length - ctrl->pending_data.written;
-      if (n > chunksize)
+      /* The length of a key listing is not known in advance.  */
+      n = chunksize;
+      if (ctrl->pending_data.length
+          && ctrl->pending_data.length - ctrl->pending_data.written < n)
+        n = ctrl->pending_data.length - ctrl->pending_data.written;
+
+      /* The chunk is produced only now; with a pending data object
+       * this is where its content gets encoded and with a key listing
+       * this is where the keys are retrieved.  */
+      chunk = xtrymalloc (n);
+      if (!chunk)
         {
-          n = chunksize;
-          xjson_AddBoolToObject (result, "more", 1);
+          err = gpg_error_from_syserror ();
+          goto leave;
         }
-      else
-        xjson_AddBoolToObject (result, "more", 0);
-
-      c = ctrl->pending_data.buffer[ctrl->pending_data.written + n];
-      ctrl->pending_data.buffer[ctrl->pending_data.written + n] = 0;
-      err = add_base64_to_object (result, "response",
-                                  (ctrl->pending_data.buffer
-                                   + ctrl->pending_data.written), n);
-      ctrl->pending_data.buffer[ctrl->pending_data.written + n] = c;
-      if (!err)
+      err = read_pending_data (ctrl, chunk, n, &n);
+      if (err)
         {
-          ctrl->pending_data.written += n;
-          if (ctrl->pending_data.written >= ctrl->pending_data.length)
-            {
-              xfree (ctrl->pending_data.buffer);
-              ctrl->pending_data.buffer = NULL;
-            }
+          /* The data can't be delivered anymore.  */
+          xfree (chunk);
+          release_pending_data (ctrl);
+          gpg_error_object (result, err, "Error reading pending data: %s",
+                            gpg_strerror (err));
+          goto leave;
         }
+      more = ctrl->pending_data.bufpos < ctrl->pending_data.buflen;
+      xjson_AddBoolToObject (result, "base64", 1);
+      xjson_AddBoolToObject (result, "more", more);
+      err = add_base64_to_object (result, "response", chunk, n);
+      xfree (chunk);
+      if (!err && !more)
+        release_pending_data (ctrl);
     }
 
  leave:
@@ -3032,7 +4095,15 @@ static const char hlp_help[] =
   "When \"chunksize\" is set the response (including json) will\n"
   "not be larger then \"chunksize\" but might be smaller.\n"
   "The chunked result will be transferred in base64 encoded chunks\n"
-  "using the \"getmore\" operation. See help getmore for more info.";
+  "using the \"getmore\" operation. See help getmore for more info.\n"
+  "\n"
+  "If the request has the property \"id\" with a string or number\n"
+  "value, the response has the same property.  Requests with an id\n"
+  "may be processed concurrently and their responses may be returned\n"
+  "in any order; a \"getmore\" needs the id of its request.  A request\n"
+  "without an id is processed only after all earlier requests.  While\n"
+  "too many requests with an id have data pending for \"getmore\", new\n"
+  "requests with an id fail with a busy error.";
 static gpg_error_t
 op_help (ctrl_t ctrl, cjson_t request, cjson_t result)
 {
@@ -3059,10 +4130,12 @@ op_help (ctrl_t ctrl, cjson_t request, cjson_t result)
  * Dispatcher
  */
 
-/* Process a request and return the response.  The response is a newly
- * allocated string or NULL in case of an error.  */
-char *
-json_core_process_request (ctrl_t ctrl, const char *request)
+/* Process a request and return the response.  The request is either
+ * given as string REQUEST or already parsed as JSON which is then
+ * released.  The response is a newly allocated string or NULL in
+ * case of an error.  */
+static char *
+process_request (ctrl_t ctrl, const char *request, cjson_t json)
 {
   static struct {
     const char *op;
@@ -3087,18 +4160,26 @@ json_core_process_request (ctrl_t ctrl, const char *request)
     { NULL }
   };
   size_t erroff;
-  cjson_t json;
   cjson_t j_tmp, j_op;
+  cjson_t j_id = NULL;
   cjson_t response;
+  cjson_arena_t arena = NULL;
   int helpmode;
   int is_getmore = 0;
   const char *op;
   char *res = NULL;
   int idx;
 
+  /* The items of the request and the response are allocated from an
+   * arena unless this is a nested call.  The response string is
+   * allocated from the heap.  */
+  if (!cJSON_GetArena () && (arena = cJSON_CreateArena ()))
+    cJSON_SetArena (arena);
+
   response = xjson_CreateObject ();
 
-  json = cJSON_Parse (request, &erroff);
+  if (!json)
+    json = cJSON_Parse (request, &erroff);
   if (!json)
     {
       log_string (GPGRT_LOGLVL_INFO, request);
@@ -3107,6 +4188,15 @@ json_core_process_request (ctrl_t ctrl, const char *request)
       goto leave;
     }
 
+  /* The id of a request is returned with its response.  */
+  j_id = cJSON_GetObjectItem (json, "id");
+  if (j_id && !cjson_is_string (j_id) && !cjson_is_number (j_id))
+    {
+      j_id = NULL;
+      error_object (response, "Property \"id\" must be a string or number");
+      goto leave;
+    }
+
   j_tmp = cJSON_GetObjectItem (json, "help");
   helpmode = (j_tmp && cjson_is_true (j_tmp));
 
@@ -3140,15 +4230,19 @@ json_core_process_request (ctrl_t ctrl, const char *request)
           is_getmore = optbl[idx].handler == op_getmore;
           /* If this is not the "getmore" command and we have any
            * pending data release that data.  */
-          if (ctrl->pending_data.buffer && optbl[idx].handler != op_getmore)
-            {
-              gpgme_free (ctrl->pending_data.buffer);
-              ctrl->pending_data.buffer = NULL;
-            }
+          if (!is_getmore)
+            release_pending_data (ctrl);
 
+          /* Large items of a response are encoded only while the
+           * response is written.  */
+          ctrl->stream_data = !is_getmore && !ctrl->interactive;
           err = optbl[idx].handler (ctrl, json, response);
+          ctrl->stream_data = 0;
           if (err)
             {
+              if (!is_getmore)
+                release_pending_data (ctrl);
+
               if (!(j_tmp = cJSON_GetObjectItem (response, "type"))
                   || !cjson_is_string (j_tmp)
                   || strcmp (j_tmp->valuestring, "error"))
@@ -3169,6 +4263,14 @@ json_core_process_request (ctrl_t ctrl, const char *request)
     }
 
  leave:
+  if (j_id)
+    {
+      j_tmp = cJSON_Duplicate (j_id, 1);
+      if (!j_tmp)
+        xoutofcore ("cJSON_Duplicate");
+      xjson_AddItemToObject (response, "id", j_tmp);
+    }
+
   if (is_getmore)
     {
       /* For getmore we bypass the encode_and_chunk. */
@@ -3195,6 +4297,7 @@ json_core_process_request (ctrl_t ctrl, const char *request)
 
   cJSON_Delete (json);
   cJSON_Delete (response);
+  cJSON_ReleaseArena (arena);
 
   if (!res)
     {
@@ -3203,3 +4306,30 @@ json_core_process_request (ctrl_t ctrl, const char *request)
     }
   return res;
 }
+
+
+/* Process the request REQUEST and return the response.  The
+ * response is a newly allocated string or NULL in case of an
+ * error.  */
+char *
+json_core_process_request (ctrl_t ctrl, const char *request)
+{
+  return process_request (ctrl, request, NULL);
+}
+
+
+/* Process the already parsed request JSON and return the response.
+ * JSON is released.  */
+char *
+json_core_process_json (ctrl_t ctrl, cjson_t json)
+{
+  return process_request (ctrl, NULL, json);
+}
+
+
+/* Release the data pending for getmore in CTRL.  */
+void
+json_core_release_pending (ctrl_t ctrl)
+{
+  release_pending_data (ctrl);
+}
@@ -24,6 +24,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <math.h>
+#include <float.h>
 #ifdef HAVE_LOCALE_H
 #include <locale.h>
 #endif
@@ -203,6 +205,217 @@ xjson_AddItemToObject (cjson_t object, const char *name, cjson_t item)
 }
 
 
+/* Return the length of the JSON string escape sequence for C or 0 if
+ * C needs no escaping.  The same escapes as in cJSON are used.  */
+size_t
+json_escape_len (unsigned char c)
+{
+  if (c == '"' || c == '\\' || c == '\b' || c == '\f' || c == '\n'
+      || c == '\r' || c == '\t')
+    return 2;
+  if (c < 0x20)
+    return 6;
+  return 0;
+}
+
+
+/* Store the JSON string escape sequence for C at BUFFER and return
+ * its length.  */
+size_t
+json_escape (unsigned char c, char *buffer)
+{
+  buffer[0] = '\\';
+  switch (c)
+    {
+    case '"':  buffer[1] = '"'; return 2;
+    case '\\': buffer[1] = '\\'; return 2;
+    case '\b': buffer[1] = 'b'; return 2;
+    case '\f': buffer[1] = 'f'; return 2;
+    case '\n': buffer[1] = 'n'; return 2;
+    case '\r': buffer[1] = 'r'; return 2;
+    case '\t': buffer[1] = 't'; return 2;
+    default:
+      buffer[1] = 'u';
+      buffer[2] = '0';
+      buffer[3] = '0';
+      buffer[4] = "0123456789abcdef"[c >> 4];
+      buffer[5] = "0123456789abcdef"[c & 15];
+      return 6;
+    }
+}
+
+/*
+ * A writer for JSON text.  It creates the same text as
+ * cJSON_PrintUnformatted but without building a tree first.  Like
+ * the xjson functions it terminates the process if it runs out of
+ * core.
+ */
+
+/* Append the LENGTH bytes at STRING to the writer W.  */
+static void
+jw_append (json_writer_t w, const char *string, size_t length)
+{
+  size_t newsize;
+  char *p;
+
+  if (w->length + length + 1 > w->size)
+    {
+      newsize = w->size? w->size : 4096;
+      while (newsize < w->length + length + 1)
+        newsize *= 2;
+      p = gpgrt_realloc (w->buffer, newsize);
+      if (!p)
+        xoutofcore ("json_writer");
+      w->buffer = p;
+      w->size = newsize;
+    }
+  memcpy (w->buffer + w->length, string, length);
+  w->length += length;
+  w->buffer[w->length] = 0;
+}
+
+
+/* Append a JSON string with the value STRING.  */
+static void
+jw_append_string (json_writer_t w, const char *string)
+{
+  const char *s;
+  char esc[6];
+
+  jw_append (w, "\"", 1);
+  for (s = string; *s; s++)
+    if (json_escape_len (*s))
+      {
+        if (s > string)
+          jw_append (w, string, s - string);
+        jw_append (w, esc, json_escape (*s, esc));
+        string = s + 1;
+      }
+  if (s > string)
+    jw_append (w, string, s - string);
+  jw_append (w, "\"", 1);
+}
+
+
+/* Start a new value named NAME; NAME is NULL for the values of an
+ * array.  */
+static void
+jw_begin_value (json_writer_t w, const char *name)
+{
+  if (w->need_comma)
+    jw_append (w, ",", 1);
+  w->need_comma = 1;
+  if (name)
+    {
+      jw_append_string (w, name);
+      jw_append (w, ":", 1);
+    }
+}
+
+
+/* Release the text of the writer W and reset it.  */
+void
+json_writer_release (json_writer_t w)
+{
+  xfree (w->buffer);
+  memset (w, 0, sizeof *w);
+}
+
+
+/* Discard the text of the writer W but keep its buffer and state;
+ * thus the values following are written as if the text was still
+ * there.  */
+void
+json_writer_clear (json_writer_t w)
+{
+  w->length = 0;
+  if (w->buffer)
+    *w->buffer = 0;
+}
+
+
+/* Start an object named NAME.  */
+void
+json_writer_begin_object (json_writer_t w, const char *name)
+{
+  jw_begin_value (w, name);
+  jw_append (w, "{", 1);
+  w->need_comma = 0;
+}
+
+
+void
+json_writer_end_object (json_writer_t w)
+{
+  jw_append (w, "}", 1);
+  w->need_comma = 1;
+}
+
+
+/* Start an array named NAME.  */
+void
+json_writer_begin_array (json_writer_t w, const char *name)
+{
+  jw_begin_value (w, name);
+  jw_append (w, "[", 1);
+  w->need_comma = 0;
+}
+
+
+void
+json_writer_end_array (json_writer_t w)
+{
+  jw_append (w, "]", 1);
+  w->need_comma = 1;
+}
+
+
+void
+json_writer_bool (json_writer_t w, const char *name, int abool)
+{
+  jw_begin_value (w, name);
+  if (abool)
+    jw_append (w, "true", 4);
+  else
+    jw_append (w, "false", 5);
+}
+
+
+/* Add the string STRING named NAME.  Nothing is added if STRING is
+ * NULL; this is the same as xjson_AddStringToObject0.  */
+void
+json_writer_string0 (json_writer_t w, const char *name, const char *string)
+{
+  if (!string)
+    return;
+  jw_begin_value (w, name);
+  jw_append_string (w, string);
+}
+
+
+/* Add the number DBL named NAME.  The formatting is the same as in
+ * cJSON.  */
+void
+json_writer_number (json_writer_t w, const char *name, double dbl)
+{
+  char buffer[64];
+  int i;
+
+  jw_begin_value (w, name);
+  if (isnan (dbl))
+    strcpy (buffer, "nan");
+  else if ((i = isinf (dbl)))
+    strcpy (buffer, i > 0? "inf" : ":-inf");
+  else if (fabs (floor (dbl) - dbl) <= DBL_EPSILON && fabs (dbl) < 1.0e60)
+    snprintf (buffer, sizeof buffer, "%.0f", dbl);
+  else if (fabs (dbl) < 1.0e-6 || fabs (dbl) > 1.0e9)
+    snprintf (buffer, sizeof buffer, "%e", dbl);
+  else
+    snprintf (buffer, sizeof buffer, "%f", dbl);
+  jw_append (w, buffer, strlen (buffer));
+}
+
+
 cjson_t
 error_object (cjson_t json, const char *message, ...)
 {
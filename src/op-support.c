@@ -33,6 +33,7 @@
 #include "ops.h"
 #include "util.h"
 #include "debug.h"
+#include "sys-util.h"
 
 
 
@@ -92,6 +93,9 @@ _gpgme_op_reset (gpgme_ctx_t ctx, int type)
   LOCK (ctx->lock);
   ctx->canceled = 0;
   ctx->redraw_suggested = 0;
+  ctx->deadline = 0;
+  if (ctx->deadline_ms)
+    ctx->deadline = _gpgme_monotonic_ms () + ctx->deadline_ms;
   UNLOCK (ctx->lock);
 
   if (ctx->engine && no_reset)
@@ -189,7 +193,10 @@ _gpgme_op_reset (gpgme_ctx_t ctx, int type)
     }
   else
     {
-      /* Use user event loop.  */
+      /* Use user event loop.  A deadline can't be enforced because we
+         do not control the timeouts of that loop.  */
+      if (ctx->deadline_ms)
+        return gpg_error (GPG_ERR_NOT_SUPPORTED);
       io_cbs.add = _gpgme_wait_user_add_io_cb;
       io_cbs.add_priv = ctx;
       io_cbs.remove = _gpgme_wait_user_remove_io_cb;
@@ -31,6 +31,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <signal.h>
+#include <time.h>
 #include <fcntl.h>
 #ifdef HAVE_UNISTD_H
 # include <unistd.h>
@@ -45,6 +46,9 @@
 #ifdef HAVE_SYS_UIO_H
 # include <sys/uio.h>
 #endif
+#ifdef HAVE_SYS_IOCTL_H
+# include <sys/ioctl.h>
+#endif
 #include <ctype.h>
 #include <sys/resource.h>
 
@@ -54,6 +58,10 @@
 # include <dirent.h>
 #endif /*USE_LINUX_GETDENTS*/
 
+#ifdef __linux__
+# include <sys/syscall.h>
+#endif
+
 #ifdef HAVE_POLL_H
 # include <poll.h>
 #else
@@ -64,6 +72,7 @@
 #include <sys/socket.h>
 
 #include "util.h"
+#include "sys-util.h"
 #include "priv-io.h"
 #include "sema.h"
 #include "debug.h"
@@ -233,6 +242,58 @@ _gpgme_io_write (int fd, const void *buffer, size_t count)
 }
 
 
+/* Write the IOVCNT buffers described by IOV to FD with one system
+   call.  Returns the number of bytes written like _gpgme_io_write.  */
+int
+_gpgme_io_writev (int fd, const struct io_iov_s *iov, int iovcnt)
+{
+#if defined(HAVE_SYS_UIO_H)
+  struct iovec vec[8];
+  int i, nwritten;
+  TRACE_BEG  (DEBUG_SYSIO, "_gpgme_io_writev", NULL,
+	      "fd=%d iovcnt=%d", fd, iovcnt);
+
+  if (iovcnt > DIM (vec))
+    iovcnt = DIM (vec);  /* A short write is allowed.  */
+  for (i = 0; i < iovcnt; i++)
+    {
+      vec[i].iov_base = (void *)iov[i].data;
+      vec[i].iov_len = iov[i].len;
+      TRACE_LOGBUFX (iov[i].data, iov[i].len);
+    }
+
+  do
+    {
+      nwritten = writev (fd, vec, iovcnt);
+    }
+  while (nwritten == -1 && errno == EINTR);
+
+  return TRACE_SYSRES (nwritten);
+#else
+  for (; iovcnt > 1 && !iov->len; iov++, iovcnt--)
+    ;
+  return _gpgme_io_write (fd, iovcnt? iov->data : NULL, iovcnt? iov->len : 0);
+#endif
+}
+
+
+/* Return the number of bytes which can be read from FD without
+   blocking or 0 if that is not known.  */
+int
+_gpgme_io_readable (int fd)
+{
+#ifdef FIONREAD
+  int n;
+
+  if (!ioctl (fd, FIONREAD, &n) && n > 0)
+    return n;
+#else
+  (void)fd;
+#endif
+  return 0;
+}
+
+
 int
 _gpgme_io_pipe (int filedes[2], int inherit_idx)
 {
@@ -539,6 +600,130 @@ _gpgme_io_waitpid (int pid, int hang, int *r_status, int *r_signal)
 }
 
 
+/* Like _gpgme_io_waitpid but also return the resource usage of the
+   process at R_STATS.  Returns 1 if the process has been reaped.  */
+int
+_gpgme_io_wait4 (int pid, int hang, struct io_child_stats_s *r_stats)
+{
+  int status;
+  pid_t ret;
+  struct rusage ru;
+
+  memset (r_stats, 0, sizeof *r_stats);
+  memset (&ru, 0, sizeof ru);
+  do
+#ifdef HAVE_WAIT4
+    ret = wait4 (pid, &status, hang? 0 : WNOHANG, &ru);
+#else
+    ret = waitpid (pid, &status, hang? 0 : WNOHANG);
+#endif
+  while (ret == (pid_t)(-1) && errno == EINTR);
+
+  if (ret != pid)
+    return 0;
+
+  if (WIFSIGNALED (status))
+    {
+      r_stats->status = -1;
+      r_stats->signo = WTERMSIG (status);
+    }
+  else if (WIFEXITED (status))
+    r_stats->status = WEXITSTATUS (status);
+  else
+    r_stats->status = -1;
+
+  r_stats->user_time = (ru.ru_utime.tv_sec * 1000
+                        + ru.ru_utime.tv_usec / 1000);
+  r_stats->sys_time = (ru.ru_stime.tv_sec * 1000
+                       + ru.ru_stime.tv_usec / 1000);
+  r_stats->max_rss = ru.ru_maxrss;
+  return 1;
+}
+
+
+/* Like _gpgme_io_wait4 but wait at most TIMEOUT milliseconds for the
+   process to terminate.  Returns 1 if the process has been reaped.  */
+int
+_gpgme_io_wait4_timeout (int pid, unsigned int timeout,
+                         struct io_child_stats_s *r_stats)
+{
+  unsigned long long end = _gpgme_monotonic_ms () + timeout;
+  struct timespec ts = { 0, 1000000 };
+
+  while (!_gpgme_io_wait4 (pid, 0, r_stats))
+    {
+      if (_gpgme_monotonic_ms () >= end)
+        return 0;
+      nanosleep (&ts, NULL);
+      /* Back off up to 32ms between the polls.  */
+      if (ts.tv_nsec < 32000000)
+        ts.tv_nsec *= 2;
+    }
+  return 1;
+}
+
+
+/* Reap the child process PID whose pipes have already been closed.
+   The process is given TIMEOUT milliseconds to terminate on its own,
+   then it is sent a SIGTERM and, if it is still alive after another
+   TIMEOUT milliseconds, a SIGKILL.  Thus a stuck process never blocks
+   the caller for long.  Returns 1 if the process has been reaped.  */
+int
+_gpgme_io_reap (int pid, unsigned int timeout,
+                struct io_child_stats_s *r_stats)
+{
+  if (_gpgme_io_wait4_timeout (pid, timeout, r_stats))
+    return 1;
+
+  TRACE (DEBUG_SYSIO, "_gpgme_io_reap", NULL,
+         "pid=%i did not terminate; sending SIGTERM", pid);
+  kill ((pid_t)pid, SIGTERM);
+  if (_gpgme_io_wait4_timeout (pid, timeout, r_stats))
+    return 1;
+
+  TRACE (DEBUG_SYSIO, "_gpgme_io_reap", NULL,
+         "pid=%i did not terminate; sending SIGKILL", pid);
+  kill ((pid_t)pid, SIGKILL);
+  return _gpgme_io_wait4 (pid, 1, r_stats);
+}
+
+
+/* Return a file descriptor which becomes readable when the child
+   process PID terminates.  Returns -1 if not supported.  */
+int
+_gpgme_io_pidfd_open (int pid)
+{
+#if defined(__linux__) && defined(SYS_pidfd_open)
+  int fd;
+
+  fd = syscall (SYS_pidfd_open, (pid_t)pid, 0);
+  if (fd != -1)
+    fcntl (fd, F_SETFD, FD_CLOEXEC);
+  TRACE (DEBUG_SYSIO, "_gpgme_io_pidfd_open", NULL,
+         "pid=%i -> fd=%d", pid, fd);
+  return fd;
+#else
+  (void)pid;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+
+/* Ask the child process PID to terminate.  The process must not yet
+   have been reaped.  Returns 0 on success, -1 on error.  */
+int
+_gpgme_io_kill (int pid)
+{
+  int res;
+
+  res = kill ((pid_t)pid, SIGTERM);
+  TRACE (DEBUG_SYSIO, "_gpgme_io_kill", NULL,
+         "pid=%i -> res=%d", pid, res);
+  return res;
+}
+
+
 /* Returns 0 on success, -1 on error.  */
 int
 _gpgme_io_spawn (const char *path, char *const argv[], unsigned int flags,
@@ -573,8 +758,9 @@ _gpgme_io_spawn (const char *path, char *const argv[], unsigned int flags,
 
   if (!pid)
     {
-      /* Intermediate child to prevent zombie processes.  */
-      if ((pid = fork ()) == 0)
+      /* Intermediate child to prevent zombie processes.  It is not
+         used if the caller reaps the process itself.  */
+      if ((flags & IOSPAWN_FLAG_NOREAP) || (pid = fork ()) == 0)
 	{
 	  /* Child.  */
           int max_fds = -1;
@@ -698,10 +884,13 @@ _gpgme_io_spawn (const char *path, char *const argv[], unsigned int flags,
 	_exit (0);
     }
 
-  TRACE_LOG  ("waiting for child process pid=%i", pid);
-  _gpgme_io_waitpid (pid, 1, &status, &signo);
-  if (status)
-    return TRACE_SYSRES (-1);
+  if (!(flags & IOSPAWN_FLAG_NOREAP))
+    {
+      TRACE_LOG  ("waiting for child process pid=%i", pid);
+      _gpgme_io_waitpid (pid, 1, &status, &signo);
+      if (status)
+        return TRACE_SYSRES (-1);
+    }
 
   for (i = 0; fd_list[i].fd != -1; i++)
     {
@@ -722,22 +911,16 @@ _gpgme_io_spawn (const char *path, char *const argv[], unsigned int flags,
    nothing to select, > 0 = number of signaled fds.  */
 #ifdef HAVE_POLL_H
 static int
-_gpgme_io_select_poll (struct io_select_fd_s *fds, size_t nfds, int nonblock)
+_gpgme_io_select_poll (struct io_select_fd_s *fds, size_t nfds, int timeout)
 {
   struct pollfd *poll_fds = NULL;
   nfds_t poll_nfds;
-  /* Use a 1s timeout.  */
-  int timeout = 1000;
   unsigned int i;
   int any;
   int count;
   void *dbg_help = NULL;
   TRACE_BEG  (DEBUG_SYSIO, "_gpgme_io_select", NULL,
-	      "nfds=%zu, nonblock=%u", nfds, nonblock);
-
-
-  if (nonblock)
-    timeout = 0;
+	      "nfds=%zu, timeout=%d", nfds, timeout);
 
   poll_fds = malloc (sizeof (*poll_fds)*nfds);
   if (!poll_fds)
@@ -833,7 +1016,8 @@ _gpgme_io_select_poll (struct io_select_fd_s *fds, size_t nfds, int nonblock)
 }
 #else
 static int
-_gpgme_io_select_select (struct io_select_fd_s *fds, size_t nfds, int nonblock)
+_gpgme_io_select_select (struct io_select_fd_s *fds, size_t nfds,
+                         int timeout_ms)
 {
   fd_set readfds;
   fd_set writefds;
@@ -842,17 +1026,16 @@ _gpgme_io_select_select (struct io_select_fd_s *fds, size_t nfds, int nonblock)
   int max_fd;
   int n;
   int count;
-  /* Use a 1s timeout.  */
-  struct timeval timeout = { 1, 0 };
+  struct timeval timeout;
   void *dbg_help = NULL;
   TRACE_BEG  (DEBUG_SYSIO, "_gpgme_io_select", NULL,
-	      "nfds=%zu, nonblock=%u", nfds, nonblock);
+	      "nfds=%zu, timeout=%d", nfds, timeout_ms);
 
   FD_ZERO (&readfds);
   FD_ZERO (&writefds);
   max_fd = 0;
-  if (nonblock)
-    timeout.tv_sec = 0;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_usec = (timeout_ms % 1000) * 1000;
 
   TRACE_SEQ (dbg_help, "selecting [ ");
 
@@ -944,15 +1127,26 @@ _gpgme_io_select_select (struct io_select_fd_s *fds, size_t nfds, int nonblock)
 }
 #endif
 
+/* Same as _gpgme_io_select but wait at most TIMEOUT milliseconds.  */
 int
-_gpgme_io_select (struct io_select_fd_s *fds, size_t nfds, int nonblock)
+_gpgme_io_select_timeout (struct io_select_fd_s *fds, size_t nfds,
+                          int timeout)
 {
+  if (timeout < 0)
+    timeout = 0;
 #ifdef HAVE_POLL_H
-  return _gpgme_io_select_poll (fds, nfds, nonblock);
+  return _gpgme_io_select_poll (fds, nfds, timeout);
 #else
-  return _gpgme_io_select_select (fds, nfds, nonblock);
+  return _gpgme_io_select_select (fds, nfds, timeout);
 #endif
 }
+
+int
+_gpgme_io_select (struct io_select_fd_s *fds, size_t nfds, int nonblock)
+{
+  /* Use a 1s timeout.  */
+  return _gpgme_io_select_timeout (fds, nfds, nonblock? 0 : 1000);
+}
 
 int
 _gpgme_io_recvmsg (int fd, struct msghdr *msg, int flags)
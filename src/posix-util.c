@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 
 #include "util.h"
 #include "sys-util.h"
@@ -203,3 +204,15 @@ _gpgme_access (const char *path, int mode)
 {
   return access (path, mode);
 }
+
+
+/* Return a monotonic timestamp in milliseconds.  */
+unsigned long long
+_gpgme_monotonic_ms (void)
+{
+  struct timespec ts;
+
+  if (clock_gettime (CLOCK_MONOTONIC, &ts))
+    return 0;
+  return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
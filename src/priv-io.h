@@ -64,12 +64,21 @@ struct io_select_fd_s
   void *opaque;
 };
 
+/* A buffer for _gpgme_io_writev.  */
+struct io_iov_s
+{
+  const void *data;
+  size_t len;
+};
+
 /* These function are either defined in posix-io.c or w32-io.c.  */
 void _gpgme_io_subsystem_init (void);
 int _gpgme_io_socket (int namespace, int style, int protocol);
 int _gpgme_io_connect (int fd, struct sockaddr *addr, int addrlen);
 int _gpgme_io_read (int fd, void *buffer, size_t count);
 int _gpgme_io_write (int fd, const void *buffer, size_t count);
+int _gpgme_io_writev (int fd, const struct io_iov_s *iov, int iovcnt);
+int _gpgme_io_readable (int fd);
 int _gpgme_io_pipe (int filedes[2], int inherit_idx);
 int _gpgme_io_close (int fd);
 typedef void (*_gpgme_close_notify_handler_t) (int,void*);
@@ -86,6 +95,9 @@ int _gpgme_io_set_nonblocking (int fd);
 #define IOSPAWN_FLAG_NOCLOSE 4
 /* Set show window to true for windows */
 #define IOSPAWN_FLAG_SHOW_WINDOW 8
+/* Do not use an intermediate child process.  The caller must reap
+   the process returned at R_PID.  Ignored under Windows.  */
+#define IOSPAWN_FLAG_NOREAP 16
 
 /* Spawn the executable PATH with ARGV as arguments.  After forking
    close all fds except for those in FD_LIST in the child, then
@@ -97,6 +109,8 @@ int _gpgme_io_spawn (const char *path, char *const argv[], unsigned int flags,
 		     void *atforkvalue, assuan_pid_t *r_pid);
 
 int _gpgme_io_select (struct io_select_fd_s *fds, size_t nfds, int nonblock);
+int _gpgme_io_select_timeout (struct io_select_fd_s *fds, size_t nfds,
+                              int timeout);
 
 /* Write the printable version of FD to the buffer BUF of length
    BUFLEN.  The printable version is the representation on the command
@@ -116,6 +130,23 @@ int _gpgme_io_dup (int fd);
 int _gpgme_io_recvmsg (int fd, struct msghdr *msg, int flags);
 int _gpgme_io_sendmsg (int fd, const struct msghdr *msg, int flags);
 int _gpgme_io_waitpid (int pid, int hang, int *r_status, int *r_signal);
+
+/* Exit status and resource usage of a reaped child process.  */
+struct io_child_stats_s
+{
+  int status;    /* The exit code or -1 if terminated by a signal.  */
+  int signo;     /* The terminating signal or 0.  */
+  unsigned long user_time;  /* User CPU time in milliseconds.  */
+  unsigned long sys_time;   /* System CPU time in milliseconds.  */
+  unsigned long max_rss;    /* Maximum resident set size in KiB.  */
+};
+int _gpgme_io_wait4 (int pid, int hang, struct io_child_stats_s *r_stats);
+int _gpgme_io_wait4_timeout (int pid, unsigned int timeout,
+                             struct io_child_stats_s *r_stats);
+int _gpgme_io_reap (int pid, unsigned int timeout,
+                    struct io_child_stats_s *r_stats);
+int _gpgme_io_pidfd_open (int pid);
+int _gpgme_io_kill (int pid);
 #endif
 
 #endif /* IO_H */
@@ -0,0 +1,201 @@
+/* secmem.c - A pool of locked memory for sensitive data.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GPGME.
+ *
+ * GPGME is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GPGME is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <https://gnu.org/licenses/>.
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
+#include "util.h"
+#include "sema.h"
+#include "debug.h"
+
+
+/* The pool is a single mapping which is locked into memory and
+ * excluded from core dumps.  It is carved into blocks whose sizes are
+ * powers of two from 64 bytes to 64 KiB; freed blocks are kept in a
+ * free list per size class.  Requests which do not fit into the pool
+ * are served by malloc; such memory is wiped as well when it is
+ * released by _gpgme_secmem_free.  */
+#define POOL_SIZE (1024 * 1024)
+#define MIN_CLASS 6
+#define MAX_CLASS 16
+
+/* The header in front of each block.  Its size keeps the blocks
+ * aligned.  */
+union block_head_u
+{
+  unsigned int cls;
+  void *next;         /* The next free block.  */
+  long double align;
+};
+typedef union block_head_u *block_head_t;
+
+static char *pool;
+static size_t pool_used;
+static int pool_initialized;
+static block_head_t free_list[MAX_CLASS + 1];
+DEFINE_STATIC_LOCK (pool_lock);
+
+
+/* Map the pool.  Must be called with POOL_LOCK held.  If that is not
+ * possible the pool stays unused.  */
+static void
+init_pool (void)
+{
+  pool_initialized = 1;
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+  {
+    void *p;
+
+    p = mmap (NULL, POOL_SIZE, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+      {
+        TRACE (DEBUG_SYSIO, "_gpgme_secmem", NULL,
+               "mapping the pool failed: %s", strerror (errno));
+        return;
+      }
+# ifdef HAVE_MLOCK
+    if (mlock (p, POOL_SIZE))
+      TRACE (DEBUG_SYSIO, "_gpgme_secmem", NULL,
+             "locking the pool failed: %s", strerror (errno));
+# endif
+# if defined(HAVE_MADVISE) && defined(MADV_DONTDUMP)
+    madvise (p, POOL_SIZE, MADV_DONTDUMP);
+# endif
+    pool = p;
+  }
+#endif
+}
+
+
+/* Return true if P has been allocated from the pool.  */
+int
+_gpgme_secmem_owns (const void *p)
+{
+  const char *cp = p;
+
+  /* POOL is set only once; thus no lock is needed if it is already
+   * set.  */
+  return pool && cp >= pool && cp < pool + POOL_SIZE;
+}
+
+
+/* Allocate N bytes for sensitive data.  Returns NULL and sets ERRNO
+ * on error.  */
+void *
+_gpgme_secmem_malloc (size_t n)
+{
+  block_head_t b = NULL;
+  unsigned int cls;
+
+  for (cls = MIN_CLASS; cls <= MAX_CLASS; cls++)
+    if (n <= ((size_t)1 << cls) - sizeof *b)
+      break;
+
+  if (cls <= MAX_CLASS)
+    {
+      LOCK (pool_lock);
+      if (!pool_initialized)
+        init_pool ();
+      if (pool && free_list[cls])
+        {
+          b = free_list[cls];
+          free_list[cls] = b->next;
+        }
+      else if (pool && pool_used + ((size_t)1 << cls) <= POOL_SIZE)
+        {
+          b = (block_head_t)(pool + pool_used);
+          pool_used += (size_t)1 << cls;
+        }
+      UNLOCK (pool_lock);
+    }
+
+  if (!b)
+    return malloc (n? n : 1);
+
+  b->cls = cls;
+  return b + 1;
+}
+
+
+/* Wipe and release the memory P which has been allocated by
+ * _gpgme_secmem_malloc or malloc.  N is the size used for P.  */
+void
+_gpgme_secmem_free (void *p, size_t n)
+{
+  block_head_t b;
+  unsigned int cls;
+
+  if (!p)
+    return;
+
+  if (!_gpgme_secmem_owns (p))
+    {
+      _gpgme_wipememory (p, n);
+      free (p);
+      return;
+    }
+
+  b = (block_head_t)p - 1;
+  cls = b->cls;
+  if (n > ((size_t)1 << cls) - sizeof *b)
+    n = ((size_t)1 << cls) - sizeof *b;
+  _gpgme_wipememory (p, n);
+  LOCK (pool_lock);
+  b->next = free_list[cls];
+  free_list[cls] = b;
+  UNLOCK (pool_lock);
+}
+
+
+/* Change the size of the memory P with the used size N to NEWSIZE.
+ * The old memory is wiped.  Returns NULL and sets ERRNO on error; P
+ * is then not changed.  */
+void *
+_gpgme_secmem_realloc (void *p, size_t n, size_t newsize)
+{
+  void *newp;
+
+  if (p && _gpgme_secmem_owns (p))
+    {
+      block_head_t b = (block_head_t)p - 1;
+
+      if (newsize <= ((size_t)1 << b->cls) - sizeof *b)
+        return p;
+    }
+
+  newp = _gpgme_secmem_malloc (newsize);
+  if (!newp)
+    return NULL;
+  if (p)
+    {
+      memcpy (newp, p, n < newsize? n : newsize);
+      _gpgme_secmem_free (p, n);
+    }
+  return newp;
+}
@@ -31,6 +31,9 @@ char *_gpgme_get_gpgconf_path (void);
 
 int _gpgme_access (const char *path_utf8, int mode);
 
+/* Return a monotonic timestamp in milliseconds.  */
+unsigned long long _gpgme_monotonic_ms (void);
+
 #ifdef HAVE_W32_SYSTEM
 const char *_gpgme_get_inst_dir (void);
 void _gpgme_w32_cancel_synchronous_io (HANDLE thread);
@@ -182,6 +182,15 @@ const char *_gpgme_cipher_mode_name (int algo, gpgme_protocol_t protocol);
 void _gpgme_replace_backslashes (char *string);
 
 
+/*-- secmem.c --*/
+
+/* Allocate, wipe and release memory for sensitive data.  */
+void *_gpgme_secmem_malloc (size_t n);
+void *_gpgme_secmem_realloc (void *p, size_t n, size_t newsize);
+void _gpgme_secmem_free (void *p, size_t n);
+int _gpgme_secmem_owns (const void *p);
+
+
 /*-- b64dec.c --*/
 
 struct b64state
@@ -353,6 +353,28 @@ _gpgme_io_write (int fd, const void *buffer, size_t count)
 }
 
 
+/* Write the IOVCNT buffers described by IOV to FD.  Only the first
+   non-empty buffer is written; this is allowed because the caller
+   needs to cope with short writes anyway.  */
+int
+_gpgme_io_writev (int fd, const struct io_iov_s *iov, int iovcnt)
+{
+  for (; iovcnt > 1 && !iov->len; iov++, iovcnt--)
+    ;
+  return _gpgme_io_write (fd, iovcnt? iov->data : NULL, iovcnt? iov->len : 0);
+}
+
+
+/* Return the number of bytes which can be read from FD without
+   blocking or 0 if that is not known.  */
+int
+_gpgme_io_readable (int fd)
+{
+  (void)fd;
+  return 0;
+}
+
+
 int
 _gpgme_io_pipe (int filedes[2], int inherit_idx)
 {
@@ -805,10 +827,12 @@ _gpgme_io_spawn (const char *path, char * const argv[], unsigned int flags,
 }
 
 
-/* Select on the list of fds.  Returns: -1 = error, 0 = timeout or
-   nothing to select, > 0 = number of signaled fds.  */
+/* Select on the list of fds and wait at most TIMEOUT milliseconds.
+   Returns: -1 = error, 0 = timeout or nothing to select, > 0 = number
+   of signaled fds.  */
 int
-_gpgme_io_select (struct io_select_fd_s *fds, size_t nfds, int nonblock)
+_gpgme_io_select_timeout (struct io_select_fd_s *fds, size_t nfds,
+                          int timeout)
 {
   int npollfds;
   GPollFD *pollfds;
@@ -818,13 +842,11 @@ _gpgme_io_select (struct io_select_fd_s *fds, size_t nfds, int nonblock)
   int any;
   int n;
   int count;
-  /* Use a 1s timeout.  */
-  int timeout = 1000;
   void *dbg_help = NULL;
   TRACE_BEG  (DEBUG_SYSIO, "_gpgme_io_select", fds,
-	      "nfds=%u, nonblock=%u", nfds, nonblock);
+	      "nfds=%u, timeout=%d", nfds, timeout);
 
-  if (nonblock)
+  if (timeout < 0)
     timeout = 0;
 
   pollfds = calloc (nfds, sizeof *pollfds);
@@ -935,6 +957,16 @@ leave:
 }
 
 
+/* Select on the list of fds.  Returns: -1 = error, 0 = timeout or
+   nothing to select, > 0 = number of signaled fds.  */
+int
+_gpgme_io_select (struct io_select_fd_s *fds, size_t nfds, int nonblock)
+{
+  /* Use a 1s timeout.  */
+  return _gpgme_io_select_timeout (fds, nfds, nonblock? 0 : 1000);
+}
+
+
 int
 _gpgme_io_dup (int fd)
 {
@@ -1097,6 +1097,28 @@ _gpgme_io_write (int fd, const void *buffer, size_t count)
 }
 
 
+/* Write the IOVCNT buffers described by IOV to FD.  Only the first
+   non-empty buffer is written; this is allowed because the caller
+   needs to cope with short writes anyway.  */
+int
+_gpgme_io_writev (int fd, const struct io_iov_s *iov, int iovcnt)
+{
+  for (; iovcnt > 1 && !iov->len; iov++, iovcnt--)
+    ;
+  return _gpgme_io_write (fd, iovcnt? iov->data : NULL, iovcnt? iov->len : 0);
+}
+
+
+/* Return the number of bytes which can be read from FD without
+   blocking or 0 if that is not known.  */
+int
+_gpgme_io_readable (int fd)
+{
+  (void)fd;
+  return 0;
+}
+
+
 int
 _gpgme_io_pipe (int filedes[2], int inherit_idx)
 {
@@ -1830,10 +1852,12 @@ _gpgme_io_spawn (const char *path, char *const argv[], unsigned int flags,
 }
 
 
-/* Select on the list of fds.  Returns: -1 = error, 0 = timeout or
-   nothing to select, > 0 = number of signaled fds.  */
+/* Select on the list of fds and wait at most TIMEOUT milliseconds.
+   Returns: -1 = error, 0 = timeout or nothing to select, > 0 = number
+   of signaled fds.  */
 int
-_gpgme_io_select (struct io_select_fd_s *fds, size_t nfds, int nonblock)
+_gpgme_io_select_timeout (struct io_select_fd_s *fds, size_t nfds,
+                          int timeout)
 {
   HANDLE waitbuf[MAXIMUM_WAIT_OBJECTS];
   int waitidx[MAXIMUM_WAIT_OBJECTS];
@@ -1846,8 +1870,10 @@ _gpgme_io_select (struct io_select_fd_s *fds, size_t nfds, int nonblock)
   void *dbg_help = NULL;
 
   TRACE_BEG  (DEBUG_SYSIO, "_gpgme_io_select", fds,
-	      "nfds=%zd, nonblock=%u", nfds, nonblock);
+	      "nfds=%zd, timeout=%d", nfds, timeout);
 
+  if (timeout < 0)
+    timeout = 0;
 #if 0
  restart:
 #endif
@@ -1914,7 +1940,7 @@ _gpgme_io_select (struct io_select_fd_s *fds, size_t nfds, int nonblock)
   if (!any)
     return TRACE_SYSRES (0);
 
-  code = WaitForMultipleObjects (nwait, waitbuf, 0, nonblock ? 0 : 1000);
+  code = WaitForMultipleObjects (nwait, waitbuf, 0, timeout);
   if (code < WAIT_OBJECT_0 + nwait)
     {
       /* The WFMO is a really silly function: It does return either
@@ -1997,6 +2023,14 @@ _gpgme_io_select (struct io_select_fd_s *fds, size_t nfds, int nonblock)
   return TRACE_SYSRES (count);
 }
 
+/* Select on the list of fds.  Returns: -1 = error, 0 = timeout or
+   nothing to select, > 0 = number of signaled fds.  */
+int
+_gpgme_io_select (struct io_select_fd_s *fds, size_t nfds, int nonblock)
+{
+  return _gpgme_io_select_timeout (fds, nfds, nonblock ? 0 : 1000);
+}
+
 
 void
 _gpgme_io_subsystem_init (void)
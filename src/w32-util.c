@@ -944,6 +944,14 @@ _gpgme_access (const char *path, int mode)
 }
 
 
+/* Return a monotonic timestamp in milliseconds.  */
+unsigned long long
+_gpgme_monotonic_ms (void)
+{
+  return GetTickCount64 ();
+}
+
+
 /* Like CreateProcessA but mapping the arguments to wchar API */
 int
 _gpgme_create_process_utf8 (const char *application_name_utf8,
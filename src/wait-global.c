@@ -50,7 +50,13 @@
    moved to the global done list.
 
    All contexts in the global done list are eligible for being
-   returned by gpgme_wait if requested by the caller.  */
+   returned by gpgme_wait if requested by the caller.
+
+   The select() loop also watches the read end of a wakeup pipe.  It
+   is written to when a context becomes active or done and when an
+   operation is canceled with gpgme_cancel_async, so that all threads
+   waiting in gpgme_wait notice this immediately and not only when
+   the next engine output arrives.  */
 
 /* The ctx_list_lock protects the list of active and done contexts.
    Insertion into any of these lists is only allowed when the lock is
@@ -76,6 +82,14 @@ struct ctx_list_item
   /* The status is set when the ctx is moved to the done list.  */
   gpgme_error_t status;
   gpgme_error_t op_err;
+
+  /* Set if a thread has taken over sending the DONE event or
+     canceling this context.  NEXT_FINISH links the contexts
+     collected by that thread and CANCEL_ERR is the error used to
+     cancel the context or 0 if it finished.  */
+  int finishing;
+  struct ctx_list_item *next_finish;
+  gpgme_error_t cancel_err;
 };
 
 /* The active list contains all contexts that are in the global event
@@ -90,6 +104,71 @@ static struct ctx_list_item *ctx_active_list;
    successful).  */
 static struct ctx_list_item *ctx_done_list;
 
+/* The wakeup pipe and a flag telling whether a byte is pending in it.
+   Both are protected by ctx_list_lock.  Because at most one byte is
+   ever pending, neither reading nor writing blocks.
+
+   The byte must stay in the pipe until every thread which was waiting
+   when it was written has returned from select.  WAKEUP_WAITERS is
+   the number of threads between collecting the file descriptors and
+   returning from select, WAKEUP_GEN is incremented for each wakeup
+   and WAKEUP_UNSEEN is the number of waiters which started waiting
+   before the last wakeup and have not yet returned.  The last of them
+   drains the pipe.  */
+static int wakeup_fds[2] = { -1, -1 };
+static int wakeup_pending;
+static unsigned int wakeup_waiters;
+static unsigned int wakeup_gen;
+static unsigned int wakeup_unseen;
+
+
+/* Wake up all threads waiting in gpgme_wait.  Must be called with
+   ctx_list_lock held.  */
+static void
+wakeup_locked (void)
+{
+  if (wakeup_fds[1] == -1 || !wakeup_waiters)
+    return;
+
+  wakeup_gen++;
+  wakeup_unseen = wakeup_waiters;
+  if (!wakeup_pending)
+    {
+      if (_gpgme_io_write (wakeup_fds[1], "", 1) == 1)
+        wakeup_pending = 1;
+    }
+}
+
+
+/* Note that a thread which started waiting at generation GEN has
+   returned from select and drains the wakeup pipe if it was the last
+   one to see the byte.  Must be called with ctx_list_lock held.  */
+static void
+wakeup_seen_locked (unsigned int gen)
+{
+  char buf;
+
+  wakeup_waiters--;
+  if (gen != wakeup_gen && wakeup_unseen)
+    wakeup_unseen--;
+  if (wakeup_pending && !wakeup_unseen)
+    {
+      _gpgme_io_read (wakeup_fds[0], &buf, 1);
+      wakeup_pending = 0;
+    }
+}
+
+
+/* Wake up all threads waiting in gpgme_wait; for example because an
+   operation has been canceled.  */
+void
+_gpgme_wait_global_wakeup (void)
+{
+  LOCK (ctx_list_lock);
+  wakeup_locked ();
+  UNLOCK (ctx_list_lock);
+}
+
 
 /* Enter the context CTX into the active list.  */
 static gpgme_error_t
@@ -99,6 +178,7 @@ ctx_active (gpgme_ctx_t ctx)
   if (!li)
     return gpg_error_from_syserror ();
   li->ctx = ctx;
+  li->finishing = 0;
 
   LOCK (ctx_list_lock);
   /* Add LI to active list.  */
@@ -107,6 +187,8 @@ ctx_active (gpgme_ctx_t ctx)
   if (ctx_active_list)
     ctx_active_list->prev = li;
   ctx_active_list = li;
+  /* Let the waiters pick up the file descriptors of CTX.  */
+  wakeup_locked ();
   UNLOCK (ctx_list_lock);
   return 0;
 }
@@ -122,7 +204,13 @@ ctx_done (gpgme_ctx_t ctx, gpgme_error_t status, gpgme_error_t op_err)
   li = ctx_active_list;
   while (li && li->ctx != ctx)
     li = li->next;
-  assert (li);
+  if (!li)
+    {
+      /* Another thread canceled CTX concurrently and already moved
+	 it to the done list.  */
+      UNLOCK (ctx_list_lock);
+      return;
+    }
 
   /* Remove LI from active list.  */
   if (li->next)
@@ -141,6 +229,7 @@ ctx_done (gpgme_ctx_t ctx, gpgme_error_t status, gpgme_error_t op_err)
   if (ctx_done_list)
     ctx_done_list->prev = li;
   ctx_done_list = li;
+  wakeup_locked ();
   UNLOCK (ctx_list_lock);
 }
 
@@ -255,14 +344,29 @@ gpgme_wait_ext (gpgme_ctx_t ctx, gpgme_error_t *status,
     {
       unsigned int i = 0;
       struct ctx_list_item *li;
+      struct ctx_list_item *finish_list;
       struct fd_table fdt;
+      unsigned int gen;
+      gpgme_error_t select_err;
+      int timeout;
       int nr;
 
-      /* Collect the active file descriptors.  */
+      /* Collect the active file descriptors.  The first slot is used
+	 for the wakeup pipe.  Use a 1s timeout unless the deadline of
+	 an operation expires earlier.  */
+      timeout = 1000;
       LOCK (ctx_list_lock);
+      if (wakeup_fds[0] == -1 && _gpgme_io_pipe (wakeup_fds, 1) < 0)
+	wakeup_fds[0] = wakeup_fds[1] = -1;
       for (li = ctx_active_list; li; li = li->next)
-	i += li->ctx->fdt.size;
-      fdt.fds = malloc (i * sizeof (struct io_select_fd_s));
+	{
+	  int left = _gpgme_wait_deadline_left (li->ctx);
+
+	  if (left >= 0 && left < timeout)
+	    timeout = left;
+	  i += li->ctx->fdt.size;
+	}
+      fdt.fds = malloc ((i + 1) * sizeof (struct io_select_fd_s));
       if (!fdt.fds)
 	{
           int saved_err = gpg_error_from_syserror ();
@@ -273,29 +377,42 @@ gpgme_wait_ext (gpgme_ctx_t ctx, gpgme_error_t *status,
 	    *op_err = 0;
 	  return NULL;
 	}
-      fdt.size = i;
-      i = 0;
+      fdt.size = i + 1;
+      memset (&fdt.fds[0], 0, sizeof fdt.fds[0]);
+      fdt.fds[0].fd = wakeup_fds[0];
+      fdt.fds[0].for_read = 1;
+      i = 1;
       for (li = ctx_active_list; li; li = li->next)
 	{
 	  memcpy (&fdt.fds[i], li->ctx->fdt.fds,
 		  li->ctx->fdt.size * sizeof (struct io_select_fd_s));
 	  i += li->ctx->fdt.size;
 	}
+      wakeup_waiters++;
+      gen = wakeup_gen;
+      UNLOCK (ctx_list_lock);
+
+      nr = _gpgme_io_select_timeout (fdt.fds, fdt.size, timeout);
+      select_err = nr < 0 ? gpg_error_from_syserror () : 0;
+
+      LOCK (ctx_list_lock);
+      wakeup_seen_locked (gen);
       UNLOCK (ctx_list_lock);
 
-      nr = _gpgme_io_select (fdt.fds, fdt.size, 0);
       if (nr < 0)
 	{
-          int saved_err = gpg_error_from_syserror ();
 	  free (fdt.fds);
 	  if (status)
-	    *status = saved_err;
+	    *status = select_err;
 	  if (op_err)
 	    *op_err = 0;
 	  return NULL;
 	}
 
-      for (i = 0; i < fdt.size && nr; i++)
+      if (fdt.fds[0].fd != -1 && fdt.fds[0].signaled)
+	nr--;
+
+      for (i = 1; i < fdt.size && nr; i++)
 	{
 	  if (fdt.fds[i].fd != -1 && fdt.fds[i].signaled)
 	    {
@@ -312,10 +429,10 @@ gpgme_wait_ext (gpgme_ctx_t ctx, gpgme_error_t *status,
 	      ictx = item->ctx;
 	      assert (ictx);
 
-	      LOCK (ctx->lock);
-	      if (ctx->canceled)
+	      LOCK (ictx->lock);
+	      if (ictx->canceled)
 		err = gpg_error (GPG_ERR_CANCELED);
-	      UNLOCK (ctx->lock);
+	      UNLOCK (ictx->lock);
 
 	      if (!err)
 		err = _gpgme_run_io_cb (&fdt.fds[i], 0, &local_op_err);
@@ -334,37 +451,58 @@ gpgme_wait_ext (gpgme_ctx_t ctx, gpgme_error_t *status,
 	}
       free (fdt.fds);
 
-      /* Now some contexts might have finished successfully.  */
+      /* Now some contexts might have finished successfully, have
+	 been canceled, or have exceeded their deadline.  Collect them
+	 while holding the lock and send the events afterwards because
+	 the DONE event handler acquires the lock to move the context
+	 to the done list.  The FINISHING flag makes sure that only one
+	 thread does this.  */
+      finish_list = NULL;
       LOCK (ctx_list_lock);
-    retry:
       for (li = ctx_active_list; li; li = li->next)
 	{
-	  gpgme_ctx_t actx = li->ctx;
+	  gpgme_error_t cancel_err = 0;
+
+	  if (li->finishing)
+	    continue;
+	  if (li->ctx->fdt.active)
+	    {
+	      LOCK (li->ctx->lock);
+	      if (li->ctx->canceled)
+		cancel_err = gpg_error (GPG_ERR_CANCELED);
+	      UNLOCK (li->ctx->lock);
+	      if (!cancel_err && !_gpgme_wait_deadline_left (li->ctx))
+		cancel_err = gpg_error (GPG_ERR_TIMEOUT);
+	      if (!cancel_err)
+		continue;
+	    }
+
+	  li->finishing = 1;
+	  li->cancel_err = cancel_err;
+	  li->next_finish = finish_list;
+	  finish_list = li;
+	}
+      UNLOCK (ctx_list_lock);
 
-	  for (i = 0; i < actx->fdt.size; i++)
-	    if (actx->fdt.fds[i].fd != -1)
-	      break;
-	  if (i == actx->fdt.size)
+      while (finish_list)
+	{
+	  gpgme_ctx_t actx = finish_list->ctx;
+	  gpgme_error_t cancel_err = finish_list->cancel_err;
+
+	  /* FINISH_LIST may be released by another thread once the
+	     DONE event has been sent.  */
+	  finish_list = finish_list->next_finish;
+	  if (cancel_err)
+	    _gpgme_cancel_with_err (actx, cancel_err, 0);
+	  else
 	    {
 	      struct gpgme_io_event_done_data data;
+
 	      data.err = 0;
 	      data.op_err = 0;
-
-	      /* FIXME: This does not perform too well.  We have to
-		 release the lock because the I/O event handler
-		 acquires it to remove the context from the active
-		 list.  Two alternative strategies are worth
-		 considering: Either implement the DONE event handler
-		 here in a lock-free manner, or save a list of all
-		 contexts to be released and call the DONE events
-		 afterwards.  */
-	      UNLOCK (ctx_list_lock);
 	      _gpgme_engine_io_event (actx->engine, GPGME_EVENT_DONE, &data);
-	      LOCK (ctx_list_lock);
-	      goto retry;
 	    }
 	}
-      UNLOCK (ctx_list_lock);
 
       {
 	gpgme_ctx_t dctx = ctx_wait (ctx, status, op_err);
@@ -80,9 +80,22 @@ _gpgme_wait_on_condition (gpgme_ctx_t ctx, volatile int *cond,
 
   do
     {
-      int nr = _gpgme_io_select (ctx->fdt.fds, ctx->fdt.size, 0);
+      int timeout = _gpgme_wait_deadline_left (ctx);
+      int nr;
       unsigned int i;
 
+      if (!timeout && ctx->fdt.active)
+	{
+	  /* The deadline of the operation has passed.  */
+	  err = gpg_error (GPG_ERR_TIMEOUT);
+	  _gpgme_cancel_with_err (ctx, err, 0);
+	  return err;
+	}
+
+      /* Use a 1s timeout so that cancellation is noticed.  */
+      if (timeout < 0 || timeout > 1000)
+	timeout = 1000;
+      nr = _gpgme_io_select_timeout (ctx->fdt.fds, ctx->fdt.size, timeout);
       if (nr < 0)
 	{
 	  /* An error occurred.  Close all fds in this context, and
@@ -93,6 +106,22 @@ _gpgme_wait_on_condition (gpgme_ctx_t ctx, volatile int *cond,
 	  return err;
 	}
 
+      if (!nr)
+	{
+	  /* A timeout.  Check whether the operation has been canceled
+	     by gpgme_cancel_async in the meantime; otherwise this is
+	     only noticed when the engine writes something.  */
+	  LOCK (ctx->lock);
+	  if (ctx->canceled)
+	    err = gpg_error (GPG_ERR_CANCELED);
+	  UNLOCK (ctx->lock);
+	  if (err)
+	    {
+	      _gpgme_cancel_with_err (ctx, err, 0);
+	      return err;
+	    }
+	}
+
       for (i = 0; i < ctx->fdt.size && nr; i++)
 	{
 	  if (ctx->fdt.fds[i].fd != -1 && ctx->fdt.fds[i].signaled)
@@ -137,10 +166,7 @@ _gpgme_wait_on_condition (gpgme_ctx_t ctx, volatile int *cond,
 	    }
 	}
 
-      for (i = 0; i < ctx->fdt.size; i++)
-	if (ctx->fdt.fds[i].fd != -1)
-	  break;
-      if (i == ctx->fdt.size)
+      if (!ctx->fdt.active)
 	{
 	  struct gpgme_io_event_done_data data;
 	  data.err = 0;
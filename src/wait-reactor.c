@@ -0,0 +1,884 @@
+/* wait-reactor.c - A completion based event loop for external reactors.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GPGME.
+ *
+ * GPGME is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GPGME is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <https://gnu.org/licenses/>.
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_EVENTFD_H)
+# include <sys/epoll.h>
+# include <sys/eventfd.h>
+# define USE_REACTOR 1
+# ifdef HAVE_SYS_TIMERFD_H
+#  include <sys/timerfd.h>
+# endif
+#endif
+
+#include "gpgme.h"
+#include "util.h"
+#include "context.h"
+#include "wait.h"
+#include "ops.h"
+#include "sema.h"
+#include "debug.h"
+
+
+/* A reactor is a variant of the user event loop which is implemented
+   by GPGME itself.  All file descriptors of the attached contexts are
+   kept in an epoll set; the epoll file descriptor is handed to the
+   application which adds it to its own event loop.  When that file
+   descriptor becomes readable, the application calls
+   gpgme_reactor_dispatch which runs the ready I/O callbacks and then
+   calls the completion callbacks of all finished operations.
+
+   Operations may also finish outside of the dispatcher, for example
+   due to gpgme_cancel.  In this case the completion is queued and an
+   eventfd which is part of the epoll set is signalled so that the
+   application calls the dispatcher soon.
+
+   The dispatcher may be called by several threads at once.  Each file
+   descriptor is armed with EPOLLONESHOT so that an event is delivered
+   to only one thread, and it is re-armed after its handler has run.
+   Because a context must not be used by two threads at the same time,
+   a thread which receives an event for a context whose handlers are
+   already running elsewhere does not wait but queues the item on the
+   context; the thread owning the context runs it before giving the
+   context up.
+
+   If the context flag "deadline-ms" is set, a timerfd is added to the
+   epoll set when an operation starts; it cancels the operation with
+   GPG_ERR_TIMEOUT when it fires.  It is run like any other item of the
+   context.  */
+
+#ifdef USE_REACTOR
+
+/* An item describes one file descriptor registered by an engine.  */
+struct reactor_item_s
+{
+  struct reactor_item_s *next;
+  struct reactor_ctx_s *rctx;
+  int fd;
+  int dir;
+  gpgme_io_cb_t fnc;
+  void *fnc_data;
+
+  /* Set if the fd has been added to the epoll set.  */
+  unsigned int armed:1;
+
+  /* Set if the item has been removed while a dispatcher may still
+     hold a reference to it.  */
+  unsigned int dead:1;
+
+  /* Set if the item is on the ready list of its context.  */
+  unsigned int ready:1;
+  struct reactor_item_s *next_ready;
+};
+typedef struct reactor_item_s *reactor_item_t;
+
+
+/* The binding between a context and a reactor.  This is used as the
+   private value of the I/O callbacks of the context.  */
+struct reactor_ctx_s
+{
+  gpgme_reactor_t reactor;
+  gpgme_ctx_t ctx;
+  gpgme_reactor_done_cb_t done_cb;
+  void *done_cb_value;
+
+  /* The items registered before the start event.  They are armed
+     when the start event is seen.  */
+  reactor_item_t pending;
+
+  /* Set once the start event has been seen for the current
+     operation.  */
+  unsigned int started:1;
+
+  /* Set while a thread runs the handlers of the context.  Items which
+     became ready meanwhile are queued on the READY list.  */
+  unsigned int busy:1;
+  reactor_item_t ready;
+  reactor_item_t *ready_tail;
+
+  /* The timer enforcing the deadline of the current operation or
+     NULL.  */
+  reactor_item_t timer;
+
+  /* Set if a completion is queued.  ERR and OP_ERR hold its status
+     and NEXT_DONE links the entry into the done queue.  */
+  unsigned int done_queued:1;
+  gpgme_error_t err;
+  gpgme_error_t op_err;
+  struct reactor_ctx_s *next_done;
+};
+typedef struct reactor_ctx_s *reactor_ctx_t;
+
+
+struct gpgme_reactor
+{
+  DECLARE_LOCK (lock);
+
+  /* The number of attached contexts plus one for the handle owned by
+     the application.  */
+  unsigned int refcount;
+
+  /* The epoll file descriptor handed to the application and the
+     eventfd used to signal queued completions.  */
+  int epfd;
+  int evfd;
+
+  /* The number of dispatchers currently running.  Items removed
+     while this is not zero are moved to the GRAVEYARD and released
+     by the last dispatcher.  */
+  unsigned int in_dispatch;
+  reactor_item_t graveyard;
+
+  /* The number of dispatchers which may be blocked in epoll_wait.
+     They do not see completions queued by other threads unless the
+     eventfd is written.  */
+  unsigned int in_wait;
+
+  /* The queue of finished operations.  */
+  reactor_ctx_t done_head;
+  reactor_ctx_t *done_tail;
+};
+
+
+/* Release REACTOR if its last reference has been dropped.  Must be
+   called with the lock held; the lock is released.  */
+static void
+reactor_unref_and_unlock (gpgme_reactor_t reactor)
+{
+  int last;
+
+  assert (reactor->refcount);
+  last = !--reactor->refcount;
+  UNLOCK (reactor->lock);
+  if (!last)
+    return;
+
+  assert (!reactor->in_dispatch);
+  while (reactor->graveyard)
+    {
+      reactor_item_t item = reactor->graveyard;
+      reactor->graveyard = item->next;
+      free (item);
+    }
+  close (reactor->evfd);
+  close (reactor->epfd);
+  DESTROY_LOCK (reactor->lock);
+  free (reactor);
+}
+
+
+/* Add ITEM to the epoll set.  Must be called with the lock held.  */
+static gpgme_error_t
+arm_item (gpgme_reactor_t reactor, reactor_item_t item)
+{
+  struct epoll_event ev;
+
+  memset (&ev, 0, sizeof ev);
+  ev.events = (item->dir ? EPOLLIN : EPOLLOUT) | EPOLLONESHOT;
+  ev.data.ptr = item;
+  if (epoll_ctl (reactor->epfd, item->armed? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+                 item->fd, &ev))
+    return gpg_error_from_syserror ();
+  item->armed = 1;
+  return 0;
+}
+
+
+/* Signal the eventfd so that the application runs the dispatcher.  */
+static void
+wakeup_reactor (gpgme_reactor_t reactor)
+{
+  uint64_t one = 1;
+
+  while (write (reactor->evfd, &one, sizeof one) < 0 && errno == EINTR)
+    ;
+}
+
+
+
+/* The I/O callback interface used for contexts attached to a
+   reactor.  */
+
+static gpgme_error_t
+reactor_add_io_cb (void *data, int fd, int dir, gpgme_io_cb_t fnc,
+                   void *fnc_data, void **r_tag)
+{
+  reactor_ctx_t rctx = data;
+  gpgme_reactor_t reactor = rctx->reactor;
+  reactor_item_t item;
+  gpgme_error_t err = 0;
+
+  item = calloc (1, sizeof *item);
+  if (!item)
+    return gpg_error_from_syserror ();
+  item->rctx = rctx;
+  item->fd = fd;
+  item->dir = dir;
+  item->fnc = fnc;
+  item->fnc_data = fnc_data;
+
+  LOCK (reactor->lock);
+  if (rctx->started)
+    err = arm_item (reactor, item);
+  else
+    {
+      item->next = rctx->pending;
+      rctx->pending = item;
+    }
+  UNLOCK (reactor->lock);
+  if (err)
+    {
+      free (item);
+      return err;
+    }
+
+  TRACE (DEBUG_CTX, "gpgme:reactor_add_io_cb", rctx->ctx,
+         "fd=%d, dir=%d -> item=%p", fd, dir, item);
+  *r_tag = item;
+  return 0;
+}
+
+
+/* Remove ITEM from the epoll set or the pending list and mark it as
+   dead.  Returns ITEM if the caller shall free it or NULL if it has
+   been moved to the graveyard.  Must be called with the lock
+   held.  */
+static reactor_item_t
+drop_item (gpgme_reactor_t reactor, reactor_item_t item)
+{
+  reactor_ctx_t rctx = item->rctx;
+
+  if (item->armed)
+    epoll_ctl (reactor->epfd, EPOLL_CTL_DEL, item->fd, NULL);
+  else
+    {
+      reactor_item_t *lastp;
+
+      for (lastp = &rctx->pending; *lastp; lastp = &(*lastp)->next)
+        if (*lastp == item)
+          {
+            *lastp = item->next;
+            break;
+          }
+    }
+  item->dead = 1;
+  if (reactor->in_dispatch)
+    {
+      /* A dispatcher may still see this item in its event list.  */
+      item->next = reactor->graveyard;
+      reactor->graveyard = item;
+      item = NULL;
+    }
+  return item;
+}
+
+
+static void
+reactor_remove_io_cb (void *tag)
+{
+  reactor_item_t item = tag;
+  reactor_ctx_t rctx = item->rctx;
+  gpgme_reactor_t reactor = rctx->reactor;
+
+  TRACE (DEBUG_CTX, "gpgme:reactor_remove_io_cb", rctx->ctx,
+         "fd=%d, item=%p", item->fd, item);
+
+  LOCK (reactor->lock);
+  item = drop_item (reactor, item);
+  UNLOCK (reactor->lock);
+  free (item);
+}
+
+
+#ifdef HAVE_SYS_TIMERFD_H
+/* The handler of the deadline timer.  */
+static gpgme_error_t
+deadline_handler (void *opaque, int fd)
+{
+  reactor_ctx_t rctx = opaque;
+  uint64_t count;
+
+  while (read (fd, &count, sizeof count) < 0 && errno == EINTR)
+    ;
+  TRACE (DEBUG_CTX, "gpgme:reactor_deadline_handler", rctx->ctx,
+         "deadline expired");
+  _gpgme_cancel_with_err (rctx->ctx, gpg_error (GPG_ERR_TIMEOUT), 0);
+  return 0;
+}
+#endif /*HAVE_SYS_TIMERFD_H*/
+
+
+/* Create the deadline timer for the operation started on the context
+   of RCTX and store it at R_TIMER.  If the operation has no deadline
+   NULL is stored.  */
+static gpgme_error_t
+new_deadline_timer (reactor_ctx_t rctx, reactor_item_t *r_timer)
+{
+  *r_timer = NULL;
+#ifdef HAVE_SYS_TIMERFD_H
+  {
+    int left = _gpgme_wait_deadline_left (rctx->ctx);
+    struct itimerspec its;
+    reactor_item_t item;
+    gpgme_error_t err;
+
+    if (left < 0)
+      return 0;
+
+    item = calloc (1, sizeof *item);
+    if (!item)
+      return gpg_error_from_syserror ();
+    item->fd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (item->fd == -1)
+      {
+        err = gpg_error_from_syserror ();
+        free (item);
+        return err;
+      }
+    memset (&its, 0, sizeof its);
+    its.it_value.tv_sec = left / 1000;
+    its.it_value.tv_nsec = (left % 1000) * 1000000;
+    if (!left)
+      its.it_value.tv_nsec = 1;  /* Already expired; zero would disarm.  */
+    if (timerfd_settime (item->fd, 0, &its, NULL))
+      {
+        err = gpg_error_from_syserror ();
+        close (item->fd);
+        free (item);
+        return err;
+      }
+    item->rctx = rctx;
+    item->dir = 1;
+    item->fnc = deadline_handler;
+    item->fnc_data = rctx;
+    *r_timer = item;
+  }
+#else
+  (void)rctx;
+#endif
+  return 0;
+}
+
+
+/* Remove and close the deadline timer of RCTX.  Must be called with
+   the lock held.  */
+static void
+drop_deadline_timer (gpgme_reactor_t reactor, reactor_ctx_t rctx)
+{
+  reactor_item_t item = rctx->timer;
+  int fd;
+
+  if (!item)
+    return;
+  rctx->timer = NULL;
+  fd = item->fd;
+  free (drop_item (reactor, item));
+  close (fd);
+}
+
+
+static void
+reactor_event_cb (void *data, gpgme_event_io_t type, void *type_data)
+{
+  reactor_ctx_t rctx = data;
+  gpgme_reactor_t reactor = rctx->reactor;
+
+  switch (type)
+    {
+    case GPGME_EVENT_START:
+      {
+        gpgme_error_t err;
+        reactor_item_t timer;
+
+        err = new_deadline_timer (rctx, &timer);
+
+        LOCK (reactor->lock);
+        rctx->started = 1;
+        drop_deadline_timer (reactor, rctx);
+        if (timer)
+          {
+            rctx->timer = timer;
+            err = arm_item (reactor, timer);
+          }
+        while (rctx->pending && !err)
+          {
+            reactor_item_t item = rctx->pending;
+
+            rctx->pending = item->next;
+            item->next = NULL;
+            err = arm_item (reactor, item);
+          }
+        UNLOCK (reactor->lock);
+        if (err)
+          _gpgme_cancel_with_err (rctx->ctx, err, 0);
+      }
+      break;
+
+    case GPGME_EVENT_DONE:
+      {
+	gpgme_io_event_done_data_t done_data = type_data;
+
+        LOCK (reactor->lock);
+        rctx->started = 0;
+        drop_deadline_timer (reactor, rctx);
+        if (!rctx->done_queued)
+          {
+            rctx->done_queued = 1;
+            rctx->err = done_data->err;
+            rctx->op_err = done_data->op_err;
+            rctx->next_done = NULL;
+            *reactor->done_tail = rctx;
+            reactor->done_tail = &rctx->next_done;
+          }
+        /* A running dispatcher calls the completion callbacks when
+           it is done with its events; only wake up the reactor if
+           there is none or one may be blocked waiting.  */
+        if (!reactor->in_dispatch || reactor->in_wait)
+          wakeup_reactor (reactor);
+        UNLOCK (reactor->lock);
+      }
+      break;
+
+    case GPGME_EVENT_NEXT_KEY:
+      /* Queue the key so that the application can retrieve it with
+         gpgme_op_keylist_next from the completion callback.  */
+      _gpgme_op_keylist_event_cb (rctx->ctx, type, type_data);
+      break;
+
+    default:
+      assert (!"Unexpected event");
+      break;
+    }
+}
+
+
+/* Detach the context bound by RCTX from its reactor.  */
+static void
+reactor_detach (reactor_ctx_t rctx)
+{
+  gpgme_reactor_t reactor = rctx->reactor;
+
+  LOCK (reactor->lock);
+  if (rctx->done_queued)
+    {
+      reactor_ctx_t *lastp;
+
+      for (lastp = &reactor->done_head; *lastp; lastp = &(*lastp)->next_done)
+        if (*lastp == rctx)
+          {
+            *lastp = rctx->next_done;
+            if (!*lastp)
+              reactor->done_tail = lastp;
+            break;
+          }
+    }
+  while (rctx->pending)
+    {
+      reactor_item_t item = rctx->pending;
+      rctx->pending = item->next;
+      free (item);
+    }
+  drop_deadline_timer (reactor, rctx);
+  rctx->ctx->reactor = NULL;
+  free (rctx);
+  reactor_unref_and_unlock (reactor);
+}
+
+#endif /*USE_REACTOR*/
+
+
+
+/* Create a new reactor and return it at R_REACTOR.  */
+gpgme_error_t
+gpgme_reactor_new (gpgme_reactor_t *r_reactor)
+{
+#ifdef USE_REACTOR
+  gpgme_error_t err;
+  gpgme_reactor_t reactor;
+  struct epoll_event ev;
+
+  TRACE_BEG (DEBUG_CTX, "gpgme_reactor_new", r_reactor, "");
+
+  if (!r_reactor)
+    return TRACE_ERR (gpg_error (GPG_ERR_INV_VALUE));
+  *r_reactor = NULL;
+
+  reactor = calloc (1, sizeof *reactor);
+  if (!reactor)
+    return TRACE_ERR (gpg_error_from_syserror ());
+  INIT_LOCK (reactor->lock);
+  reactor->refcount = 1;
+  reactor->done_tail = &reactor->done_head;
+
+  reactor->epfd = epoll_create1 (EPOLL_CLOEXEC);
+  if (reactor->epfd == -1)
+    {
+      err = gpg_error_from_syserror ();
+      free (reactor);
+      return TRACE_ERR (err);
+    }
+  reactor->evfd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (reactor->evfd == -1)
+    {
+      err = gpg_error_from_syserror ();
+      close (reactor->epfd);
+      free (reactor);
+      return TRACE_ERR (err);
+    }
+  memset (&ev, 0, sizeof ev);
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;  /* NULL marks the eventfd.  */
+  if (epoll_ctl (reactor->epfd, EPOLL_CTL_ADD, reactor->evfd, &ev))
+    {
+      err = gpg_error_from_syserror ();
+      close (reactor->evfd);
+      close (reactor->epfd);
+      free (reactor);
+      return TRACE_ERR (err);
+    }
+
+  *r_reactor = reactor;
+  TRACE_SUC ("reactor=%p epfd=%d", reactor, reactor->epfd);
+  return 0;
+#else
+  TRACE (DEBUG_CTX, "gpgme_reactor_new", r_reactor, "not supported");
+  if (r_reactor)
+    *r_reactor = NULL;
+  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+#endif
+}
+
+
+/* Release the application's handle of REACTOR.  The reactor is
+   destroyed once all contexts have been detached.  */
+void
+gpgme_reactor_release (gpgme_reactor_t reactor)
+{
+  TRACE (DEBUG_CTX, "gpgme_reactor_release", reactor, "");
+
+  if (!reactor)
+    return;
+#ifdef USE_REACTOR
+  LOCK (reactor->lock);
+  reactor_unref_and_unlock (reactor);
+#endif
+}
+
+
+/* Return the file descriptor which the application shall watch for
+   readability.  */
+int
+gpgme_reactor_get_fd (gpgme_reactor_t reactor)
+{
+#ifdef USE_REACTOR
+  return reactor ? reactor->epfd : -1;
+#else
+  (void)reactor;
+  return -1;
+#endif
+}
+
+
+/* Attach the context CTX to REACTOR.  DONE_CB is called with
+   DONE_CB_VALUE by gpgme_reactor_dispatch whenever an operation
+   started on CTX has finished.  If REACTOR is NULL the context is
+   detached and the default event loops are used again.  */
+gpgme_error_t
+gpgme_set_reactor (gpgme_ctx_t ctx, gpgme_reactor_t reactor,
+                   gpgme_reactor_done_cb_t done_cb, void *done_cb_value)
+{
+#ifdef USE_REACTOR
+  reactor_ctx_t rctx;
+#endif
+
+  TRACE_BEG (DEBUG_CTX, "gpgme_set_reactor", ctx, "reactor=%p done_cb=%p/%p",
+             reactor, done_cb, done_cb_value);
+
+  if (!ctx || (reactor && !done_cb))
+    return TRACE_ERR (gpg_error (GPG_ERR_INV_VALUE));
+
+#ifdef USE_REACTOR
+  if (ctx->reactor)
+    {
+      reactor_detach (ctx->reactor);
+      gpgme_set_io_cbs (ctx, NULL);
+    }
+  if (!reactor)
+    return TRACE_ERR (0);
+
+  rctx = calloc (1, sizeof *rctx);
+  if (!rctx)
+    return TRACE_ERR (gpg_error_from_syserror ());
+  rctx->reactor = reactor;
+  rctx->ctx = ctx;
+  rctx->ready_tail = &rctx->ready;
+  rctx->done_cb = done_cb;
+  rctx->done_cb_value = done_cb_value;
+
+  LOCK (reactor->lock);
+  reactor->refcount++;
+  UNLOCK (reactor->lock);
+
+  ctx->io_cbs.add = reactor_add_io_cb;
+  ctx->io_cbs.add_priv = rctx;
+  ctx->io_cbs.remove = reactor_remove_io_cb;
+  ctx->io_cbs.event = reactor_event_cb;
+  ctx->io_cbs.event_priv = rctx;
+  ctx->reactor = rctx;
+  return TRACE_ERR (0);
+#else
+  if (!reactor)
+    return TRACE_ERR (0);
+  return TRACE_ERR (gpg_error (GPG_ERR_NOT_SUPPORTED));
+#endif
+}
+
+
+/* Internal function to detach CTX from its reactor on release.  */
+void
+_gpgme_reactor_release_ctx (gpgme_ctx_t ctx)
+{
+#ifdef USE_REACTOR
+  if (ctx->reactor)
+    reactor_detach (ctx->reactor);
+#else
+  (void)ctx;
+#endif
+}
+
+
+#ifdef USE_REACTOR
+/* Run the handler of ITEM unless another thread is running handlers
+   of the same context; in that case queue ITEM for that thread.  The
+   owning thread runs all queued items before it releases the
+   context.  */
+static void
+run_item (gpgme_reactor_t reactor, reactor_item_t item)
+{
+  reactor_ctx_t rctx = item->rctx;
+  gpgme_error_t err;
+
+  LOCK (reactor->lock);
+  if (item->dead)
+    {
+      UNLOCK (reactor->lock);
+      return;
+    }
+  if (rctx->busy)
+    {
+      if (!item->ready)
+        {
+          item->ready = 1;
+          item->next_ready = NULL;
+          *rctx->ready_tail = item;
+          rctx->ready_tail = &item->next_ready;
+        }
+      UNLOCK (reactor->lock);
+      return;
+    }
+  rctx->busy = 1;
+
+  while (item)
+    {
+      UNLOCK (reactor->lock);
+      TRACE (DEBUG_CTX, "gpgme:reactor_run_item", rctx->ctx,
+             "running handler for fd=%d item=%p", item->fd, item);
+      (*item->fnc) (item->fnc_data, item->fd);
+      LOCK (reactor->lock);
+
+      /* Re-arm the file descriptor unless the handler removed it.  */
+      if (!item->dead && (err = arm_item (reactor, item)))
+        {
+          UNLOCK (reactor->lock);
+          _gpgme_cancel_with_err (rctx->ctx, err, 0);
+          LOCK (reactor->lock);
+        }
+
+      do
+        {
+          item = rctx->ready;
+          if (item)
+            {
+              rctx->ready = item->next_ready;
+              if (!rctx->ready)
+                rctx->ready_tail = &rctx->ready;
+              item->ready = 0;
+            }
+        }
+      while (item && item->dead);
+    }
+
+  rctx->busy = 0;
+  UNLOCK (reactor->lock);
+}
+
+
+/* Take the next finished operation from the done queue of REACTOR.
+   Contexts which are still owned by another thread are skipped; that
+   thread picks them up itself.  Must be called with the lock
+   held.  */
+static reactor_ctx_t
+take_done (gpgme_reactor_t reactor)
+{
+  reactor_ctx_t *lastp, rctx;
+
+  for (lastp = &reactor->done_head; (rctx = *lastp);
+       lastp = &rctx->next_done)
+    if (!rctx->busy)
+      {
+        *lastp = rctx->next_done;
+        if (!*lastp)
+          reactor->done_tail = lastp;
+        rctx->done_queued = 0;
+        return rctx;
+      }
+  return NULL;
+}
+#endif /*USE_REACTOR*/
+
+
+/* Wait up to TIMEOUT milliseconds for events on REACTOR, run the
+   ready I/O callbacks and then call the completion callbacks of the
+   finished operations.  A TIMEOUT of -1 waits forever.  This function
+   may be called by several threads at the same time.  */
+gpgme_error_t
+gpgme_reactor_run (gpgme_reactor_t reactor, int timeout)
+{
+#ifdef USE_REACTOR
+#define REACTOR_MAX_EVENTS 64
+  struct epoll_event events[REACTOR_MAX_EVENTS];
+  gpgme_error_t err = 0;
+  reactor_item_t graveyard = NULL;
+  int i, n;
+
+  TRACE_BEG (DEBUG_CTX, "gpgme_reactor_run", reactor, "timeout=%d", timeout);
+
+  if (!reactor)
+    return TRACE_ERR (gpg_error (GPG_ERR_INV_VALUE));
+
+  LOCK (reactor->lock);
+  reactor->in_dispatch++;
+  if (timeout)
+    reactor->in_wait++;
+  UNLOCK (reactor->lock);
+
+  do
+    n = epoll_wait (reactor->epfd, events, REACTOR_MAX_EVENTS, timeout);
+  while (n < 0 && errno == EINTR);
+  if (n < 0)
+    err = gpg_error_from_syserror ();
+
+  if (timeout)
+    {
+      LOCK (reactor->lock);
+      reactor->in_wait--;
+      UNLOCK (reactor->lock);
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      reactor_item_t item = events[i].data.ptr;
+
+      if (!item)
+        {
+          uint64_t count;
+
+          /* The eventfd; the queued completions are handled below.  */
+          while (read (reactor->evfd, &count, sizeof count) < 0
+                 && errno == EINTR)
+            ;
+          continue;
+        }
+
+      run_item (reactor, item);
+    }
+
+  LOCK (reactor->lock);
+  if (!--reactor->in_dispatch)
+    {
+      graveyard = reactor->graveyard;
+      reactor->graveyard = NULL;
+    }
+  UNLOCK (reactor->lock);
+
+  /* Now call the completion callbacks.  We take them one by one from
+     the queue because a callback may start a new operation or
+     release another context.  */
+  for (;;)
+    {
+      reactor_ctx_t rctx;
+      gpgme_ctx_t ctx = NULL;
+      gpgme_reactor_done_cb_t done_cb = NULL;
+      void *done_cb_value = NULL;
+      gpgme_error_t done_err = 0;
+      gpgme_error_t done_op_err = 0;
+
+      LOCK (reactor->lock);
+      rctx = take_done (reactor);
+      if (rctx)
+        {
+          ctx = rctx->ctx;
+          done_cb = rctx->done_cb;
+          done_cb_value = rctx->done_cb_value;
+          done_err = rctx->err;
+          done_op_err = rctx->op_err;
+        }
+      UNLOCK (reactor->lock);
+      if (!rctx)
+        break;
+
+      TRACE_LOG ("operation on ctx=%p done: %s <%s>",
+                 ctx, gpg_strerror (done_err), gpg_strsource (done_err));
+      (*done_cb) (done_cb_value, ctx, done_err, done_op_err);
+    }
+
+  while (graveyard)
+    {
+      reactor_item_t item = graveyard;
+      graveyard = item->next;
+      free (item);
+    }
+
+  return TRACE_ERR (err);
+#else
+  (void)reactor;
+  (void)timeout;
+  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+#endif
+}
+
+
+/* Run all I/O callbacks which are ready and then call the completion
+   callbacks of the finished operations.  This function never blocks
+   waiting for I/O.  */
+gpgme_error_t
+gpgme_reactor_dispatch (gpgme_reactor_t reactor)
+{
+  return gpgme_reactor_run (reactor, 0);
+}
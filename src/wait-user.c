@@ -62,22 +62,13 @@ _gpgme_user_io_cb_handler (void *data, int fd)
     err = _gpgme_run_io_cb (&ctx->fdt.fds[tag->idx], 0, &op_err);
   if (err || op_err)
     _gpgme_cancel_with_err (ctx, err, op_err);
-  else
+  else if (!ctx->fdt.active)
     {
-      unsigned int i;
+      struct gpgme_io_event_done_data done_data;
 
-      for (i = 0; i < ctx->fdt.size; i++)
-	if (ctx->fdt.fds[i].fd != -1)
-	  break;
-
-      if (i == ctx->fdt.size)
-	{
-	  struct gpgme_io_event_done_data done_data;
-
-	  done_data.err = 0;
-	  done_data.op_err = 0;
-	  _gpgme_engine_io_event (ctx->engine, GPGME_EVENT_DONE, &done_data);
-	}
+      done_data.err = 0;
+      done_data.op_err = 0;
+      _gpgme_engine_io_event (ctx->engine, GPGME_EVENT_DONE, &done_data);
     }
   return 0;
 }
@@ -26,6 +26,7 @@
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #ifdef HAVE_SYS_TYPES_H
 # include <sys/types.h>
 #endif
@@ -38,6 +39,7 @@
 #include "priv-io.h"
 #include "engine.h"
 #include "debug.h"
+#include "sys-util.h"
 
 
 void
@@ -45,6 +47,7 @@ _gpgme_fd_table_init (fd_table_t fdt)
 {
   fdt->fds = NULL;
   fdt->size = 0;
+  fdt->active = 0;
 }
 
 void
@@ -86,6 +89,7 @@ fd_table_put (fd_table_t fdt, int fd, int dir, void *opaque, int *idx)
   fdt->fds[i].for_write = (dir == 0);
   fdt->fds[i].signaled = 0;
   fdt->fds[i].opaque = opaque;
+  fdt->active++;
   *idx = i;
   return 0;
 }
@@ -167,6 +171,8 @@ _gpgme_remove_io_cb (void *data)
   free (tag);
 
   /* Free the table entry.  */
+  assert (fdt->active);
+  fdt->active--;
   fdt->fds[idx].fd = -1;
   fdt->fds[idx].for_read = 0;
   fdt->fds[idx].for_write = 0;
@@ -224,3 +230,26 @@ _gpgme_run_io_cb (struct io_select_fd_s *an_fds, int checked,
   *op_err = iocb_data.op_err;
   return err;
 }
+
+
+/* Return the number of milliseconds left until the deadline of the
+   current operation in CTX expires, 0 if it has expired, or -1 if the
+   operation has no deadline.  */
+int
+_gpgme_wait_deadline_left (gpgme_ctx_t ctx)
+{
+  unsigned long long deadline;
+  unsigned long long now;
+
+  LOCK (ctx->lock);
+  deadline = ctx->deadline;
+  UNLOCK (ctx->lock);
+  if (!deadline)
+    return -1;
+
+  now = _gpgme_monotonic_ms ();
+  if (now >= deadline)
+    return 0;
+  deadline -= now;
+  return deadline > INT_MAX? INT_MAX : (int)deadline;
+}
@@ -29,6 +29,9 @@ struct fd_table
 {
   struct io_select_fd_s *fds;
   size_t size;
+
+  /* The number of entries in FDS which are in use.  */
+  size_t active;
 };
 typedef struct fd_table *fd_table_t;
 
@@ -67,6 +70,7 @@ void _gpgme_wait_private_event_cb (void *data, gpgme_event_io_t type,
 				   void *type_data);
 void _gpgme_wait_global_event_cb (void *data, gpgme_event_io_t type,
 				  void *type_data);
+void _gpgme_wait_global_wakeup (void);
 
 gpgme_error_t _gpgme_wait_user_add_io_cb (void *data, int fd, int dir,
 					  gpgme_io_cb_t fnc, void *fnc_data,
@@ -77,6 +81,10 @@ void _gpgme_wait_user_event_cb (void *data, gpgme_event_io_t type,
 
 gpgme_error_t _gpgme_run_io_cb (struct io_select_fd_s *an_fds, int checked,
 				gpgme_error_t *err);
+int _gpgme_wait_deadline_left (gpgme_ctx_t ctx);
+
+/*-- wait-reactor.c --*/
+void _gpgme_reactor_release_ctx (gpgme_ctx_t ctx);
 
 
 /* Session based interfaces require to make a distinction between IPC
@@ -0,0 +1,200 @@
+/* t-deadline.c - Regression test.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GPGME.
+ *
+ * GPGME is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GPGME is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <https://gnu.org/licenses/>.
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* We need to include config.h so that we know whether we are building
+   with large file system (LFS) support. */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <gpgme.h>
+
+#include "t-support.h"
+
+
+/* The program used as an engine which does not finish in time.  */
+#define SLEEP_PGM "/bin/sleep"
+
+
+static void
+check_timeout (gpgme_error_t err, time_t started)
+{
+  if (gpgme_err_code (err) != GPG_ERR_TIMEOUT)
+    {
+      fprintf (stderr, "%s:%i: expected a timeout, got: %s\n",
+               __FILE__, __LINE__, gpgme_strerror (err));
+      exit (1);
+    }
+  if (time (NULL) - started > 10)
+    {
+      fprintf (stderr, "%s:%i: deadline not enforced in time\n",
+               __FILE__, __LINE__);
+      exit (1);
+    }
+}
+
+
+static void
+check_not_supported (gpgme_error_t err)
+{
+  if (gpgme_err_code (err) != GPG_ERR_NOT_SUPPORTED)
+    {
+      fprintf (stderr, "%s:%i: expected not supported, got: %s\n",
+               __FILE__, __LINE__, gpgme_strerror (err));
+      exit (1);
+    }
+}
+
+
+static gpgme_error_t
+add_io_cb (void *data, int fd, int dir, gpgme_io_cb_t fnc, void *fnc_data,
+	   void **r_tag)
+{
+  (void)data; (void)fd; (void)dir; (void)fnc; (void)fnc_data;
+  *r_tag = NULL;
+  return 0;
+}
+
+
+static void
+remove_io_cb (void *tag)
+{
+  (void)tag;
+}
+
+
+static void
+io_event (void *data, gpgme_event_io_t type, void *type_data)
+{
+  (void)data; (void)type; (void)type_data;
+}
+
+
+static struct gpgme_io_cbs io_cbs =
+  {
+    add_io_cb, NULL, remove_io_cb, io_event, NULL
+  };
+
+
+int
+main (void)
+{
+  gpgme_ctx_t ctx;
+  gpgme_error_t err;
+  gpgme_data_t in, out;
+  gpgme_key_t key[2] = { NULL, NULL };
+  gpgme_ctx_t wctx;
+  const char *argv[] = { "sleep", "30", NULL };
+  const char *s;
+  time_t started;
+
+  init_gpgme (GPGME_PROTOCOL_OpenPGP);
+
+  err = gpgme_new (&ctx);
+  fail_if_err (err);
+
+  err = gpgme_set_ctx_flag (ctx, "deadline-ms", "foo");
+  if (gpgme_err_code (err) != GPG_ERR_INV_VALUE)
+    {
+      fprintf (stderr, "%s:%i: invalid value accepted\n", __FILE__, __LINE__);
+      exit (1);
+    }
+  err = gpgme_set_ctx_flag (ctx, "deadline-ms", "300");
+  fail_if_err (err);
+  s = gpgme_get_ctx_flag (ctx, "deadline-ms");
+  if (!s || strcmp (s, "300"))
+    {
+      fprintf (stderr, "%s:%i: flag not set\n", __FILE__, __LINE__);
+      exit (1);
+    }
+
+  /* A synchronous operation using the private event loop.  The
+     process keeps its stdout open until it is terminated.  */
+  err = gpgme_set_protocol (ctx, GPGME_PROTOCOL_SPAWN);
+  fail_if_err (err);
+  err = gpgme_data_new (&out);
+  fail_if_err (err);
+  started = time (NULL);
+  err = gpgme_op_spawn (ctx, SLEEP_PGM, argv, NULL, out, NULL, 0);
+  check_timeout (err, started);
+  gpgme_data_release (out);
+
+  /* An asynchronous operation run by the global event loop.  */
+  err = gpgme_data_new (&out);
+  fail_if_err (err);
+  started = time (NULL);
+  err = gpgme_op_spawn_start (ctx, SLEEP_PGM, argv, NULL, out, NULL, 0);
+  fail_if_err (err);
+  wctx = gpgme_wait (ctx, &err, 1);
+  if (wctx != ctx)
+    {
+      fprintf (stderr, "%s:%i: wrong context returned\n", __FILE__, __LINE__);
+      exit (1);
+    }
+  check_timeout (err, started);
+  gpgme_data_release (out);
+
+  /* An operation which finishes in time is not affected.  */
+  err = gpgme_set_protocol (ctx, GPGME_PROTOCOL_OpenPGP);
+  fail_if_err (err);
+  err = gpgme_set_ctx_flag (ctx, "deadline-ms", "60000");
+  fail_if_err (err);
+  gpgme_set_armor (ctx, 1);
+  err = gpgme_get_key (ctx, "A0FF4590BB6122EDEF6E3C542D727CC768697734",
+		       &key[0], 0);
+  fail_if_err (err);
+  err = gpgme_data_new_from_mem (&in, "Hallo Leute\n", 12, 0);
+  fail_if_err (err);
+  err = gpgme_data_new (&out);
+  fail_if_err (err);
+  err = gpgme_op_encrypt (ctx, key, GPGME_ENCRYPT_ALWAYS_TRUST, in, out);
+  fail_if_err (err);
+
+  gpgme_key_unref (key[0]);
+  gpgme_data_release (in);
+  gpgme_data_release (out);
+  gpgme_release (ctx);
+
+  /* A deadline can't be enforced with a user event loop.  */
+  err = gpgme_new (&ctx);
+  fail_if_err (err);
+  err = gpgme_set_ctx_flag (ctx, "deadline-ms", "300");
+  fail_if_err (err);
+  err = gpgme_set_protocol (ctx, GPGME_PROTOCOL_SPAWN);
+  fail_if_err (err);
+  gpgme_set_io_cbs (ctx, &io_cbs);
+  err = gpgme_data_new (&out);
+  fail_if_err (err);
+  err = gpgme_op_spawn_start (ctx, SLEEP_PGM, argv, NULL, out, NULL, 0);
+  check_not_supported (err);
+  err = gpgme_set_ctx_flag (ctx, "deadline-ms", "300");
+  check_not_supported (err);
+  err = gpgme_set_ctx_flag (ctx, "deadline-ms", "0");
+  fail_if_err (err);
+  gpgme_data_release (out);
+  gpgme_release (ctx);
+
+  return 0;
+}
@@ -0,0 +1,139 @@
+/* t-engine-stats.c - Regression test.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GPGME.
+ *
+ * GPGME is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GPGME is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <https://gnu.org/licenses/>.
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* We need to include config.h so that we know whether we are building
+   with large file system (LFS) support. */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gpgme.h>
+
+#include "t-support.h"
+
+
+static void
+check_result (gpgme_ctx_t ctx)
+{
+  gpgme_process_result_t result;
+
+  result = gpgme_op_process_result (ctx);
+  if (!result)
+    {
+      fprintf (stderr, "%s:%i: no process result\n", __FILE__, __LINE__);
+      exit (1);
+    }
+  if (result->pid <= 0 || result->exit_status || result->exit_signal)
+    {
+      fprintf (stderr, "%s:%i: unexpected process result: "
+               "pid=%d status=%d signal=%d\n", __FILE__, __LINE__,
+               result->pid, result->exit_status, result->exit_signal);
+      exit (1);
+    }
+}
+
+
+int
+main (void)
+{
+  gpgme_ctx_t ctx;
+  gpgme_error_t err;
+  gpgme_data_t in, out;
+  gpgme_key_t key[3] = { NULL, NULL, NULL };
+  gpgme_ctx_t wctx;
+  const char *s;
+
+  init_gpgme (GPGME_PROTOCOL_OpenPGP);
+
+  err = gpgme_new (&ctx);
+  fail_if_err (err);
+  gpgme_set_armor (ctx, 1);
+
+  err = gpgme_get_key (ctx, "A0FF4590BB6122EDEF6E3C542D727CC768697734",
+		       &key[0], 0);
+  fail_if_err (err);
+  err = gpgme_get_key (ctx, "D695676BDCEDCC2CDD6152BCFE180B1DA9E3B0B2",
+		       &key[1], 0);
+  fail_if_err (err);
+
+  /* Without the flag no result is available.  */
+  if (gpgme_op_process_result (ctx))
+    {
+      fprintf (stderr, "%s:%i: unexpected process result\n",
+               __FILE__, __LINE__);
+      exit (1);
+    }
+
+  err = gpgme_set_ctx_flag (ctx, "engine-stats", "1");
+  fail_if_err (err);
+  s = gpgme_get_ctx_flag (ctx, "engine-stats");
+  if (!s || strcmp (s, "1"))
+    {
+      fprintf (stderr, "%s:%i: flag not set\n", __FILE__, __LINE__);
+      exit (1);
+    }
+
+  err = gpgme_data_new_from_mem (&in, "Hallo Leute\n", 12, 0);
+  fail_if_err (err);
+  err = gpgme_data_new (&out);
+  fail_if_err (err);
+
+  /* A synchronous operation.  */
+  err = gpgme_op_encrypt (ctx, key, GPGME_ENCRYPT_ALWAYS_TRUST, in, out);
+  fail_if_err (err);
+  if (!gpgme_op_process_result (ctx))
+    {
+      /* No pidfd support; the process is reaped with the engine.  */
+      fprintf (stderr, "%s:%i: no process tracking; skipping\n",
+               __FILE__, __LINE__);
+      goto leave;
+    }
+  check_result (ctx);
+
+  /* An asynchronous operation run by the global event loop.  */
+  gpgme_data_seek (in, 0, SEEK_SET);
+  gpgme_data_release (out);
+  err = gpgme_data_new (&out);
+  fail_if_err (err);
+  err = gpgme_op_encrypt_start (ctx, key, GPGME_ENCRYPT_ALWAYS_TRUST,
+                                in, out);
+  fail_if_err (err);
+  wctx = gpgme_wait (ctx, &err, 1);
+  fail_if_err (err);
+  if (wctx != ctx)
+    {
+      fprintf (stderr, "%s:%i: wrong context returned\n", __FILE__, __LINE__);
+      exit (1);
+    }
+  check_result (ctx);
+
+ leave:
+  gpgme_key_unref (key[0]);
+  gpgme_key_unref (key[1]);
+  gpgme_data_release (in);
+  gpgme_data_release (out);
+  gpgme_release (ctx);
+
+  return 0;
+}
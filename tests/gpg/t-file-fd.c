@@ -0,0 +1,136 @@
+/* t-file-fd.c - Regression test.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GPGME.
+ *
+ * GPGME is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GPGME is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <https://gnu.org/licenses/>.
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* We need to include config.h so that we know whether we are building
+   with large file system (LFS) support. */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gpgme.h>
+
+#include "t-support.h"
+
+
+/* Data objects for regular files are passed directly to gpg.  The
+   file must then be used from its current position on and the
+   position must follow the data processed.  */
+
+#define SKIPPED "This line is skipped.\n"
+#define TEXT    "Hallo Leute\n"
+
+
+int
+main (void)
+{
+  gpgme_ctx_t ctx;
+  gpgme_error_t err;
+  gpgme_data_t in, out, plain;
+  gpgme_key_t key[2] = { NULL, NULL };
+  FILE *infp, *outfp;
+  char *agent_info;
+  char *buf;
+  size_t len;
+  off_t off;
+
+  init_gpgme (GPGME_PROTOCOL_OpenPGP);
+
+  err = gpgme_new (&ctx);
+  fail_if_err (err);
+  gpgme_set_armor (ctx, 1);
+
+  agent_info = getenv("GPG_AGENT_INFO");
+  if (!(agent_info && strchr (agent_info, ':')))
+    {
+      gpgme_set_pinentry_mode (ctx, GPGME_PINENTRY_MODE_LOOPBACK);
+      gpgme_set_passphrase_cb (ctx, passphrase_cb, NULL);
+    }
+
+  infp = tmpfile ();
+  outfp = tmpfile ();
+  if (!infp || !outfp)
+    {
+      fprintf (stderr, "%s:%i: can't create temporary files\n",
+               __FILE__, __LINE__);
+      exit (1);
+    }
+  if (write (fileno (infp), SKIPPED TEXT, strlen (SKIPPED TEXT))
+      != strlen (SKIPPED TEXT)
+      || lseek (fileno (infp), strlen (SKIPPED), SEEK_SET)
+      != strlen (SKIPPED))
+    {
+      fprintf (stderr, "%s:%i: can't write temporary file\n",
+               __FILE__, __LINE__);
+      exit (1);
+    }
+
+  err = gpgme_data_new_from_fd (&in, fileno (infp));
+  fail_if_err (err);
+  err = gpgme_data_new_from_fd (&out, fileno (outfp));
+  fail_if_err (err);
+
+  err = gpgme_get_key (ctx, "A0FF4590BB6122EDEF6E3C542D727CC768697734",
+		       &key[0], 0);
+  fail_if_err (err);
+
+  err = gpgme_op_encrypt (ctx, key, GPGME_ENCRYPT_ALWAYS_TRUST, in, out);
+  fail_if_err (err);
+
+  if (gpgme_data_seek (in, 0, SEEK_CUR) != strlen (SKIPPED TEXT))
+    {
+      fprintf (stderr, "%s:%i: input not consumed\n", __FILE__, __LINE__);
+      exit (1);
+    }
+  off = gpgme_data_seek (out, 0, SEEK_CUR);
+  if (off <= 0 || gpgme_data_seek (out, 0, SEEK_END) != off)
+    {
+      fprintf (stderr, "%s:%i: output not written at the position\n",
+               __FILE__, __LINE__);
+      exit (1);
+    }
+
+  err = gpgme_data_seek (out, 0, SEEK_SET);
+  fail_if_err (err);
+  err = gpgme_data_new (&plain);
+  fail_if_err (err);
+  err = gpgme_op_decrypt (ctx, out, plain);
+  fail_if_err (err);
+
+  buf = gpgme_data_release_and_get_mem (plain, &len);
+  if (!buf || len != strlen (TEXT) || memcmp (buf, TEXT, len))
+    {
+      fprintf (stderr, "%s:%i: wrong plaintext\n", __FILE__, __LINE__);
+      exit (1);
+    }
+  gpgme_free (buf);
+
+  gpgme_key_unref (key[0]);
+  gpgme_data_release (in);
+  gpgme_data_release (out);
+  fclose (infp);
+  fclose (outfp);
+  gpgme_release (ctx);
+  return 0;
+}
@@ -0,0 +1,302 @@
+/* t-reactor.c - Regression test.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GPGME.
+ *
+ * GPGME is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GPGME is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <https://gnu.org/licenses/>.
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* We need to include config.h so that we know whether we are building
+   with large file system (LFS) support. */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <gpgme.h>
+
+#include "t-support.h"
+
+
+#define NCTX 8
+#define NTHREADS 4
+
+struct op_result
+{
+  int done;
+  gpgme_error_t err;
+};
+
+static struct op_result op_result[NCTX];
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static int pending;
+
+
+static int
+get_pending (void)
+{
+  int n;
+
+  pthread_mutex_lock (&pending_lock);
+  n = pending;
+  pthread_mutex_unlock (&pending_lock);
+  return n;
+}
+
+
+static void
+done_cb (void *opaque, gpgme_ctx_t ctx, gpgme_error_t err,
+         gpgme_error_t op_err)
+{
+  struct op_result *result = opaque;
+
+  (void)ctx;
+  if (result->done)
+    {
+      fprintf (stderr, "%s:%i: completion reported twice\n",
+               __FILE__, __LINE__);
+      exit (1);
+    }
+  result->done = 1;
+  result->err = err ? err : op_err;
+  pthread_mutex_lock (&pending_lock);
+  pending--;
+  pthread_mutex_unlock (&pending_lock);
+}
+
+
+/* Drive REACTOR from the application's poll loop.  */
+static void
+run_polled (gpgme_reactor_t reactor)
+{
+  struct pollfd pfd;
+  gpgme_error_t err;
+  int n;
+
+  pfd.fd = gpgme_reactor_get_fd (reactor);
+  pfd.events = POLLIN;
+  while (get_pending ())
+    {
+      do
+        n = poll (&pfd, 1, 10000);
+      while (n < 0 && errno == EINTR);
+      if (n <= 0)
+        {
+          fprintf (stderr, "%s:%i: reactor stalled\n", __FILE__, __LINE__);
+          exit (1);
+        }
+      err = gpgme_reactor_dispatch (reactor);
+      fail_if_err (err);
+    }
+}
+
+
+static void *
+worker (void *arg)
+{
+  gpgme_reactor_t reactor = arg;
+  gpgme_error_t err;
+
+  while (get_pending ())
+    {
+      err = gpgme_reactor_run (reactor, 100);
+      fail_if_err (err);
+    }
+  return NULL;
+}
+
+
+/* Drive REACTOR from several threads at once.  */
+static void
+run_threaded (gpgme_reactor_t reactor)
+{
+  pthread_t threads[NTHREADS];
+  int i;
+
+  for (i = 0; i < NTHREADS; i++)
+    if (pthread_create (&threads[i], NULL, worker, reactor))
+      {
+        fprintf (stderr, "%s:%i: failed to create threads\n",
+                 __FILE__, __LINE__);
+        exit (1);
+      }
+  for (i = 0; i < NTHREADS; i++)
+    pthread_join (threads[i], NULL);
+}
+
+
+static void *
+blocking_worker (void *arg)
+{
+  gpgme_reactor_t reactor = arg;
+  gpgme_error_t err;
+
+  while (get_pending ())
+    {
+      err = gpgme_reactor_run (reactor, -1);
+      fail_if_err (err);
+    }
+  return NULL;
+}
+
+
+/* Cancel an operation from the main thread while another thread is
+   blocked in gpgme_reactor_run without a timeout.  The process keeps
+   its stdout open and writes nothing; the thread must be woken up by
+   the completion alone.  */
+static void
+run_cancel (gpgme_reactor_t reactor)
+{
+  const char *argv[] = { "sleep", "10", NULL };
+  gpgme_ctx_t ctx;
+  gpgme_error_t err;
+  gpgme_data_t out;
+  pthread_t thread;
+
+  memset (op_result, 0, sizeof op_result);
+  err = gpgme_new (&ctx);
+  fail_if_err (err);
+  err = gpgme_set_protocol (ctx, GPGME_PROTOCOL_SPAWN);
+  fail_if_err (err);
+  err = gpgme_set_reactor (ctx, reactor, done_cb, &op_result[0]);
+  fail_if_err (err);
+  err = gpgme_data_new (&out);
+  fail_if_err (err);
+
+  pthread_mutex_lock (&pending_lock);
+  pending++;
+  pthread_mutex_unlock (&pending_lock);
+  err = gpgme_op_spawn_start (ctx, "/bin/sleep", argv, NULL, out, NULL, 0);
+  fail_if_err (err);
+
+  if (pthread_create (&thread, NULL, blocking_worker, reactor))
+    {
+      fprintf (stderr, "%s:%i: failed to create thread\n",
+               __FILE__, __LINE__);
+      exit (1);
+    }
+  /* Give the thread time to block.  */
+  usleep (200000);
+  err = gpgme_cancel (ctx);
+  fail_if_err (err);
+  pthread_join (thread, NULL);
+
+  if (gpgme_err_code (op_result[0].err) != GPG_ERR_CANCELED)
+    {
+      fprintf (stderr, "%s:%i: unexpected result: %s\n",
+               __FILE__, __LINE__, gpgme_strerror (op_result[0].err));
+      exit (1);
+    }
+  gpgme_data_release (out);
+  gpgme_release (ctx);
+}
+
+
+static void
+run_round (gpgme_reactor_t reactor, gpgme_key_t *key, int threaded)
+{
+  gpgme_ctx_t ctx[NCTX];
+  gpgme_error_t err;
+  gpgme_data_t in[NCTX], out[NCTX];
+  int i;
+
+  memset (op_result, 0, sizeof op_result);
+  for (i = 0; i < NCTX; i++)
+    {
+      err = gpgme_new (&ctx[i]);
+      fail_if_err (err);
+      gpgme_set_armor (ctx[i], 1);
+      err = gpgme_set_reactor (ctx[i], reactor, done_cb, &op_result[i]);
+      fail_if_err (err);
+
+      err = gpgme_data_new_from_mem (&in[i], "Hallo Leute\n", 12, 0);
+      fail_if_err (err);
+      err = gpgme_data_new (&out[i]);
+      fail_if_err (err);
+
+      pthread_mutex_lock (&pending_lock);
+      pending++;
+      pthread_mutex_unlock (&pending_lock);
+      err = gpgme_op_encrypt_start (ctx[i], key, GPGME_ENCRYPT_ALWAYS_TRUST,
+                                    in[i], out[i]);
+      fail_if_err (err);
+    }
+
+  if (threaded)
+    run_threaded (reactor);
+  else
+    run_polled (reactor);
+
+  for (i = 0; i < NCTX; i++)
+    {
+      fail_if_err (op_result[i].err);
+      if (gpgme_data_seek (out[i], 0, SEEK_END) <= 0)
+        {
+          fprintf (stderr, "%s:%i: no output for ctx %d\n",
+                   __FILE__, __LINE__, i);
+          exit (1);
+        }
+      gpgme_data_release (in[i]);
+      gpgme_data_release (out[i]);
+      gpgme_release (ctx[i]);
+    }
+}
+
+
+int
+main (void)
+{
+  gpgme_reactor_t reactor;
+  gpgme_ctx_t ctx;
+  gpgme_error_t err;
+  gpgme_key_t key[3] = { NULL, NULL, NULL };
+
+  init_gpgme (GPGME_PROTOCOL_OpenPGP);
+
+  err = gpgme_reactor_new (&reactor);
+  if (gpgme_err_code (err) == GPG_ERR_NOT_SUPPORTED)
+    return 0;
+  fail_if_err (err);
+
+  err = gpgme_new (&ctx);
+  fail_if_err (err);
+  err = gpgme_get_key (ctx, "A0FF4590BB6122EDEF6E3C542D727CC768697734",
+		       &key[0], 0);
+  fail_if_err (err);
+  err = gpgme_get_key (ctx, "D695676BDCEDCC2CDD6152BCFE180B1DA9E3B0B2",
+		       &key[1], 0);
+  fail_if_err (err);
+  gpgme_release (ctx);
+
+  run_round (reactor, key, 0);
+  run_round (reactor, key, 1);
+
+  /* Do not hang forever if the blocked thread is not woken up.  */
+  alarm (60);
+  run_cancel (reactor);
+
+  gpgme_reactor_release (reactor);
+  gpgme_key_unref (key[0]);
+  gpgme_key_unref (key[1]);
+
+  return 0;
+}
@@ -0,0 +1,156 @@
+/* run-base64.c - Time the Base64 codec of gpgme-json.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GPGME.
+ *
+ * GPGME is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GPGME is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <https://gnu.org/licenses/>.
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <gpg-error.h>
+
+#define PGM "run-base64"
+
+/* From src/json-b64.c.  */
+size_t json_b64_encode (char *out, const void *buffer, size_t length);
+gpg_error_t json_b64_decode (void *out, const char *string, size_t length,
+                             size_t *r_nbytes);
+
+
+static void
+die (const char *msg)
+{
+  fprintf (stderr, PGM ": %s\n", msg);
+  exit (1);
+}
+
+
+static double
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/* Encode BUFFER with the codec of libgpg-error.  The result is
+ * malloced and its length stored at R_LEN.  */
+static char *
+gpgrt_encode (const void *buffer, size_t length, size_t *r_len)
+{
+  gpgrt_stream_t fp;
+  gpgrt_b64state_t state;
+  void *result;
+
+  fp = gpgrt_fopenmem (0, "w+b");
+  if (!fp)
+    die ("fopenmem failed");
+  state = gpgrt_b64enc_start (fp, "");
+  if (!state
+      || gpgrt_b64enc_write (state, buffer, length)
+      || gpgrt_b64enc_finish (state))
+    die ("gpgrt_b64enc failed");
+  if (gpgrt_fclose_snatch (fp, &result, r_len))
+    die ("fclose_snatch failed");
+  return result;
+}
+
+
+/* Decode STRING with the codec of libgpg-error in place.  Returns the
+ * length of the result.  */
+static size_t
+gpgrt_decode (char *string, size_t length)
+{
+  gpgrt_b64state_t state;
+  size_t n;
+
+  state = gpgrt_b64dec_start (NULL);
+  if (!state
+      || gpgrt_b64dec_proc (state, string, length, &n)
+      || gpgrt_b64dec_finish (state))
+    die ("gpgrt_b64dec failed");
+  return n;
+}
+
+
+int
+main (int argc, char **argv)
+{
+  unsigned char *data;
+  char *enc;
+  size_t size = 64 * 1024 * 1024;
+  size_t enclen, n, i;
+  double t0, t_enc, t_dec, t_rtenc, t_rtdec;
+
+  if (argc)
+    { argc--; argv++; }
+  while (argc && !strncmp (*argv, "--", 2))
+    {
+      if (!strcmp (*argv, "--size") && argc > 1)
+        {
+          size = strtoul (argv[1], NULL, 0);
+          argc -= 2; argv += 2;
+        }
+      else
+        {
+          fputs ("usage: " PGM " [--size N]\n", stderr);
+          return 1;
+        }
+    }
+
+  data = malloc (size + 1);
+  enc = malloc ((size + 2) / 3 * 4 + 1);
+  if (!data || !enc)
+    die ("out of core");
+  for (i = 0; i < size; i++)
+    data[i] = rand ();
+
+  t0 = now ();
+  enclen = json_b64_encode (enc, data, size);
+  t_enc = now () - t0;
+
+  t0 = now ();
+  if (json_b64_decode (data, enc, enclen, &n) || n != size)
+    die ("decoding failed");
+  t_dec = now () - t0;
+
+  t0 = now ();
+  free (gpgrt_encode (data, size, &n));
+  t_rtenc = now () - t0;
+
+  t0 = now ();
+  gpgrt_decode (enc, enclen);
+  t_rtdec = now () - t0;
+
+  printf ("%zu bytes   encode: %.1f MB/s (gpgrt %.1f MB/s)"
+          "   decode: %.1f MB/s (gpgrt %.1f MB/s)\n",
+          size,
+          size / 1e6 / t_enc, size / 1e6 / t_rtenc,
+          size / 1e6 / t_dec, size / 1e6 / t_rtdec);
+
+  free (data);
+  free (enc);
+  return 0;
+}
@@ -0,0 +1,185 @@
+/* run-cjson.c - Time parsing and printing with cJSON.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GPGME.
+ *
+ * GPGME is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GPGME is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <https://gnu.org/licenses/>.
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* This is a benchmark and not run by the test suite.  Each file is
+ * parsed, printed and deleted repeatedly, once with the items taken
+ * from the heap and once from an arena as done by gpgme-json.
+ * Example:
+ *
+ *   ./run-cjson $(srcdir)/t-*.json
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <gpg-error.h>
+
+#include "../../src/cJSON.h"
+
+#define PGM "run-cjson"
+
+
+static int verbose;
+
+
+static void
+die (const char *msg)
+{
+  fprintf (stderr, PGM ": %s\n", msg);
+  exit (1);
+}
+
+
+static double
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static char *
+get_file (const char *fname)
+{
+  FILE *fp;
+  char *buf;
+  long n;
+
+  fp = fopen (fname, "rb");
+  if (!fp)
+    {
+      fprintf (stderr, PGM ": can't open '%s'\n", fname);
+      exit (1);
+    }
+  if (fseek (fp, 0, SEEK_END) || (n = ftell (fp)) < 0
+      || fseek (fp, 0, SEEK_SET))
+    die ("can't get the file length");
+  buf = malloc (n + 1);
+  if (!buf)
+    die ("out of core");
+  if (fread (buf, n, 1, fp) != 1 && n)
+    die ("error reading the file");
+  buf[n] = 0;
+  fclose (fp);
+  return buf;
+}
+
+
+/* Parse, print and delete STRING ITERATIONS times.  Returns the time
+ * used.  */
+static double
+run (const char *string, int iterations, int use_arena)
+{
+  cjson_arena_t arena = NULL;
+  cjson_t json;
+  char *out;
+  double t0;
+  int i;
+
+  t0 = now ();
+  for (i = 0; i < iterations; i++)
+    {
+      if (use_arena)
+        {
+          arena = cJSON_CreateArena ();
+          if (!arena)
+            die ("out of core");
+          cJSON_SetArena (arena);
+        }
+      json = cJSON_Parse (string, NULL);
+      if (!json)
+        die ("parsing failed");
+      out = cJSON_PrintUnformatted (json);
+      if (!out)
+        die ("printing failed");
+      gpgrt_free (out);
+      cJSON_Delete (json);
+      cJSON_ReleaseArena (arena);
+    }
+  return now () - t0;
+}
+
+
+int
+main (int argc, char **argv)
+{
+  int iterations = 10000;
+  double t_heap, t_arena, sum_heap = 0, sum_arena = 0;
+  char *string;
+  size_t total = 0;
+
+  if (argc)
+    { argc--; argv++; }
+  while (argc && !strncmp (*argv, "--", 2))
+    {
+      if (!strcmp (*argv, "--verbose"))
+        {
+          verbose = 1;
+          argc--; argv++;
+        }
+      else if (!strcmp (*argv, "--iterations") && argc > 1)
+        {
+          iterations = atoi (argv[1]);
+          argc -= 2; argv += 2;
+        }
+      else
+        {
+          fputs ("usage: " PGM " [--verbose] [--iterations N] FILES\n",
+                 stderr);
+          return 1;
+        }
+    }
+  if (!argc || iterations < 1)
+    {
+      fputs ("usage: " PGM " [--verbose] [--iterations N] FILES\n", stderr);
+      return 1;
+    }
+
+  for (; argc; argc--, argv++)
+    {
+      string = get_file (*argv);
+      total += strlen (string);
+      /* Warm up the chunk pool of the arena.  */
+      run (string, 1, 1);
+      t_heap = run (string, iterations, 0);
+      t_arena = run (string, iterations, 1);
+      sum_heap += t_heap;
+      sum_arena += t_arena;
+      if (verbose)
+        printf ("%-40s %7zu bytes  heap: %6.2f us  arena: %6.2f us\n",
+                *argv, strlen (string),
+                t_heap * 1e6 / iterations, t_arena * 1e6 / iterations);
+      free (string);
+    }
+
+  printf ("%zu bytes   heap: %.1f MB/s   arena: %.1f MB/s\n",
+          total,
+          total * (double)iterations / 1e6 / sum_heap,
+          total * (double)iterations / 1e6 / sum_arena);
+  return 0;
+}
@@ -0,0 +1,149 @@
+/* t-base64.c - Check the Base64 codec of gpgme-json.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GPGME.
+ *
+ * GPGME is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GPGME is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <https://gnu.org/licenses/>.
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gpg-error.h>
+
+#define PGM "t-base64"
+
+/* From src/json-b64.c.  */
+size_t json_b64_encode (char *out, const void *buffer, size_t length);
+gpg_error_t json_b64_decode (void *out, const char *string, size_t length,
+                             size_t *r_nbytes);
+
+
+static void
+die (const char *msg)
+{
+  fprintf (stderr, PGM ": %s\n", msg);
+  exit (1);
+}
+
+
+/* Encode BUFFER with the codec of libgpg-error.  The result is
+ * malloced and its length stored at R_LEN.  */
+static char *
+gpgrt_encode (const void *buffer, size_t length, size_t *r_len)
+{
+  gpgrt_stream_t fp;
+  gpgrt_b64state_t state;
+  void *result;
+
+  fp = gpgrt_fopenmem (0, "w+b");
+  if (!fp)
+    die ("fopenmem failed");
+  state = gpgrt_b64enc_start (fp, "");
+  if (!state
+      || gpgrt_b64enc_write (state, buffer, length)
+      || gpgrt_b64enc_finish (state))
+    die ("gpgrt_b64enc failed");
+  if (gpgrt_fclose_snatch (fp, &result, r_len))
+    die ("fclose_snatch failed");
+  return result;
+}
+
+
+/* Compare the results of both codecs for all lengths up to MAXLEN.  */
+static void
+check (const unsigned char *data, size_t maxlen)
+{
+  char *ref, *enc, *dec;
+  size_t len, reflen, enclen, declen;
+
+  enc = malloc ((maxlen + 2) / 3 * 4 + 1);
+  dec = malloc (maxlen + 1);
+  if (!enc || !dec)
+    die ("out of core");
+
+  for (len = 0; len <= maxlen; len++)
+    {
+      ref = gpgrt_encode (data, len, &reflen);
+      enclen = json_b64_encode (enc, data, len);
+      if (enclen != reflen || memcmp (enc, ref, enclen))
+        die ("encoding differs");
+      free (ref);
+
+      if (json_b64_decode (dec, enc, enclen, &declen)
+          || declen != len || memcmp (dec, data, len))
+        die ("decoding failed");
+
+      /* Decoding in place with whitespace.  */
+      if (enclen > 4)
+        {
+          memmove (enc + 3, enc + 2, enclen - 2);
+          enc[2] = '\n';
+          if (json_b64_decode (enc, enc, enclen + 1, &declen)
+              || declen != len || memcmp (enc, data, len))
+            die ("decoding in place failed");
+        }
+    }
+
+  free (enc);
+  free (dec);
+}
+
+
+/* Check the handling of malformed input.  Unlike the decoder of
+ * libgpg-error, which skips them, invalid characters are rejected.  */
+static void
+check_invalid (void)
+{
+  static const char *bad[] =
+    { "QUJD!", "QUJDR", "Q", "QUJ-", "QUJ_", "QU JD\x80", NULL };
+  char dec[16];
+  size_t declen;
+  int i;
+
+  for (i = 0; bad[i]; i++)
+    if (!json_b64_decode (dec, bad[i], strlen (bad[i]), &declen))
+      {
+        fprintf (stderr, PGM ": '%s' not rejected\n", bad[i]);
+        exit (1);
+      }
+
+  /* White space is skipped.  */
+  if (json_b64_decode (dec, " QU\r\nJD\tRA== ", 15, &declen)
+      || declen != 4 || memcmp (dec, "ABCD", 4))
+    die ("white space not skipped");
+  if (json_b64_decode (dec, "", 0, &declen) || declen)
+    die ("empty string not decoded");
+}
+
+
+int
+main (void)
+{
+  unsigned char data[300];
+  size_t i;
+
+  for (i = 0; i < sizeof data; i++)
+    data[i] = rand ();
+
+  check (data, sizeof data);
+  check_invalid ();
+  return 0;
+}
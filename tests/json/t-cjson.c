@@ -0,0 +1,289 @@
+/* t-cjson.c - Regression test for the arena of cJSON.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GPGME.
+ *
+ * GPGME is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GPGME is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <https://gnu.org/licenses/>.
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* This test checks that items allocated from an arena print the same
+ * as items from the heap, that they can be deleted with another or no
+ * arena set, and that nothing is leaked.  All memory is allocated by
+ * a checking allocator installed with gpgrt_set_alloc_func.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gpg-error.h>
+
+#include "../../src/cJSON.h"
+
+#define PGM "t-cjson"
+
+/* The test data taken from the other tests.  */
+static const char *files[] =
+  {
+    "t-decrypt.in.json",
+    "t-getmore.out.json",
+    "t-id-getmore.in.json",
+    "t-keylist-secret.out.json",
+    NULL
+  };
+
+static int verbose;
+
+
+static void
+die (const char *msg)
+{
+  fprintf (stderr, PGM ": %s\n", msg);
+  exit (1);
+}
+
+
+/* The header of each block of the checking allocator.  */
+#define BLOCK_MAGIC 0x636a736f6e626c6bUL
+typedef union
+{
+  unsigned long magic;
+  double d;
+  void *p;
+} block_header_t;
+
+/* The number of allocated blocks.  */
+static long nblocks;
+
+
+/* A realloc function for gpgrt_set_alloc_func which counts the
+ * blocks and dies if asked to release memory it did not allocate.  */
+static void *
+check_realloc (void *a, size_t n)
+{
+  block_header_t *hdr = NULL;
+
+  if (a)
+    {
+      hdr = (block_header_t *)a - 1;
+      if (hdr->magic != BLOCK_MAGIC)
+        die ("release of memory not allocated from the heap");
+    }
+  if (!n)
+    {
+      if (hdr)
+        {
+          hdr->magic = 0;
+          free (hdr);
+          nblocks--;
+        }
+      return NULL;
+    }
+  hdr = realloc (hdr, sizeof *hdr + n);
+  if (!hdr)
+    return NULL;
+  if (!a)
+    nblocks++;
+  hdr->magic = BLOCK_MAGIC;
+  return hdr + 1;
+}
+
+
+static char *
+get_file (const char *fname)
+{
+  const char *srcdir = getenv ("top_srcdir");
+  char *name;
+  FILE *fp;
+  char *buf;
+  long n;
+
+  if (!srcdir)
+    die ("envvar top_srcdir not set");
+  name = malloc (strlen (srcdir) + strlen (fname) + 20);
+  if (!name)
+    die ("out of core");
+  sprintf (name, "%s/tests/json/%s", srcdir, fname);
+  fp = fopen (name, "rb");
+  if (!fp)
+    {
+      fprintf (stderr, PGM ": can't open '%s'\n", name);
+      exit (1);
+    }
+  free (name);
+  if (fseek (fp, 0, SEEK_END) || (n = ftell (fp)) < 0
+      || fseek (fp, 0, SEEK_SET))
+    die ("can't get the file length");
+  buf = malloc (n + 1);
+  if (!buf)
+    die ("out of core");
+  if (fread (buf, n, 1, fp) != 1 && n)
+    die ("error reading the file");
+  buf[n] = 0;
+  fclose (fp);
+  return buf;
+}
+
+
+/* Parse STRING.  If R_BUFFER is not NULL the string is parsed in
+ * place from a copy which is stored there.  */
+static cjson_t
+parse (const char *string, char **r_buffer)
+{
+  cjson_t json;
+
+  if (r_buffer)
+    {
+      *r_buffer = gpgrt_strdup (string);
+      if (!*r_buffer)
+        die ("out of core");
+      json = cJSON_ParseInPlace (*r_buffer, NULL);
+    }
+  else
+    json = cJSON_Parse (string, NULL);
+  if (!json)
+    die ("parsing failed");
+  return json;
+}
+
+
+static void
+check_print (cjson_t json, const char *expected, const char *what)
+{
+  char *out;
+
+  out = cJSON_PrintUnformatted (json);
+  if (!out)
+    die ("printing failed");
+  if (strcmp (out, expected))
+    {
+      fprintf (stderr, PGM ": %s prints differently\n", what);
+      exit (1);
+    }
+  gpgrt_free (out);
+}
+
+
+/* Check the data STRING with the items taken from the heap and from
+ * arenas.  */
+static void
+check_string (const char *string)
+{
+  cjson_arena_t arena, other;
+  cjson_t json, copy, item, heapitem;
+  char *expected, *buffer;
+
+  json = parse (string, NULL);
+  expected = cJSON_PrintUnformatted (json);
+  if (!expected)
+    die ("printing failed");
+  cJSON_Delete (json);
+
+  /* Parse with an arena; delete with no arena set.  */
+  arena = cJSON_CreateArena ();
+  if (!arena)
+    die ("out of core");
+  cJSON_SetArena (arena);
+  json = parse (string, NULL);
+  cJSON_SetArena (NULL);
+  check_print (json, expected, "parsed into an arena");
+
+  /* A copy made without an arena is independent of the arena.  */
+  copy = cJSON_Duplicate (json, 1);
+  if (!copy)
+    die ("out of core");
+  cJSON_Delete (json);
+  cJSON_ReleaseArena (arena);
+  check_print (copy, expected, "copy from an arena");
+  cJSON_Delete (copy);
+
+  /* Parse in place with an arena; delete with another arena set.  */
+  arena = cJSON_CreateArena ();
+  other = cJSON_CreateArena ();
+  if (!arena || !other)
+    die ("out of core");
+  cJSON_SetArena (arena);
+  json = parse (string, &buffer);
+  check_print (json, expected, "parsed in place into an arena");
+  cJSON_SetArena (other);
+  copy = cJSON_Duplicate (json, 1);
+  if (!copy)
+    die ("out of core");
+  cJSON_Delete (json);
+  gpgrt_free (buffer);
+  cJSON_SetArena (NULL);
+  cJSON_ReleaseArena (arena);
+  check_print (copy, expected, "copy into another arena");
+
+  /* Mix the items of the other arena and of the heap.  */
+  heapitem = cJSON_CreateString ("from the heap");
+  json = cJSON_CreateObject ();
+  if (!heapitem || !json)
+    die ("out of core");
+  cJSON_SetArena (other);
+  item = cJSON_CreateString ("from the arena");
+  if (!item)
+    die ("out of core");
+  cJSON_AddItemToObject (json, "arena", item);
+  cJSON_AddItemToObject (copy, "heap", heapitem);
+  cJSON_SetArena (NULL);
+  cJSON_AddItemToObject (json, "copy", copy);
+  cJSON_Delete (json);
+  cJSON_ReleaseArena (other);
+
+  gpgrt_free (expected);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  long nblocks_warm = 0;
+  char *strings[sizeof files / sizeof *files];
+  int i, round;
+
+  gpgrt_set_alloc_func (check_realloc);
+
+  if (argc > 1 && !strcmp (argv[1], "--verbose"))
+    verbose = 1;
+
+  for (i = 0; files[i]; i++)
+    strings[i] = get_file (files[i]);
+
+  /* The first round fills the pool of arena chunks; the following
+   * rounds must not allocate any more memory.  */
+  for (round = 0; round < 4; round++)
+    {
+      for (i = 0; files[i]; i++)
+        {
+          if (verbose && !round)
+            printf ("%s\n", files[i]);
+          check_string (strings[i]);
+        }
+      if (verbose)
+        printf ("round %d: %ld blocks\n", round, nblocks);
+      if (!round)
+        nblocks_warm = nblocks;
+      else if (nblocks != nblocks_warm)
+        die ("memory leak detected");
+    }
+
+  for (i = 0; files[i]; i++)
+    free (strings[i]);
+  return 0;
+}
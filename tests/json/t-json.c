@@ -27,7 +27,12 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
 #include <sys/stat.h>
+#ifndef HAVE_W32_SYSTEM
+# include <unistd.h>
+# include <sys/wait.h>
+#endif
 
 #include <gpgme.h>
 #include <gpg-error.h>
@@ -47,6 +52,34 @@ static const char*tests[] = { "t-config", "t-version",
     "t-delete", "t-import",
     NULL };
 
+/* Register session tests here.  The input file of a session is an
+ * array of requests which are sent one after the other to gpgme-json
+ * using the Native Messaging protocol; the output file is the array
+ * of the expected responses.  A string "$NAME" as a top level value
+ * of an expected response matches any string and stores it in the
+ * variable NAME; "$+NAME" appends it to that variable.  A string
+ * "$NAME" as a top level value of a request is replaced by the value
+ * of the variable.  The pseudo request {"t-json":"decode","var":NAME}
+ * is not sent; instead the Base-64 encoded JSON object in the
+ * variable NAME is checked against its expected response.  */
+static struct {
+  const char *name;
+  const char *option;  /* An additional option for gpgme-json.  */
+} sessions[] = {
+  { "t-getmore", NULL },
+  { "t-id-getmore", NULL },
+  { "t-keylist-cursor", "--check-writer" },
+  { "t-spool", "--spool-threshold=512" },
+  { NULL, NULL }
+};
+
+/* The variables of a session.  */
+#define MAX_VARS 16
+static struct {
+  char *name;
+  char *value;
+} vars[MAX_VARS];
+
 static int verbose = 0;
 
 
@@ -101,9 +134,10 @@ get_file (const char *fname)
 }
 
 /* Check that the element needle exists in hay. Returns 0 if
-   the needle was found. */
+   the needle was found.  If VARS is set, a string starting with a
+   '$' is a variable of a session and matches any string.  */
 int
-test_contains (cjson_t needle, cjson_t hay)
+test_contains (cjson_t needle, cjson_t hay, int vars)
 {
   cjson_t it;
 
@@ -139,7 +173,9 @@ test_contains (cjson_t needle, cjson_t hay)
     {
       if (strcmp (needle->valuestring, hay->valuestring) &&
           /* Use * as a general don't care placeholder */
-          strcmp (needle->valuestring, "*"))
+          strcmp (needle->valuestring, "*") &&
+          /* A variable of a session matches any string.  */
+          !(vars && *needle->valuestring == '$'))
         {
           if (verbose)
             fprintf (stderr, "%s: string mismatch Expected '%s' got '%s'\n",
@@ -156,14 +192,14 @@ test_contains (cjson_t needle, cjson_t hay)
           fprintf (stderr, "Depth mismatch. Expected child for %s\n",
                    nonnull (needle->string));
         }
-      else if (test_contains (needle->child, hay->child))
+      else if (test_contains (needle->child, hay->child, vars))
         {
           int found = 0;
           cjson_t hit;
 
           for (hit = hay->child; hit; hit = hit->next)
             {
-              found |= !test_contains (needle->child, hit);
+              found |= !test_contains (needle->child, hit, vars);
               if (found)
                 {
                   break;
@@ -199,7 +235,7 @@ test_contains (cjson_t needle, cjson_t hay)
             }
           for (; hit && hit->child; hit = hit->next)
             {
-              found |= !test_contains (it->child, hit->child);
+              found |= !test_contains (it->child, hit->child, vars);
               if (found)
                 {
                   break;
@@ -219,7 +255,7 @@ test_contains (cjson_t needle, cjson_t hay)
               !strcmp (hit->string, it->string))
             {
               found = 1;
-              if (test_contains (it, hit))
+              if (test_contains (it, hit, vars))
                 {
                   return 1;
                 }
@@ -238,7 +274,7 @@ test_contains (cjson_t needle, cjson_t hay)
 
 
 int
-check_response (const char *response, const char *expected)
+check_response (const char *response, const char *expected, int vars)
 {
   cjson_t hay;
   cjson_t needle;
@@ -262,7 +298,7 @@ check_response (const char *response, const char *expected)
       return 1;
     }
 
-  rc = test_contains (needle, hay);
+  rc = test_contains (needle, hay, vars);
 
   cJSON_Delete (needle);
   cJSON_Delete (hay);
@@ -279,7 +315,7 @@ run_test (const char *test, const char *gpgme_json)
   gpgme_data_t json_stderr = NULL;
   char *test_in;
   char *test_out;
-  const char *argv[3];
+  const char *argv[4];
   char *response;
   char *expected = NULL;
   size_t response_size;
@@ -309,7 +345,9 @@ run_test (const char *test, const char *gpgme_json)
 
   argv[0] = gpgme_json;
   argv[1] = "-s";
-  argv[2] = NULL;
+  /* Check the text of the listed keys against cJSON.  */
+  argv[2] = "--check-writer";
+  argv[3] = NULL;
 
   fail_if_err (gpgme_op_spawn (ctx, gpgme_json, argv,
                                json_stdin,
@@ -324,7 +362,7 @@ run_test (const char *test, const char *gpgme_json)
 
       test (expected);
 
-      rc = check_response (response, expected);
+      rc = check_response (response, expected, 0);
     }
   else
     {
@@ -361,12 +399,348 @@ run_test (const char *test, const char *gpgme_json)
   return rc;
 }
 
+#ifndef HAVE_W32_SYSTEM
+/* Return the value of the session variable NAME or NULL.  */
+static const char *
+get_var (const char *name)
+{
+  int i;
+
+  for (i = 0; i < MAX_VARS && vars[i].name; i++)
+    if (!strcmp (vars[i].name, name))
+      return vars[i].value;
+  return NULL;
+}
+
+
+/* Set the session variable NAME to VALUE or append VALUE to it.  */
+static void
+set_var (const char *name, const char *value, int append)
+{
+  int i;
+  char *p;
+
+  for (i = 0; i < MAX_VARS && vars[i].name; i++)
+    if (!strcmp (vars[i].name, name))
+      break;
+  if (i == MAX_VARS)
+    {
+      fprintf (stderr, "Error: too many variables\n");
+      exit (1);
+    }
+  if (!vars[i].name)
+    {
+      vars[i].name = strdup (name);
+      vars[i].value = strdup ("");
+      if (!vars[i].name || !vars[i].value)
+        fail_if_err (gpg_error_from_syserror ());
+    }
+  p = gpgrt_bsprintf ("%s%s", append? vars[i].value : "", value);
+  if (!p)
+    fail_if_err (gpg_error_from_syserror ());
+  free (vars[i].value);
+  vars[i].value = p;
+}
+
+
+/* Release all session variables.  */
+static void
+clear_vars (void)
+{
+  int i;
+
+  for (i = 0; i < MAX_VARS && vars[i].name; i++)
+    {
+      free (vars[i].name);
+      free (vars[i].value);
+      vars[i].name = vars[i].value = NULL;
+    }
+}
+
+
+/* Replace the variables in REQUEST by their values.  */
+static void
+substitute_vars (cjson_t request)
+{
+  cjson_t item;
+  const char *value;
+
+  for (item = request->child; item; item = item->next)
+    if (cjson_is_string (item) && *item->valuestring == '$')
+      {
+        value = get_var (item->valuestring + 1);
+        if (!value)
+          {
+            fprintf (stderr, "Error: variable '%s' not set\n",
+                     item->valuestring + 1);
+            exit (1);
+          }
+        gpgrt_free (item->valuestring);
+        item->valuestring = gpgrt_strdup (value);
+        if (!item->valuestring)
+          fail_if_err (gpg_error_from_syserror ());
+      }
+}
+
+
+/* Store the values matched by the variables of EXPECTED, which has
+ * already been checked against RESPONSE.  */
+static void
+capture_vars (const char *response, cjson_t expected)
+{
+  cjson_t json, item, hit;
+  const char *name;
+
+  json = cJSON_Parse (response, NULL);
+  if (!json)
+    return;
+  for (item = expected->child; item; item = item->next)
+    if (cjson_is_string (item) && *item->valuestring == '$' && item->string
+        && (hit = cJSON_GetObjectItem (json, item->string))
+        && cjson_is_string (hit))
+      {
+        name = item->valuestring + 1;
+        if (*name == '+')
+          set_var (name + 1, hit->valuestring, 1);
+        else
+          set_var (name, hit->valuestring, 0);
+      }
+  cJSON_Delete (json);
+}
+
+
+/* Return the Base-64 decoded value of the variable NAME as a
+ * string.  */
+static char *
+decode_var (const char *name)
+{
+  gpgrt_b64state_t state;
+  const char *value;
+  char *buf;
+  size_t len;
+
+  value = get_var (name);
+  if (!value)
+    {
+      fprintf (stderr, "Error: variable '%s' not set\n", name);
+      exit (1);
+    }
+  buf = strdup (value);
+  if (!buf)
+    fail_if_err (gpg_error_from_syserror ());
+  state = gpgrt_b64dec_start (NULL);
+  if (!state)
+    fail_if_err (gpg_error_from_syserror ());
+  fail_if_err (gpgrt_b64dec_proc (state, buf, strlen (buf), &len));
+  fail_if_err (gpgrt_b64dec_finish (state));
+  buf[len] = 0;
+  return buf;
+}
+
+
+/* Write all LENGTH bytes of BUFFER to FD.  */
+static void
+write_all (int fd, const void *buffer, size_t length)
+{
+  const char *p = buffer;
+  ssize_t n;
+
+  while (length)
+    {
+      n = write (fd, p, length);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        fail_if_err (gpg_error_from_syserror ());
+      p += n;
+      length -= n;
+    }
+}
+
+
+/* Read exactly LENGTH bytes from FD into BUFFER.  Returns -1 on EOF
+ * or error.  */
+static int
+read_all (int fd, void *buffer, size_t length)
+{
+  char *p = buffer;
+  ssize_t n;
+
+  while (length)
+    {
+      n = read (fd, p, length);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return -1;
+      p += n;
+      length -= n;
+    }
+  return 0;
+}
+
+
+/* Send REQUEST to FD and return the response read from RFD or NULL
+ * if there is none.  */
+static char *
+exchange_message (int fd, int rfd, const char *request)
+{
+  uint32_t n;
+  char *response;
+
+  n = strlen (request);
+  write_all (fd, &n, sizeof n);
+  write_all (fd, request, n);
+
+  if (read_all (rfd, &n, sizeof n))
+    return NULL;
+  response = malloc ((size_t)n + 1);
+  if (!response)
+    fail_if_err (gpg_error_from_syserror ());
+  if (read_all (rfd, response, n))
+    {
+      free (response);
+      return NULL;
+    }
+  response[n] = 0;
+  return response;
+}
+
+
+int
+run_session (const char *test, const char *option, const char *gpgme_json)
+{
+  char *test_in, *test_out;
+  char *buf;
+  cjson_t requests, responses, request, expected, item;
+  const char *argv[4];
+  int inpipe[2], outpipe[2];
+  pid_t pid;
+  int status;
+  int i, count;
+  char *text, *response;
+  int rc = 0;
+  const char *top_srcdir = getenv ("top_srcdir");
+
+  if (!top_srcdir)
+    {
+      fprintf (stderr, "Error top_srcdir environment variable not set\n");
+      exit(1);
+    }
+
+  gpgrt_asprintf (&test_in, "%s/tests/json/%s.in.json",
+                  top_srcdir, test);
+  gpgrt_asprintf (&test_out, "%s/tests/json/%s.out.json",
+                  top_srcdir, test);
+
+  printf ("Running %s...\n", test);
+
+  buf = get_file (test_in);
+  test (buf);
+  requests = cJSON_Parse (buf, NULL);
+  free (buf);
+  buf = get_file (test_out);
+  test (buf);
+  responses = cJSON_Parse (buf, NULL);
+  free (buf);
+  test (requests && cjson_is_array (requests));
+  test (responses && cjson_is_array (responses));
+  count = cJSON_GetArraySize (requests);
+  test (count == cJSON_GetArraySize (responses));
+
+  argv[0] = gpgme_json;
+  argv[1] = option? option : NULL;
+  argv[2] = NULL;
+
+  if (pipe (inpipe) || pipe (outpipe))
+    fail_if_err (gpg_error_from_syserror ());
+  pid = fork ();
+  if (pid == -1)
+    fail_if_err (gpg_error_from_syserror ());
+  if (!pid)
+    {
+      dup2 (inpipe[0], 0);
+      dup2 (outpipe[1], 1);
+      close (inpipe[0]);
+      close (inpipe[1]);
+      close (outpipe[0]);
+      close (outpipe[1]);
+      execv (gpgme_json, (char *const *)argv);
+      _exit (127);
+    }
+  close (inpipe[0]);
+  close (outpipe[1]);
+
+  for (i = 0; !rc && i < count; i++)
+    {
+      request = cJSON_GetArrayItem (requests, i);
+      expected = cJSON_GetArrayItem (responses, i);
+
+      item = cJSON_GetObjectItem (request, "t-json");
+      if (item)
+        {
+          item = cJSON_GetObjectItem (request, "var");
+          test (item && cjson_is_string (item));
+          response = decode_var (item->valuestring);
+        }
+      else
+        {
+          substitute_vars (request);
+          text = cJSON_PrintUnformatted (request);
+          test (text);
+          response = exchange_message (inpipe[1], outpipe[0], text);
+          free (text);
+        }
+      if (!response)
+        {
+          printf (" failed, no response from gpgme-json for request %d\n",
+                  i + 1);
+          rc = 1;
+          break;
+        }
+
+      text = cJSON_PrintUnformatted (expected);
+      test (text);
+      rc = check_response (response, text, 1);
+      free (text);
+      if (rc)
+        printf (" failed at request %d; response:\n%s\n", i + 1, response);
+      else
+        capture_vars (response, expected);
+      free (response);
+    }
+
+  close (inpipe[1]);
+  close (outpipe[0]);
+  while (waitpid (pid, &status, 0) == -1 && errno == EINTR)
+    ;
+  if (!rc && !(WIFEXITED (status) && !WEXITSTATUS (status)))
+    {
+      printf (" failed, gpgme-json terminated abnormally\n");
+      rc = 1;
+    }
+  if (!rc)
+    printf (" success\n");
+
+  clear_vars ();
+  cJSON_Delete (requests);
+  cJSON_Delete (responses);
+  free (test_out);
+  free (test_in);
+  return rc;
+}
+#endif /*!HAVE_W32_SYSTEM*/
+
+
 int
 main (int argc, char *argv[])
 {
   const char *gpgme_json = getenv ("gpgme_json");
   int last_argc = -1;
   const char **test;
+#ifndef HAVE_W32_SYSTEM
+  int i;
+#endif
 
   if (argc)
     { argc--; argv++; }
@@ -399,5 +773,14 @@ main (int argc, char *argv[])
           exit(1);
         }
     }
+#ifndef HAVE_W32_SYSTEM
+  for (i = 0; sessions[i].name; i++)
+    {
+      if (run_session (sessions[i].name, sessions[i].option, gpgme_json))
+        {
+          exit(1);
+        }
+    }
+#endif
   return 0;
 }
@@ -0,0 +1,228 @@
+/* run-tool-load.c - Put the socket server of gpgme-tool under load.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GPGME.
+ *
+ * GPGME is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GPGME is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <https://gnu.org/licenses/>.
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* This is not a unit test but a tool to measure the throughput of
+ * "gpgme-tool --socket".  Each client connects to the server and
+ * sends the command a number of times; the rate of commands and
+ * their latency is printed at the end.  Example:
+ *
+ *   gpgme-tool --socket /tmp/gt.sock &
+ *   run-tool-load --clients 32 --requests 100 /tmp/gt.sock "KEYLIST foo"
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <gpg-error.h>
+#include <assuan.h>
+
+#define PGM "run-tool-load"
+
+static int verbose;
+static const char *socket_name;
+static const char *command = "VERSION";
+static int requests = 100;
+
+
+struct client
+{
+  pthread_t thread;
+  int failed;        /* Number of failed commands.  */
+  size_t nbytes;     /* Number of data bytes received.  */
+  double latency;    /* Sum of the latencies.  */
+  double max_latency;
+};
+
+
+static void
+show_usage (int ex)
+{
+  fputs ("usage: " PGM " [options] SOCKET [COMMAND]\n\n"
+         "Options:\n"
+         "  --verbose       run in verbose mode\n"
+         "  --clients N     run N clients at once (default 8)\n"
+         "  --requests N    send the command N times per client"
+         " (default 100)\n"
+         , stderr);
+  exit (ex);
+}
+
+
+static double
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static gpg_error_t
+data_cb (void *opaque, const void *buffer, size_t length)
+{
+  struct client *client = opaque;
+
+  (void)buffer;
+  client->nbytes += length;
+  return 0;
+}
+
+
+static void *
+client_thread (void *arg)
+{
+  struct client *client = arg;
+  assuan_context_t ctx;
+  gpg_error_t err;
+  double t0, t;
+  int i;
+
+  err = assuan_new (&ctx);
+  if (!err)
+    err = assuan_socket_connect (ctx, socket_name, ASSUAN_INVALID_PID, 0);
+  if (err)
+    {
+      fprintf (stderr, PGM ": can't connect to '%s': %s\n",
+               socket_name, gpg_strerror (err));
+      client->failed = requests;
+      return NULL;
+    }
+
+  for (i = 0; i < requests; i++)
+    {
+      t0 = now ();
+      err = assuan_transact (ctx, command, data_cb, client,
+                             NULL, NULL, NULL, NULL);
+      t = now () - t0;
+      if (err)
+        {
+          if (verbose)
+            fprintf (stderr, PGM ": '%s' failed: %s\n",
+                     command, gpg_strerror (err));
+          client->failed++;
+        }
+      client->latency += t;
+      if (t > client->max_latency)
+        client->max_latency = t;
+    }
+
+  assuan_release (ctx);
+  return NULL;
+}
+
+
+int
+main (int argc, char **argv)
+{
+  int last_argc = -1;
+  int nclients = 8;
+  struct client *clients;
+  double t0, elapsed, latency = 0, max_latency = 0;
+  size_t nbytes = 0;
+  int failed = 0;
+  int i;
+
+  if (argc)
+    { argc--; argv++; }
+
+  while (argc && last_argc != argc )
+    {
+      last_argc = argc;
+      if (!strcmp (*argv, "--"))
+        {
+          argc--; argv++;
+          break;
+        }
+      else if (!strcmp (*argv, "--help"))
+        show_usage (0);
+      else if (!strcmp (*argv, "--verbose"))
+        {
+          verbose = 1;
+          argc--; argv++;
+        }
+      else if (!strcmp (*argv, "--clients"))
+        {
+          argc--; argv++;
+          if (!argc)
+            show_usage (1);
+          nclients = atoi (*argv);
+          argc--; argv++;
+        }
+      else if (!strcmp (*argv, "--requests"))
+        {
+          argc--; argv++;
+          if (!argc)
+            show_usage (1);
+          requests = atoi (*argv);
+          argc--; argv++;
+        }
+      else if (!strncmp (*argv, "--", 2))
+        show_usage (1);
+    }
+
+  if (argc < 1 || argc > 2 || nclients < 1 || requests < 1)
+    show_usage (1);
+  socket_name = argv[0];
+  if (argc > 1)
+    command = argv[1];
+
+  clients = calloc (nclients, sizeof *clients);
+  if (!clients)
+    {
+      fputs (PGM ": out of core\n", stderr);
+      exit (1);
+    }
+
+  t0 = now ();
+  for (i = 0; i < nclients; i++)
+    if (pthread_create (&clients[i].thread, NULL,
+                        client_thread, clients + i))
+      {
+        fputs (PGM ": failed to create thread\n", stderr);
+        exit (1);
+      }
+  for (i = 0; i < nclients; i++)
+    {
+      pthread_join (clients[i].thread, NULL);
+      failed += clients[i].failed;
+      nbytes += clients[i].nbytes;
+      latency += clients[i].latency;
+      if (clients[i].max_latency > max_latency)
+        max_latency = clients[i].max_latency;
+    }
+  elapsed = now () - t0;
+
+  printf ("%d clients  %d requests  %d failed  %zu bytes  %.2f s\n"
+          "%.1f requests/s  latency: %.2f ms avg  %.2f ms max\n",
+          nclients, nclients * requests, failed, nbytes, elapsed,
+          nclients * requests / elapsed,
+          latency * 1000 / (nclients * requests), max_latency * 1000);
+
+  free (clients);
+  return !!failed;
+}
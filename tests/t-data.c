@@ -29,6 +29,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#ifndef HAVE_W32_SYSTEM
+# include <unistd.h>
+#endif
 
 #define PGM "t-data"
 #include "run-support.h"
@@ -174,6 +177,604 @@ write_test (round_t round, gpgme_data_t data)
 }
 
 
+/* Check a file which is large enough to be mapped instead of being
+   read into memory.  The file is sparse and has TEXT at an unaligned
+   offset and at its end.  */
+#define LARGE_FILE_NAME   "t-data-large.tmp"
+#define LARGE_FILE_SIZE   (17 * 1024 * 1024)
+#define LARGE_FILE_OFFSET 4097
+
+static void
+check_text (const char *where, gpgme_data_t data)
+{
+  char buffer[64];
+  gpgme_ssize_t amt;
+
+  amt = gpgme_data_read (data, buffer, strlen (text));
+  if (amt != strlen (text) || strncmp (buffer, text, strlen (text)))
+    {
+      fprintf (stderr, "%s:%d: %s: gpgme_data_read returned wrong data\n",
+	       __FILE__, __LINE__, where);
+      exit (1);
+    }
+}
+
+static void
+large_file_test (void)
+{
+  round_t round = TEST_END;
+  gpgme_error_t err;
+  gpgme_data_t data;
+  FILE *fp;
+  char buffer[16];
+  char *buf;
+  size_t len;
+  size_t part_len = LARGE_FILE_SIZE - LARGE_FILE_OFFSET;
+
+  fp = fopen (LARGE_FILE_NAME, "wb");
+  if (!fp
+      || fseek (fp, LARGE_FILE_OFFSET, SEEK_SET)
+      || fwrite (text, strlen (text), 1, fp) != 1
+      || fseek (fp, LARGE_FILE_SIZE - strlen (text), SEEK_SET)
+      || fwrite (text, strlen (text), 1, fp) != 1
+      || fclose (fp))
+    {
+      fprintf (stderr, "%s:%d: creating %s failed: %s\n", __FILE__, __LINE__,
+	       LARGE_FILE_NAME, strerror (errno));
+      exit (1);
+    }
+
+  /* Reading and seeking.  */
+  err = gpgme_data_new_from_filepart (&data, LARGE_FILE_NAME, NULL,
+				      LARGE_FILE_OFFSET, part_len);
+  fail_if_err (err);
+  check_text ("start", data);
+  if (gpgme_data_seek (data, -(gpgme_off_t)strlen (text), SEEK_END)
+      != part_len - strlen (text))
+    {
+      fprintf (stderr, "%s:%d: gpgme_data_seek failed\n", __FILE__, __LINE__);
+      exit (1);
+    }
+  check_text ("end", data);
+  if (gpgme_data_read (data, buffer, sizeof buffer))
+    {
+      fprintf (stderr, "%s:%d: gpgme_data_read did not signal EOF\n",
+	       __FILE__, __LINE__);
+      exit (1);
+    }
+  gpgme_data_release (data);
+
+  /* Writing to a mapped file does not change the file.  */
+  err = gpgme_data_new_from_file (&data, LARGE_FILE_NAME, 1);
+  fail_if_err (err);
+  if (gpgme_data_write (data, "X", 1) == 1)
+    {
+      gpgme_data_seek (data, 0, SEEK_SET);
+      buf = gpgme_data_release_and_get_mem (data, &len);
+      if (!buf || len != LARGE_FILE_SIZE || *buf != 'X'
+	  || strncmp (buf + LARGE_FILE_OFFSET, text, strlen (text)))
+	{
+	  fprintf (stderr, "%s:%d: wrong data after write\n",
+		   __FILE__, __LINE__);
+	  exit (1);
+	}
+      gpgme_free (buf);
+    }
+  else
+    gpgme_data_release (data);  /* The streaming fallback is read-only.  */
+
+  err = gpgme_data_new_from_file (&data, LARGE_FILE_NAME, 1);
+  fail_if_err (err);
+  gpgme_data_seek (data, LARGE_FILE_OFFSET, SEEK_SET);
+  check_text ("unchanged", data);
+  gpgme_data_release (data);
+
+  remove (LARGE_FILE_NAME);
+}
+
+
+/* Check a memory data object which stores its data in chunks.  */
+#define CHUNKED_SIZE (3 * 1024 * 1024 + 17)
+
+static void
+chunked_test (void)
+{
+  round_t round = TEST_END;
+  gpgme_error_t err;
+  gpgme_data_t data;
+  char buffer[7919];
+  const void *chunk;
+  size_t i, n, len;
+  char *buf;
+
+  /* The flag may only be set on an empty object.  */
+  err = gpgme_data_new_from_mem (&data, text, strlen (text), 0);
+  fail_if_err (err);
+  err = gpgme_data_set_flag (data, "chunked", "1");
+  if (gpgme_err_code (err) != GPG_ERR_CONFLICT)
+    {
+      fprintf (stderr, "%s:%d: flag accepted for non-empty object\n",
+	       __FILE__, __LINE__);
+      exit (1);
+    }
+  gpgme_data_release (data);
+
+  err = gpgme_data_new (&data);
+  fail_if_err (err);
+  err = gpgme_data_set_flag (data, "chunked", "1");
+  fail_if_err (err);
+
+  /* Write a pattern in pieces which do not match the chunk size.  */
+  for (i = 0; i < CHUNKED_SIZE; i += n)
+    {
+      n = CHUNKED_SIZE - i < sizeof buffer ? CHUNKED_SIZE - i : sizeof buffer;
+      for (len = 0; len < n; len++)
+	buffer[len] = (i + len) % 251;
+      if (gpgme_data_write (data, buffer, n) != n)
+	fail_if_err (gpgme_error_from_errno (errno));
+    }
+
+  /* Overwrite a range crossing a chunk boundary.  */
+  if (gpgme_data_seek (data, 4090, SEEK_SET) != 4090
+      || gpgme_data_write (data, "XXXXXXXXXXXX", 12) != 12)
+    fail_if_err (gpgme_error_from_errno (errno));
+
+  /* Read it back with random access.  */
+  if (gpgme_data_seek (data, 4088, SEEK_SET) != 4088
+      || gpgme_data_read (data, buffer, 16) != 16
+      || memcmp (buffer, "HIXXXXXXXXXXXXVW", 16))
+    {
+      fprintf (stderr, "%s:%d: wrong data after overwrite\n",
+	       __FILE__, __LINE__);
+      exit (1);
+    }
+  if (gpgme_data_seek (data, 1, SEEK_END) != -1)
+    {
+      fprintf (stderr, "%s:%d: seek beyond end succeeded\n",
+	       __FILE__, __LINE__);
+      exit (1);
+    }
+
+  /* Iterate over the chunks without copying.  */
+  gpgme_data_seek (data, 0, SEEK_SET);
+  for (i = 0; ; i += len)
+    {
+      err = gpgme_data_read_chunk (data, &chunk, &len);
+      fail_if_err (err);
+      if (!len)
+	break;
+      for (n = 0; n < len; n++)
+	if (((const char *)chunk)[n] != (char)((i + n) % 251)
+	    && !(i + n >= 4090 && i + n < 4102))
+	  {
+	    fprintf (stderr, "%s:%d: wrong data at %zu\n",
+		     __FILE__, __LINE__, i + n);
+	    exit (1);
+	  }
+    }
+  if (i != CHUNKED_SIZE)
+    {
+      fprintf (stderr, "%s:%d: chunks cover %zu bytes\n",
+	       __FILE__, __LINE__, i);
+      exit (1);
+    }
+
+  /* Peeking joins the chunks.  */
+  err = gpgme_data_peek_mem (data, &chunk, &len);
+  fail_if_err (err);
+  if (len != CHUNKED_SIZE || ((const char *)chunk)[4101] != 'X'
+      || ((const char *)chunk)[4102] != (char)(4102 % 251))
+    {
+      fprintf (stderr, "%s:%d: wrong data from gpgme_data_peek_mem\n",
+	       __FILE__, __LINE__);
+      exit (1);
+    }
+
+  buf = gpgme_data_release_and_get_mem (data, &len);
+  if (!buf || len != CHUNKED_SIZE || buf[0] != 0 || buf[4090] != 'X'
+      || buf[CHUNKED_SIZE - 1] != (char)((CHUNKED_SIZE - 1) % 251))
+    {
+      fprintf (stderr, "%s:%d: wrong data from release_and_get_mem\n",
+	       __FILE__, __LINE__);
+      exit (1);
+    }
+  gpgme_free (buf);
+
+  /* A plain memory object is returned in one piece.  */
+  err = gpgme_data_new_from_mem (&data, text, strlen (text), 0);
+  fail_if_err (err);
+  err = gpgme_data_read_chunk (data, &chunk, &len);
+  fail_if_err (err);
+  if (chunk != text || len != strlen (text))
+    {
+      fprintf (stderr, "%s:%d: wrong data from gpgme_data_read_chunk\n",
+	       __FILE__, __LINE__);
+      exit (1);
+    }
+  gpgme_data_release (data);
+}
+
+
+/* Check that the content of memory data objects can be accessed
+   without copying it.  */
+static void
+peek_take_test (void)
+{
+  round_t round = TEST_END;
+  gpgme_error_t err;
+  gpgme_data_t data;
+  const void *view;
+  void *buf;
+  size_t len;
+
+  err = gpgme_data_new_from_mem (&data, text, strlen (text), 0);
+  fail_if_err (err);
+  err = gpgme_data_peek_mem (data, &view, &len);
+  fail_if_err (err);
+  if (view != text || len != strlen (text))
+    {
+      fprintf (stderr, "%s:%d: wrong data from gpgme_data_peek_mem\n",
+	       __FILE__, __LINE__);
+      exit (1);
+    }
+  check_text ("peek", data);
+  err = gpgme_data_take_mem (data, &buf, &len);
+  fail_if_err (err);
+  if (!buf || buf == text || len != strlen (text)
+      || memcmp (buf, text, len))
+    {
+      fprintf (stderr, "%s:%d: wrong data from gpgme_data_take_mem\n",
+	       __FILE__, __LINE__);
+      exit (1);
+    }
+  gpgme_free (buf);
+
+  /* The object is empty now but can still be used.  */
+  err = gpgme_data_peek_mem (data, &view, &len);
+  fail_if_err (err);
+  if (view || len)
+    {
+      fprintf (stderr, "%s:%d: object not empty after gpgme_data_take_mem\n",
+	       __FILE__, __LINE__);
+      exit (1);
+    }
+  if (gpgme_data_write (data, text, strlen (text)) != strlen (text))
+    fail_if_err (gpgme_error_from_errno (errno));
+  err = gpgme_data_peek_mem (data, &view, &len);
+  fail_if_err (err);
+  err = gpgme_data_take_mem (data, &buf, &len);
+  fail_if_err (err);
+  if (buf != view || len != strlen (text))
+    {
+      fprintf (stderr, "%s:%d: gpgme_data_take_mem copied the buffer\n",
+	       __FILE__, __LINE__);
+      exit (1);
+    }
+  gpgme_free (buf);
+  gpgme_data_release (data);
+}
+
+
+/* Digest callback for tee_test which sums up the bytes.  */
+static void
+sum_cb (void *opaque, const void *buffer, size_t length)
+{
+  unsigned long *sum = opaque;
+  const unsigned char *p = buffer;
+
+  while (length--)
+    *sum += *p++;
+}
+
+
+/* Check that a tee forwards to all sinks.  */
+static void
+tee_test (void)
+{
+  round_t round = TEST_END;
+  gpgme_error_t err;
+  gpgme_data_t sinks[3] = { NULL, NULL, NULL };
+  gpgme_data_t data;
+  unsigned long sum = 0;
+  const unsigned char *p;
+  char buffer[64];
+  int i;
+
+  err = gpgme_data_new (&sinks[0]);
+  fail_if_err (err);
+  err = gpgme_data_new (&sinks[1]);
+  fail_if_err (err);
+  err = gpgme_data_new_tee (&data, sinks, sum_cb, &sum);
+  fail_if_err (err);
+
+  for (i = 0; i < 2; i++)
+    if (gpgme_data_write (data, text, strlen (text)) != strlen (text))
+      fail_if_err (gpgme_error_from_errno (errno));
+
+  if (gpgme_data_seek (data, 0, SEEK_CUR) != 2 * strlen (text)
+      || gpgme_data_seek (data, 0, SEEK_SET) != -1
+      || gpgme_data_read (data, buffer, sizeof buffer) != -1)
+    {
+      fprintf (stderr, "%s:%d: wrong seek or read result for tee\n",
+	       __FILE__, __LINE__);
+      exit (1);
+    }
+  gpgme_data_release (data);
+
+  for (p = (const unsigned char *)text; *p; p++)
+    sum -= 2 * *p;
+  if (sum)
+    {
+      fprintf (stderr, "%s:%d: digest callback not called correctly\n",
+	       __FILE__, __LINE__);
+      exit (1);
+    }
+
+  for (i = 0; i < 2; i++)
+    {
+      gpgme_data_seek (sinks[i], 0, SEEK_SET);
+      check_text ("tee", sinks[i]);
+      check_text ("tee", sinks[i]);
+      gpgme_data_release (sinks[i]);
+    }
+}
+
+
+/* Check the Base64 adapters by encoding TEXT2 and decoding it
+   again.  */
+static void
+base64_test (void)
+{
+  static const char *titles[] = { NULL, "", "PGP MESSAGE" };
+  round_t round = TEST_END;
+  gpgme_error_t err;
+  gpgme_data_t data, inner;
+  char buffer[64];
+  const void *view;
+  size_t len;
+  int i, armored;
+
+  for (i = 0; i < sizeof titles / sizeof *titles; i++)
+    {
+      err = gpgme_data_new (&inner);
+      fail_if_err (err);
+      if (gpgme_data_write (inner, "junk\n", 5) != 5)
+        fail_if_err (gpgme_error_from_errno (errno));
+      err = gpgme_data_new_base64 (&data, inner, titles[i],
+                                   GPGME_DATA_BASE64_ENCODE);
+      fail_if_err (err);
+      if (gpgme_data_write (data, text2, 3) != 3
+          || gpgme_data_write (data, text2 + 3, strlen (text2) - 3)
+          != strlen (text2) - 3
+          || gpgme_data_seek (data, 0, SEEK_CUR) != strlen (text2))
+        fail_if_err (gpgme_error_from_errno (errno));
+      gpgme_data_release (data);
+
+      /* Armor is found after the junk, plain Base64 is decoded
+         without it.  */
+      armored = titles[i] && *titles[i];
+      gpgme_data_seek (inner, armored? 0 : 5, SEEK_SET);
+      err = gpgme_data_new_base64 (&data, inner, armored? "" : NULL,
+                                   GPGME_DATA_BASE64_OWN);
+      fail_if_err (err);
+      check_text ("base64", data);
+      if (gpgme_data_seek (data, 0, SEEK_SET))
+        fail_if_err (gpgme_error_from_errno (errno));
+      check_text ("base64 rewind", data);
+      if (gpgme_data_seek (data, strlen (text2) - 2, SEEK_SET)
+          != strlen (text2) - 2
+          || gpgme_data_read (data, buffer, sizeof buffer) != 2
+          || memcmp (buffer, "!\n", 2)
+          || gpgme_data_read (data, buffer, sizeof buffer))
+        {
+          fprintf (stderr, "%s:%d: (%d) wrong data at end of Base64\n",
+                   __FILE__, __LINE__, i);
+          exit (1);
+        }
+      gpgme_data_release (data);
+    }
+
+  /* Armor written with a title can be found in other text.  */
+  err = gpgme_data_new (&inner);
+  fail_if_err (err);
+  err = gpgme_data_new_base64 (&data, inner, "PGP MESSAGE",
+                               GPGME_DATA_BASE64_ENCODE);
+  fail_if_err (err);
+  if (gpgme_data_write (data, text, strlen (text)) != strlen (text))
+    fail_if_err (gpgme_error_from_errno (errno));
+  gpgme_data_release (data);
+  err = gpgme_data_peek_mem (inner, &view, &len);
+  fail_if_err (err);
+  if (len < 30 || memcmp (view, "-----BEGIN PGP MESSAGE-----\n", 28))
+    {
+      fprintf (stderr, "%s:%d: armor header missing\n", __FILE__, __LINE__);
+      exit (1);
+    }
+  gpgme_data_release (inner);
+}
+
+
+/* Sensitive data is kept in locked memory; it must behave like any
+   other memory based data object.  */
+static void
+sensitive_test (void)
+{
+  round_t round = TEST_END;
+  gpgme_error_t err;
+  gpgme_data_t data;
+  char buffer[100];
+  char *buf;
+  size_t len;
+  int i;
+
+  err = gpgme_data_new (&data);
+  fail_if_err (err);
+  err = gpgme_data_set_flag (data, "sensitive", "1");
+  fail_if_err (err);
+  for (i = 0; i < 2000; i++)
+    if (gpgme_data_write (data, text, strlen (text)) != strlen (text))
+      fail_if_err (gpgme_error_from_errno (errno));
+  if (gpgme_data_seek (data, 0, SEEK_SET))
+    fail_if_err (gpgme_error_from_errno (errno));
+  for (i = 0; i < 2000; i++)
+    if (gpgme_data_read (data, buffer, strlen (text)) != strlen (text)
+        || memcmp (buffer, text, strlen (text)))
+      {
+        fprintf (stderr, "%s:%d: wrong sensitive data\n", __FILE__, __LINE__);
+        exit (1);
+      }
+  buf = gpgme_data_release_and_get_mem (data, &len);
+  if (!buf || len != 2000 * strlen (text) || memcmp (buf, text, strlen (text)))
+    {
+      fprintf (stderr, "%s:%d: wrong sensitive buffer\n", __FILE__, __LINE__);
+      exit (1);
+    }
+  gpgme_free (buf);
+
+  /* An object becoming sensitive after it has been filled.  */
+  err = gpgme_data_new_from_mem (&data, text, strlen (text), 1);
+  fail_if_err (err);
+  err = gpgme_data_set_flag (data, "sensitive", "1");
+  fail_if_err (err);
+  if (gpgme_data_write (data, text, strlen (text)) != strlen (text))
+    fail_if_err (gpgme_error_from_errno (errno));
+  if (gpgme_data_seek (data, 0, SEEK_SET))
+    fail_if_err (gpgme_error_from_errno (errno));
+  check_text ("sensitive", data);
+  gpgme_data_release (data);
+
+  /* A sensitive chunked object.  */
+  err = gpgme_data_new (&data);
+  fail_if_err (err);
+  err = gpgme_data_set_flag (data, "sensitive", "1");
+  fail_if_err (err);
+  err = gpgme_data_set_flag (data, "chunked", "1");
+  fail_if_err (err);
+  for (i = 0; i < 2000; i++)
+    if (gpgme_data_write (data, text, strlen (text)) != strlen (text))
+      fail_if_err (gpgme_error_from_errno (errno));
+  if (gpgme_data_seek (data, 0, SEEK_SET))
+    fail_if_err (gpgme_error_from_errno (errno));
+  for (i = 0; i < 2000; i++)
+    if (gpgme_data_read (data, buffer, strlen (text)) != strlen (text)
+        || memcmp (buffer, text, strlen (text)))
+      {
+        fprintf (stderr, "%s:%d: wrong sensitive data\n", __FILE__, __LINE__);
+        exit (1);
+      }
+  buf = gpgme_data_release_and_get_mem (data, &len);
+  if (!buf || len != 2000 * strlen (text) || memcmp (buf, text, strlen (text)))
+    {
+      fprintf (stderr, "%s:%d: wrong sensitive buffer\n", __FILE__, __LINE__);
+      exit (1);
+    }
+  gpgme_free (buf);
+
+  /* A single sensitive chunk is not handed out from the pool.  */
+  err = gpgme_data_new (&data);
+  fail_if_err (err);
+  err = gpgme_data_set_flag (data, "sensitive", "1");
+  fail_if_err (err);
+  err = gpgme_data_set_flag (data, "chunked", "1");
+  fail_if_err (err);
+  if (gpgme_data_write (data, text, strlen (text)) != strlen (text))
+    fail_if_err (gpgme_error_from_errno (errno));
+  buf = gpgme_data_release_and_get_mem (data, &len);
+  if (!buf || len != strlen (text) || memcmp (buf, text, len))
+    {
+      fprintf (stderr, "%s:%d: wrong sensitive buffer\n", __FILE__, __LINE__);
+      exit (1);
+    }
+  gpgme_free (buf);
+}
+
+
+/* Data is identified without consuming it, even if it can't seek.  */
+static void
+identify_test (void)
+{
+  round_t round = TEST_END;
+  static const char key[] =
+    "Some text before the key.\n"
+    "-----BEGIN PGP PUBLIC KEY BLOCK-----\n"
+    "\n"
+    "mDMEXEcE6RYJKwYBBAHaRw8BAQdArjWwk3FAqyiFbFBKT4TzXcVBqPTB3gmzlC/U\n"
+    "-----END PGP PUBLIC KEY BLOCK-----\n";
+  static const char cert[] =
+    "-----BEGIN CERTIFICATE-----\n"
+    "MIIBszCCAVmgAwIBAgIUJ1n7GfB7Q8KNbUpCJbxMQrRyzlowCgYIKoZIzj0EAwIw\n"
+    "-----END CERTIFICATE-----\n";
+  const void *buffers[4];
+  size_t lengths[4];
+  gpgme_data_type_t types[4];
+  gpgme_error_t err;
+  gpgme_data_t data;
+
+  err = gpgme_data_new_from_mem (&data, key, strlen (key), 0);
+  fail_if_err (err);
+  if (gpgme_data_identify (data, 0) != GPGME_DATA_TYPE_PGP_KEY
+      || gpgme_data_seek (data, 0, SEEK_CUR) != 0)
+    {
+      fprintf (stderr, "%s:%d: memory data not identified\n",
+               __FILE__, __LINE__);
+      exit (1);
+    }
+  gpgme_data_release (data);
+
+#ifndef HAVE_W32_SYSTEM
+  {
+    int fds[2];
+    char buffer[sizeof key];
+    size_t n = 0;
+    gpgme_ssize_t amt;
+
+    if (pipe (fds)
+        || write (fds[1], key, strlen (key)) != strlen (key)
+        || close (fds[1]))
+      fail_if_err (gpgme_error_from_errno (errno));
+    err = gpgme_data_new_from_fd (&data, fds[0]);
+    fail_if_err (err);
+    if (gpgme_data_identify (data, 0) != GPGME_DATA_TYPE_PGP_KEY)
+      {
+        fprintf (stderr, "%s:%d: pipe data not identified\n",
+                 __FILE__, __LINE__);
+        exit (1);
+      }
+    while ((amt = gpgme_data_read (data, buffer + n, 10)) > 0)
+      n += amt;
+    if (amt < 0 || n != strlen (key) || memcmp (buffer, key, n))
+      {
+        fprintf (stderr, "%s:%d: pipe data consumed by identify\n",
+                 __FILE__, __LINE__);
+        exit (1);
+      }
+    gpgme_data_release (data);
+    close (fds[0]);
+  }
+#endif /*!HAVE_W32_SYSTEM*/
+
+  buffers[0] = key;
+  lengths[0] = strlen (key);
+  buffers[1] = cert;
+  lengths[1] = strlen (cert);
+  buffers[2] = text;
+  lengths[2] = strlen (text);
+  buffers[3] = cert;
+  lengths[3] = 20;   /* Too short.  */
+  err = gpgme_data_identify_mem (buffers, lengths, 4, types);
+  fail_if_err (err);
+  if (types[0] != GPGME_DATA_TYPE_PGP_KEY
+      || types[1] != GPGME_DATA_TYPE_X509_CERT
+      || types[2] != GPGME_DATA_TYPE_UNKNOWN
+      || types[3] != GPGME_DATA_TYPE_UNKNOWN)
+    {
+      fprintf (stderr, "%s:%d: wrong types from gpgme_data_identify_mem\n",
+               __FILE__, __LINE__);
+      exit (1);
+    }
+}
+
+
 int
 main (void)
 {
@@ -268,6 +869,14 @@ main (void)
       gpgme_data_release (data);
     }
  out:
+  large_file_test ();
+  chunked_test ();
+  peek_take_test ();
+  tee_test ();
+  base64_test ();
+  sensitive_test ();
+  identify_test ();
+
   free (text_filename);
   free (longer_text_filename);
   return 0;
@@ -0,0 +1,290 @@
+/* t-tool-socket.c - Regression test for gpgme-tool --socket.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GPGME.
+ *
+ * GPGME is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GPGME is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <https://gnu.org/licenses/>.
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* This test starts "gpgme-tool --socket", checks the permissions of
+ * the socket, and has two clients send several commands at once
+ * without waiting for the replies in between.  It then checks that
+ * clients which sent only a partial line do not keep the workers
+ * from serving another client.  The commands used do not need an
+ * engine.  */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <gpgme.h>
+
+#define PGM "t-tool-socket"
+#define SOCKET_NAME "t-tool-socket.S"
+
+static int verbose;
+static pid_t server_pid = -1;
+
+
+static void
+stop_server (void)
+{
+  int status;
+
+  if (server_pid == -1)
+    return;
+  kill (server_pid, SIGTERM);
+  while (waitpid (server_pid, &status, 0) == -1 && errno == EINTR)
+    ;
+  server_pid = -1;
+  unlink (SOCKET_NAME);
+}
+
+
+static void
+fail (const char *format, const char *arg)
+{
+  fprintf (stderr, PGM ": ");
+  fprintf (stderr, format, arg);
+  putc ('\n', stderr);
+  stop_server ();
+  exit (1);
+}
+
+
+static void
+alarm_handler (int signo)
+{
+  (void)signo;
+  if (server_pid != -1)
+    kill (server_pid, SIGTERM);
+  unlink (SOCKET_NAME);
+  _exit (1);
+}
+
+
+static void
+start_server (const char *pgm)
+{
+  server_pid = fork ();
+  if (server_pid == -1)
+    fail ("fork failed: %s", strerror (errno));
+  if (!server_pid)
+    {
+      /* The socket shall not depend on the umask of the caller.  */
+      umask (022);
+      execl (pgm, pgm, "--socket", SOCKET_NAME, "--workers", "2", NULL);
+      fprintf (stderr, PGM ": can't exec '%s': %s\n", pgm, strerror (errno));
+      _exit (1);
+    }
+}
+
+
+/* Connect to the server; retry until it listens.  */
+static int
+connect_server (void)
+{
+  struct sockaddr_un addr;
+  int fd, i;
+
+  memset (&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, SOCKET_NAME);
+
+  for (i = 0; i < 200; i++)
+    {
+      fd = socket (AF_UNIX, SOCK_STREAM, 0);
+      if (fd == -1)
+        fail ("can't create socket: %s", strerror (errno));
+      if (!connect (fd, (struct sockaddr *)&addr, sizeof addr))
+        return fd;
+      close (fd);
+      usleep (50000);
+    }
+  fail ("can't connect to '%s'", SOCKET_NAME);
+  return -1;
+}
+
+
+static void
+write_all (int fd, const char *buffer)
+{
+  size_t length = strlen (buffer);
+  ssize_t n;
+
+  while (length)
+    {
+      n = write (fd, buffer, length);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n == -1)
+        fail ("write failed: %s", strerror (errno));
+      buffer += n;
+      length -= n;
+    }
+}
+
+
+/* Read a line from FD into BUFFER, which has room for SIZE bytes,
+ * and strip the LF.  */
+static void
+read_line (int fd, char *buffer, size_t size)
+{
+  size_t len = 0;
+  ssize_t n;
+  char c;
+
+  for (;;)
+    {
+      n = read (fd, &c, 1);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n == -1)
+        fail ("read failed: %s", strerror (errno));
+      if (!n)
+        fail ("unexpected EOF", NULL);
+      if (c == '\n')
+        break;
+      if (len + 1 < size)
+        buffer[len++] = c;
+    }
+  buffer[len] = 0;
+  if (verbose)
+    fprintf (stderr, PGM ": got '%s'\n", buffer);
+}
+
+
+/* Read a line from FD and check that it starts with PREFIX.  */
+static void
+expect_line (int fd, const char *prefix)
+{
+  char line[1002];
+
+  read_line (fd, line, sizeof line);
+  if (strncmp (line, prefix, strlen (prefix)))
+    fail ("unexpected reply '%s'", line);
+}
+
+
+/* The commands of a client sent in one go and the expected replies.  */
+static const char commands[] =
+  "HASH_ALGO_NAME 2\n"
+  "PUBKEY_ALGO_NAME 1\n"
+  "NO_SUCH_COMMAND\n"
+  "STRERROR 0\n"
+  "VERSION\n"
+  "BYE\n";
+
+
+static void
+check_replies (int fd)
+{
+  char line[1002];
+
+  expect_line (fd, "D SHA1");
+  expect_line (fd, "OK");
+  expect_line (fd, "D RSA");
+  expect_line (fd, "OK");
+  expect_line (fd, "ERR ");
+  expect_line (fd, "D Success");
+  expect_line (fd, "OK");
+  read_line (fd, line, sizeof line);
+  if (strncmp (line, "D ", 2)
+      || strcmp (line + 2, gpgme_check_version (NULL)))
+    fail ("unexpected reply '%s'", line);
+  expect_line (fd, "OK");
+  expect_line (fd, "OK");
+}
+
+
+int
+main (int argc, char **argv)
+{
+  const char *pgm = getenv ("gpgme_tool");
+  struct stat st;
+  int fd1, fd2, fd3;
+
+  if (argc > 1 && !strcmp (argv[1], "--verbose"))
+    verbose = 1;
+  if (!pgm)
+    {
+      fprintf (stderr, PGM ": envvar gpgme_tool not set\n");
+      exit (1);
+    }
+  gpgme_check_version (NULL);
+
+  signal (SIGALRM, alarm_handler);
+  alarm (60);
+  unlink (SOCKET_NAME);
+  start_server (pgm);
+
+  fd1 = connect_server ();
+  fd2 = connect_server ();
+
+  if (stat (SOCKET_NAME, &st))
+    fail ("can't stat socket: %s", strerror (errno));
+  if ((st.st_mode & (S_IRWXG | S_IRWXO)))
+    fail ("socket '%s' is accessible by others", SOCKET_NAME);
+
+  expect_line (fd1, "OK");
+  expect_line (fd2, "OK");
+  write_all (fd1, commands);
+  write_all (fd2, commands);
+  check_replies (fd2);
+  check_replies (fd1);
+  close (fd1);
+  close (fd2);
+
+  /* Occupy both workers with a partial line each.  */
+  fd1 = connect_server ();
+  fd2 = connect_server ();
+  fd3 = connect_server ();
+  expect_line (fd1, "OK");
+  expect_line (fd2, "OK");
+  expect_line (fd3, "OK");
+  write_all (fd1, "NO");
+  write_all (fd2, "NO");
+  usleep (200000);
+
+  /* Lines which arrive in one go are all processed.  */
+  write_all (fd3, "NOP\nNOP\n");
+  expect_line (fd3, "OK");
+  expect_line (fd3, "OK");
+
+  /* The partial lines are completed.  */
+  write_all (fd1, "P\n");
+  write_all (fd2, "P\nNOP\n");
+  expect_line (fd1, "OK");
+  expect_line (fd2, "OK");
+  expect_line (fd2, "OK");
+  close (fd1);
+  close (fd2);
+  close (fd3);
+
+  stop_server ();
+  return 0;
+}